@@ -5,12 +5,16 @@
 #include "ecs/registry.h"
 #include "ecs/systems.h"
 #include "gen.h"
+#include "geometryArena.h"
+#include "glState.h"
 #include "mesh.h"
 #include "objectBuilder.h"
 #include "resource_manager.h"
 #include "uniformBuffer.h"
 #include <GLFW/glfw3.h>
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <cstdlib>
 #include <glm/common.hpp>
 #include <glm/ext/scalar_constants.hpp>
@@ -37,7 +41,23 @@ App::App(int width, int height, const std::string &title)
     std::cerr << "Failed to initialize GLAD" << std::endl;
     exit(-1);
   }
-  ShaderResult shaderLoadResult = shader.loadShaders();
+  useIndirectDraw = INDIRECT_DRAW && IndirectDrawBuffer::isSupported();
+  std::vector<std::string> defines;
+  if (useIndirectDraw) {
+    defines.push_back("INDIRECT_DRAW");
+  } else if (INDIRECT_DRAW) {
+    std::cerr << "No GL 4.3 multi-draw indirect, using instanced draws"
+              << std::endl;
+  }
+  useMaterialTable =
+      useIndirectDraw && MATERIAL_TABLE && MaterialTable::isSupported();
+  if (useMaterialTable) {
+    defines.push_back("MATERIAL_TABLE");
+  } else if (useIndirectDraw && MATERIAL_TABLE) {
+    std::cerr << "No ARB_copy_image, materials use bound textures"
+              << std::endl;
+  }
+  ShaderResult shaderLoadResult = shader.loadShaders(defines);
   if (shaderLoadResult != ShaderResult::Success) {
     std::cerr << "Failed to load shaders: "
               << static_cast<int>(shaderLoadResult) << std::endl;
@@ -56,25 +76,102 @@ App::App(int width, int height, const std::string &title)
   // glCullFace(GL_BACK);
   // glFrontFace(GL_CCW);
 
+  resourceManager.setTextureCompression(COMPRESS_TEXTURES &&
+                                        Texture::supportsBC1());
+  resourceManager.getTextureStreamer().setBudget(TEXTURE_STREAMING_BUDGET_MB
+                                                 << 20);
+
   glfwSetWindowUserPointer(window.getGLFWwindow(), this);
   glfwSetKeyCallback(window.getGLFWwindow(), key_callback);
   glfwSetFramebufferSizeCallback(window.getGLFWwindow(),
                                  framebuffer_size_callback);
 }
 
-void App::loadObjectFromConfig(const ObjectConfig &cfg) {
+App::~App() {
+  // The last meshes using the white texture then delete it with the other
+  // members, before window terminates GLFW
+  Texture::releaseWhite();
+}
+
+int App::loadObjectFromConfig(const ObjectConfig &cfg) {
   int obj = registry.createEntity();
 
   if (!cfg.mesh.path.empty()) {
-    auto mesh = resourceManager.loadMesh(cfg.mesh.path, cfg.mesh.name,
-                                         cfg.mesh.texturePath);
-    registry.setMesh(obj, std::optional<MeshComp>({mesh}));
+    MeshComp meshComp;
+    meshComp.mesh = resourceManager.loadMeshAsync(
+        cfg.mesh.path, cfg.mesh.name, cfg.mesh.texturePath, &meshComp.lods);
+    registry.setMesh(obj, std::optional<MeshComp>(meshComp));
 
   } else if (!cfg.sweep.points.empty()) {
-    auto mesh = resourceManager.loadMesh(
-        cfg.sweep.points, cfg.sweep.pathSegments, cfg.sweep.circleSegments,
-        cfg.sweep.radius, cfg.sweep.color);
-    registry.setMesh(obj, std::optional<MeshComp>({mesh}));
+    // Straight rails and branches are instances of a shared unit cylinder,
+    // leaves of a shared disc; only curved sweeps get geometry of their own
+    const Sweep &sweep = cfg.sweep;
+    MeshComp base{nullptr, sweep.color};
+    Primitive primitive =
+        Mesh::matchPrimitive(sweep.points, sweep.radius, base.localMatrix);
+    if (primitive != Primitive::None) {
+      base.primitive = true;
+      base.localNormalMatrix =
+          glm::transpose(glm::inverse(glm::mat3(base.localMatrix)));
+    }
+
+    // Long static sweeps (the coaster track) are split into sections, each
+    // culled and given its LOD on its own, at most one per path segment of
+    // the coarsest level
+    int sections = 1;
+    bool animated = cfg.sineAnim.amplitude != 0.f ||
+                    cfg.rotationAnim.rpm != 0.f || !cfg.parAnim.points.empty();
+    if (primitive == Primitive::None && !animated) {
+      float length = 0.f;
+      for (size_t i = 1; i < sweep.points.size(); ++i) {
+        length += glm::length(sweep.points[i] - sweep.points[i - 1]);
+      }
+      int coarsestPath = sweep.pathSegments, coarsestCircle = 0;
+      sweepLodSegments(LOD_LEVELS - 1, coarsestPath, coarsestCircle);
+      sections = std::clamp(int(std::ceil(length / SWEEP_SECTION_LENGTH)), 1,
+                            coarsestPath);
+    }
+
+    for (int section = 0; section < sections; ++section) {
+      MeshComp meshComp = base;
+      meshComp.mesh =
+          primitive != Primitive::None
+              ? resourceManager.loadPrimitive(primitive, sweep.circleSegments)
+              : resourceManager.loadMeshAsync(
+                    sweep.points, sweep.pathSegments, sweep.circleSegments,
+                    sweep.radius, section, sections);
+
+      // Coarser levels until the resolution stops dropping (primitives have
+      // no path resolution)
+      int pathSegments = sweep.pathSegments;
+      int circleSegments = sweep.circleSegments;
+      for (int level = 1; level < LOD_LEVELS; ++level) {
+        int path = sweep.pathSegments, circle = sweep.circleSegments;
+        sweepLodSegments(level, path, circle);
+        if (circle == circleSegments &&
+            (path == pathSegments || primitive != Primitive::None))
+          break;
+        pathSegments = path;
+        circleSegments = circle;
+        meshComp.lods.push_back(
+            primitive != Primitive::None
+                ? resourceManager.loadPrimitive(primitive, circle)
+                : resourceManager.loadMeshAsync(sweep.points, path, circle,
+                                                sweep.radius, section,
+                                                sections));
+      }
+      // The occluder box has to fit inside every level
+      if (primitive == Primitive::Cylinder) {
+        meshComp.cylinderSides = circleSegments;
+      }
+
+      // The first section is obj, the others only share its transform
+      int id = section == 0 ? obj : registry.createEntity();
+      registry.setMesh(id, std::optional<MeshComp>(meshComp));
+      if (id != obj) {
+        registry.setTransform(id, cfg.transform);
+      }
+    }
   }
 
   registry.setTransform(obj, cfg.transform);
@@ -98,20 +195,51 @@ void App::loadObjectFromConfig(const ObjectConfig &cfg) {
     ++cameraIndex;
     registry.setCamera(obj, std::shared_ptr<Camera>(cameras[cameraIndex]));
   }
+  return obj;
 }
 
 void App::run() {
-  shader.addUniform("model");
   shader.addUniform("diffuseTexture");
   shader.addUniform("specularTexture");
   shader.addUniform("imageTexture");
   shader.addUniform("shininess");
   shader.addUniform("cameraPos");
+  shader.addUniform("lightData");
+  shader.addUniform("clusterGrid");
+  shader.addUniform("lightIndices");
+  shader.addUniform("clusterParams");
+  shader.addUniform("lightCount");
+  if (useMaterialTable) {
+    shader.addUniform("materialArrays");
+  }
 
-  shader.bindUniformBlock("LightBlock", 0);
   shader.bindUniformBlock("CameraBlock", 1);
 
-  lightUniformBuffer.bindToPoint(0);
+  useImpostors = TREE_IMPOSTORS && treeImpostors.loadShaders();
+
+  // Sampler units never change, set them once
+  shader.use();
+  glUniform1i(shader.getUniformLocation("imageTexture"), 0);
+  glUniform1i(shader.getUniformLocation("specularTexture"), 1);
+  glUniform1i(shader.getUniformLocation("diffuseTexture"), 2);
+  glUniform1i(shader.getUniformLocation("lightData"), LIGHT_DATA_UNIT);
+  glUniform1i(shader.getUniformLocation("clusterGrid"), CLUSTER_GRID_UNIT);
+  glUniform1i(shader.getUniformLocation("lightIndices"), LIGHT_INDEX_UNIT);
+  if (useMaterialTable) {
+    GLint units[MATERIAL_TEXTURE_ARRAYS];
+    for (int i = 0; i < MATERIAL_TEXTURE_ARRAYS; ++i) {
+      units[i] = MATERIAL_ARRAY_FIRST_UNIT + i;
+    }
+    glUniform1iv(shader.getUniformLocation("materialArrays"),
+                 MATERIAL_TEXTURE_ARRAYS, units);
+    renderQueue.setMaterialTable(&materialTable);
+  }
+
+  if (PERSISTENT_UNIFORM_RING &&
+      !cameraUniformBuffer.createRing(sizeof(CameraBlock))) {
+    std::cerr << "No ARB_buffer_storage, camera uniforms use glBufferData"
+              << std::endl;
+  }
   cameraUniformBuffer.bindToPoint(1);
 
   std::vector<glm::vec3> coasterPoints = {
@@ -201,7 +329,8 @@ void App::run() {
     objectConfigs.push_back(cfg);
   }
 
-  // MAKE TREES
+  // MAKE TREES (each a range of objectConfigs, for the impostors)
+  std::vector<std::pair<size_t, size_t>> treeRanges;
   for (int i = -WORLD_WIDTH / 2; i < WORLD_WIDTH / 2; i += 2) {
     for (int j = -WORLD_WIDTH / 2; j < WORLD_WIDTH / 2; j += 2) {
       glm::vec3 pos = glm::vec3{i * 10, 0, j * 10};
@@ -211,14 +340,20 @@ void App::run() {
       float randomHeight = TREE_HEIGHT_SCALE + rand() % 3;
       float randomWidth = TREE_BASE_WIDTH + ((rand() * 10) % 3) / 10.f;
 
+      size_t first = objectConfigs.size();
       for (const auto &cfg : genTree(offset, randomHeight, randomWidth, 4, 2)) {
         objectConfigs.push_back(cfg);
       }
+      treeRanges.push_back({first, objectConfigs.size()});
     }
   }
   std::cerr << "Loading meshes: " << objectConfigs.size() << std::endl;
+  std::vector<int> entities;
   for (const auto &cfg : objectConfigs) {
-    loadObjectFromConfig(cfg);
+    entities.push_back(loadObjectFromConfig(cfg));
+  }
+  for (const auto &[first, last] : treeRanges) {
+    treeImpostors.addTree({entities.begin() + first, entities.begin() + last});
   }
 
   loadObjectFromConfig(createObject()
@@ -238,11 +373,10 @@ void App::run() {
 
   terrainEntityId = registry.createEntity();
   registry.setMesh(terrainEntityId, std::optional<MeshComp>({terrainMesh}));
-  registry.getMesh(terrainEntityId)
-      .value()
-      .mesh->setTexture(
-          "/home/qscheetz/Sync/3dEngine-assets/Amusement Park/Floor/grass.jpg",
-          TextureType::Image);
+  terrainMesh->setTexture(
+      resourceManager.loadTexture(
+          "/home/qscheetz/Sync/3dEngine-assets/Amusement Park/Floor/grass.jpg"),
+      TextureType::Image);
   registry.setTransform(terrainEntityId,
                         {{0, 20, 30}, {0, 0, 0}, {10, 10, 10}, -1});
 
@@ -255,6 +389,7 @@ void App::run() {
 
   auto prevTime = std::chrono::steady_clock::now();
   float totalTime = 0;
+  float renderStatsTimer = 0;
 
   while (!window.shouldClose()) {
     auto currentTime = std::chrono::steady_clock::now();
@@ -266,27 +401,85 @@ void App::run() {
 
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    // Finish async loads; meshes without data yet are skipped by renderAll
+    if (resourceManager.pendingLoads() > 0) {
+      resourceManager.processUploads(UPLOAD_BUDGET_MS);
+      if (resourceManager.pendingLoads() == 0) {
+        TextureCacheStats stats = resourceManager.getTextureStats();
+        std::cerr << "Finished loading assets after " << totalTime << "s ("
+                  << stats.texturesResident << " textures, "
+                  << stats.bytesResident / 1024 << " KiB, " << stats.hits
+                  << " cache hits, " << stats.misses << " misses, "
+                  << resourceManager.getTextureStreamer()
+                         .getStats()
+                         .texturesStreamed
+                  << " streamed)" << std::endl;
+        MeshCacheStats meshStats = resourceManager.getMeshStats();
+        std::cerr << "Meshes: " << meshStats.meshesResident << " buffers for "
+                  << meshStats.hits + meshStats.misses << " requests, "
+                  << meshStats.verticesResident << " vertices" << std::endl;
+
+        if (STATIC_BATCHING) {
+          staticBatcher.build(
+              registry,
+              glm::vec2(-STATIC_BATCH_HALF_EXTENT, -STATIC_BATCH_HALF_EXTENT),
+              glm::vec2(STATIC_BATCH_HALF_EXTENT, STATIC_BATCH_HALF_EXTENT),
+              STATIC_BATCH_CELLS);
+          const StaticBatchStats &batchStats = staticBatcher.getStats();
+          std::cerr << "Static batching: " << batchStats.entities
+                    << " entities into " << batchStats.chunks << " chunks, "
+                    << batchStats.vertices << " vertices, "
+                    << batchStats.indices << " indices" << std::endl;
+        }
+
+        // Transforms of the trees are set by now (they never move)
+        if (useImpostors && treeImpostors.bake(registry)) {
+          const ImpostorStats &impostorStats = treeImpostors.getStats();
+          std::cerr << "Impostors: " << impostorStats.trees << " trees x "
+                    << IMPOSTOR_VIEWS << " views, atlas "
+                    << impostorStats.atlasBytes / 1024 << " KiB" << std::endl;
+        }
+      }
+    }
+
     moveCamera(deltaTime);
 
     updateAnimations(registry, deltaTime);
     updateTransforms(registry);
+    updateWorldBounds(registry, sceneBvh);
     updateCamera(registry);
 
-    LightBlock lightBlock{};
-    lightBlock.count = 0;
+    // Rasterize occluders on the workers while the main thread streams
+    // textures and fills the uniform buffers
+    glm::mat4 viewProjection = cameras[cameraIndex]->getProjectionMatrix() *
+                               cameras[cameraIndex]->getViewMatrix();
+    gatherOccluders(registry, cameras[cameraIndex]->getPosition(),
+                    viewProjection, occluders);
+    occlusionCuller.begin(viewProjection, occluders);
+
+    // Stream texture mips in/out for what the camera can see now
+    TextureStreamer &streamer = resourceManager.getTextureStreamer();
+    requestTextureResolutions(registry, streamer,
+                              cameras[cameraIndex]->getPosition(),
+                              cameras[cameraIndex]->getFOV(),
+                              cameras[cameraIndex]->getHeight());
+    streamer.update(UPLOAD_BUDGET_MS);
+
+    // Slots stay put; only lights that moved or changed get uploaded
+    lightStore.beginFrame();
     for (auto &id : registry.getLightEntityIds()) {
-      auto &lightOpt = registry.getLight(id);
-      auto &light = lightOpt.value();
-      auto &pos = registry.getTransform(id).position;
-
-      lightBlock.lights[lightBlock.count].position = pos;
-      lightBlock.lights[lightBlock.count].color = light.color;
-      lightBlock.lights[lightBlock.count].intensity = light.intensity;
-      lightBlock.count++;
+      auto &light = registry.getLight(id).value();
+      lightStore.set(id, registry.getTransform(id).position, light.color,
+                     light.intensity);
     }
-
-    lightUniformBuffer.bindToPoint(0);
-    lightUniformBuffer.uploadData(&lightBlock, sizeof(LightBlock));
+    lightStore.removeStale();
+    lightClusters.build(lightStore, cameras[cameraIndex]->getViewMatrix(),
+                        cameras[cameraIndex]->getProjectionMatrix(),
+                        cameras[cameraIndex]->getWidth(),
+                        cameras[cameraIndex]->getHeight(),
+                        cameras[cameraIndex]->getNear(),
+                        cameras[cameraIndex]->getFar());
+    lightClusters.upload(lightStore);
 
     CameraBlock cameraBlock{
         cameras[cameraIndex]->getViewMatrix(),
@@ -296,19 +489,231 @@ void App::run() {
     cameraUniformBuffer.bindToPoint(1);
     cameraUniformBuffer.uploadData(&cameraBlock, sizeof(CameraBlock));
 
+    // The impostors leave their program bound
+    shader.use();
     glUniform3fv(shader.getUniformLocation("cameraPos"), 1,
                  glm::value_ptr(cameras[cameraIndex]->getPosition()));
 
-    shader.use();
-    renderAll(registry, shader.getUniformLocation("model"),
-              shader.getUniformLocation("imageTexture"),
-              shader.getUniformLocation("diffuseTexture"),
-              shader.getUniformLocation("specularTexture"),
-              shader.getUniformLocation("shininess"));
+    glUniform4fv(shader.getUniformLocation("clusterParams"), 1,
+                 glm::value_ptr(lightClusters.getShaderParams()));
+    glUniform1i(shader.getUniformLocation("lightCount"),
+                int(lightStore.getActiveCount()));
+    occlusionCuller.finish();
+    lodSelector.setView(cameras[cameraIndex]->getPosition(),
+                        cameras[cameraIndex]->getFOV(),
+                        cameras[cameraIndex]->getHeight());
+    treeImpostors.update(cameras[cameraIndex]->getPosition(),
+                         cameras[cameraIndex]->getFrustum(),
+                         IMPOSTOR_DISTANCE, IMPOSTOR_FADE_DISTANCE);
+    renderAll(registry, renderQueue, instanceBuffer,
+              shader.getUniformLocation("shininess"),
+              cameras[cameraIndex]->getPosition(),
+              cameras[cameraIndex]->getFrustum(), sceneBvh, occlusionCuller,
+              lodSelector, treeImpostors, cullStats,
+              useIndirectDraw ? &indirectDraws : nullptr);
+    treeImpostors.draw(cameras[cameraIndex]->getPosition(),
+                       int(lightStore.getActiveCount()));
+
+    renderStatsTimer += deltaTime;
+    if (renderStatsTimer >= RENDER_STATS_INTERVAL) {
+      const RenderStats &stats = renderQueue.getStats();
+      std::cerr << "\nrender: " << cullStats.visible << " visible, "
+                << cullStats.culled << " culled, " << cullStats.occluded
+                << " occluded, " << stats.items
+                << " items in "
+                << stats.drawCalls << " draws";
+      if (useIndirectDraw) {
+        std::cerr << " (" << stats.commands << " indirect commands)";
+      }
+      std::cerr << ", " << stats.textureBinds
+                << " texture binds (" << stats.textureBindsSkipped
+                << " saved), " << stats.vaoBinds << " VAO binds ("
+                << stats.vaoBindsSkipped << " saved), "
+                << stats.uniformUpdates << " uniform updates ("
+                << stats.uniformUpdatesSkipped << " saved)" << std::endl;
+
+      // Binds over the whole interval, not just the last frame
+      const GLStateStats &gl = GLState::get().getStats();
+      std::cerr << "gl binds issued/elided: program " << gl.programs.issued
+                << "/" << gl.programs.elided << ", vao "
+                << gl.vertexArrays.issued << "/" << gl.vertexArrays.elided
+                << ", texture " << gl.textures.issued << "/"
+                << gl.textures.elided << ", buffer " << gl.buffers.issued
+                << "/" << gl.buffers.elided << ", ubo base "
+                << gl.bufferBases.issued << "/" << gl.bufferBases.elided
+                << std::endl;
+      GLState::get().resetStats();
+
+      BVHStats bvhStats = sceneBvh.getStats();
+      std::cerr << "bvh: " << bvhStats.items << " items, " << bvhStats.nodes
+                << " nodes, cost " << bvhStats.cost << " (built "
+                << bvhStats.builtCost << "), " << bvhStats.refits
+                << " refits, " << bvhStats.rebuilds << " rebuilds"
+                << std::endl;
+
+      const ClusterStats &clusterStats = lightClusters.getStats();
+      std::cerr << "lights: " << clusterStats.lights << " in "
+                << clusterStats.indices << " cluster slots, at most "
+                << clusterStats.maxPerCluster << " per cluster, binned in "
+                << clusterStats.buildMs << " ms" << std::endl;
+      const LightUploadStats &lightUpload = lightClusters.getUploadStats();
+      std::cerr << "light upload: " << lightUpload.lightBytes << " B in "
+                << lightUpload.lightRanges << " ranges, grid "
+                << lightUpload.gridBytes << " B, indices "
+                << lightUpload.indexBytes << " B" << std::endl;
+
+      UniformRingStats ringStats = cameraUniformBuffer.takeRingStats();
+      if (cameraUniformBuffer.isRing()) {
+        std::cerr << "uniform ring: " << ringStats.fenceWaits << "/"
+                  << ringStats.frames << " frames waited on a fence, "
+                  << ringStats.fenceWaitMs << " ms total" << std::endl;
+      }
+
+      if (useMaterialTable) {
+        MaterialTableStats materialStats = materialTable.takeStats();
+        std::cerr << "materials: " << materialStats.entries << " entries for "
+                  << materialStats.meshes << " meshes, "
+                  << materialStats.textures << " textures in "
+                  << materialStats.arrays << " arrays ("
+                  << materialStats.textureBytes / 1024 << " KiB), "
+                  << materialStats.copies << " copied, "
+                  << materialStats.evictions << " evicted" << std::endl;
+      }
+
+      GeometryArena &arena = GeometryArena::get();
+      GeometryArenaStats arenaStats = arena.getStats();
+      std::cerr << "geometry: " << arenaStats.bytesUsed / 1024 << "/"
+                << arenaStats.bytesAllocated / 1024 << " KiB used, "
+                << arenaStats.vertices.allocations << " meshes, "
+                << "fragmentation " << arenaStats.vertices.fragmentation
+                << " vertices / " << arenaStats.indices.fragmentation
+                << " indices, " << arenaStats.grows << " grows, "
+                << arenaStats.defragmentations << " defragmentations"
+                << std::endl;
+      // Holes come from meshes replaced at runtime (terrain subdivision)
+      if (resourceManager.pendingLoads() == 0 &&
+          std::max(arenaStats.vertices.fragmentation,
+                   arenaStats.indices.fragmentation) >
+              GEOMETRY_DEFRAG_THRESHOLD) {
+        arena.defragment();
+      }
+
+      const LodStats &lodStats = lodSelector.getStats();
+      std::cerr << "lod:";
+      for (int level = 0; level < LOD_LEVELS; ++level) {
+        std::cerr << (level > 0 ? "," : "") << " level " << level << " "
+                  << lodStats.instances[level] << " instances/"
+                  << lodStats.triangles[level] << " triangles";
+      }
+      std::cerr << std::endl;
+
+      if (useImpostors) {
+        const ImpostorStats &impostorStats = treeImpostors.getStats();
+        std::cerr << "impostors: " << impostorStats.impostors << " of "
+                  << impostorStats.trees << " trees (" << impostorStats.fading
+                  << " cross-fading)" << std::endl;
+      }
+
+      OcclusionStats occlusionStats = occlusionCuller.takeStats();
+      std::cerr << "occlusion: " << occlusionStats.occluders << " occluders, "
+                << occlusionStats.faces << " faces in "
+                << occlusionStats.rasterMs << " ms, "
+                << occlusionStats.occluded << "/" << occlusionStats.tested
+                << " tested boxes hidden" << std::endl;
+      renderStatsTimer = 0;
+    }
+    // The draws reading this frame's uniform region are all queued now
+    cameraUniformBuffer.endFrame();
     window.swapBuffers();
   }
+}
+
+int App::runNormalMatrixBenchmark() {
+  // A long curve: lots of vertices, each with its own normal
+  std::vector<glm::vec3> points = {
+      {0, 0, 0}, {2, 1, 0}, {4, 0, 2}, {6, 1, 0}, {8, 0, -2}};
+  auto mesh = std::make_shared<Mesh>();
+  int vertexCount = mesh->loadVertices(
+      Mesh::buildSweep(points, NORMAL_BENCH_PATH_SEGMENTS,
+                       NORMAL_BENCH_CIRCLE_SEGMENTS, 0.5f));
+
+  // Non-uniform scales so the general normal matrix path is exercised
+  std::vector<InstanceData> instances;
+  for (int i = 0; i < NORMAL_BENCH_INSTANCES; ++i) {
+    glm::vec3 scale(1.f + (i % 3) * 0.5f, 1.f, 1.f + (i % 5) * 0.25f);
+    glm::mat4 model = glm::translate(glm::mat4(1.f),
+                                     glm::vec3((i % 8) * 10.f, 0.f,
+                                               -20.f - (i / 8) * 10.f));
+    model = glm::rotate(model, glm::radians(i * 17.f), glm::vec3(0, 1, 0));
+    model = glm::scale(model, scale);
+    instances.push_back({model, glm::vec4(1.f),
+                         trsNormalMatrix(glm::mat3(model), scale)});
+  }
+  instanceBuffer.upload(instances);
+
+  CameraBlock cameraBlock{cameras[0]->getViewMatrix(),
+                          cameras[0]->getProjectionMatrix()};
+  cameraUniformBuffer.bindToPoint(1);
+  cameraUniformBuffer.uploadData(&cameraBlock, sizeof(CameraBlock));
+
+  auto drawAll = [&]() {
+    for (const Submesh &submesh : mesh->getSubmeshes()) {
+      mesh->drawSubmesh(submesh, NORMAL_BENCH_INSTANCES);
+    }
+  };
+
+  const char *names[2] = {"inverse() per vertex", "precomputed per instance"};
+  double frameMs[2] = {};
+  unsigned int query;
+  glGenQueries(1, &query);
+  glEnable(GL_RASTERIZER_DISCARD);
+  for (int variant = 0; variant < 2; ++variant) {
+    std::vector<std::string> defines;
+    if (variant == 0) {
+      defines.push_back("NORMAL_MATRIX_IN_SHADER");
+    }
+    if (shader.loadShaders(defines) != ShaderResult::Success) {
+      std::cerr << "Failed to load shaders for " << names[variant]
+                << std::endl;
+      glDeleteQueries(1, &query);
+      return 1;
+    }
+    shader.bindUniformBlock("CameraBlock", 1);
+    shader.use();
+    mesh->bindVertexArray();
+    instanceBuffer.bindAttributes(0);
+
+    for (int frame = 0; frame < NORMAL_BENCH_WARMUP_FRAMES; ++frame) {
+      drawAll();
+    }
+    glFinish();
 
-  glfwTerminate();
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    for (int frame = 0; frame < NORMAL_BENCH_FRAMES; ++frame) {
+      drawAll();
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    GLuint64 elapsedNs = 0;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsedNs);
+    frameMs[variant] = elapsedNs / 1e6 / NORMAL_BENCH_FRAMES;
+  }
+  glDisable(GL_RASTERIZER_DISCARD);
+  glDeleteQueries(1, &query);
+
+  double verticesPerFrame = double(vertexCount) * NORMAL_BENCH_INSTANCES;
+  std::cerr << "normal matrix benchmark: " << NORMAL_BENCH_INSTANCES << " x "
+            << vertexCount << " vertices, " << NORMAL_BENCH_FRAMES
+            << " frames, rasterizer off" << std::endl;
+  for (int variant = 0; variant < 2; ++variant) {
+    std::cerr << "  " << names[variant] << ": " << frameMs[variant]
+              << " ms/frame, "
+              << verticesPerFrame / (frameMs[variant] * 1e3)
+              << " Mvertices/s" << std::endl;
+  }
+  if (frameMs[1] > 0.0) {
+    std::cerr << "  speedup: " << frameMs[0] / frameMs[1] << "x" << std::endl;
+  }
+  return 0;
 }
 
 void App::moveCamera(float deltaTime) {
@@ -365,6 +770,8 @@ void App::moveCamera(float deltaTime) {
 }
 
 void App::regenerateTerrain() {
+  // The mesh is about to change, it can't stay baked into a chunk
+  staticBatcher.unbatch(registry, terrainEntityId);
   FractalTerrain fractalTerrain;
   auto verts = fractalTerrain.generateTerrain(subdivLevel, terrainV1, terrainV2,
                                               terrainV3);
@@ -5,7 +5,17 @@
 #include "controls.h"
 #include "ecs/registry.h"
 #include "fractal_terrain.h"
+#include "indirectDraw.h"
+#include "materialTable.h"
+#include "instanceBuffer.h"
+#include "lightClusters.h"
+#include "lodSelector.h"
+#include "math/bvh.h"
 #include "objectBuilder.h"
+#include "occlusion.h"
+#include "renderQueue.h"
+#include "staticBatcher.h"
+#include "treeImpostors.h"
 #include "resource_manager.h"
 #include "shader.h"
 #include "uniformBuffer.h"
@@ -23,6 +33,9 @@ constexpr float COASTER_CAR_SPEED = 0.5f;
 constexpr float COASTER_CAR_SCALE = 0.2f;
 constexpr float COASTER_RADIUS = 0.2f;
 constexpr glm::vec3 COASTER_COLOR = {1, .25, .2};
+// Static curved sweeps longer than this (summed over their control points)
+// are split into sections, so each picks its own LOD
+constexpr float SWEEP_SECTION_LENGTH = 40.f;
 
 constexpr float TREE_BASE_WIDTH = 0.25f;
 constexpr int TREE_NUM_PER_LEVEL = 3;
@@ -32,6 +45,45 @@ constexpr int RAIL_COUNT = 10;
 
 constexpr int WORLD_WIDTH = 15;
 
+// Time per frame spent uploading finished async loads to the GPU
+constexpr float UPLOAD_BUDGET_MS = 4.f;
+// Cook textures to BC1 when the driver has S3TC (1/4 to 1/8 the VRAM)
+constexpr bool COMPRESS_TEXTURES = true;
+// GPU memory streamed texture mips may use before unused levels are evicted
+constexpr size_t TEXTURE_STREAMING_BUDGET_MB = 256;
+// Per-frame uniforms through a persistently mapped, fenced ring (falls back
+// to glBufferData when the driver lacks ARB_buffer_storage)
+constexpr bool PERSISTENT_UNIFORM_RING = true;
+// "--bench-normals": instanced copies of a dense sweep drawn with the
+// rasterizer off, so the timings are vertex shading only
+constexpr int NORMAL_BENCH_INSTANCES = 64;
+constexpr int NORMAL_BENCH_PATH_SEGMENTS = 500;
+constexpr int NORMAL_BENCH_CIRCLE_SEGMENTS = 32;
+constexpr int NORMAL_BENCH_WARMUP_FRAMES = 20;
+constexpr int NORMAL_BENCH_FRAMES = 200;
+// Submit draws from a storage buffer with multi-draw indirect when the
+// driver has the GL 4.3 features (falls back to instanced draws)
+constexpr bool INDIRECT_DRAW = true;
+// On the indirect path, pack materials into a storage buffer and their
+// textures into arrays so draws are no longer split by texture binds
+constexpr bool MATERIAL_TABLE = true;
+// Compact the shared vertex/index buffers once this much of their free
+// space is outside the largest hole (checked with the stats printout)
+constexpr float GEOMETRY_DEFRAG_THRESHOLD = 0.5f;
+// Once everything has loaded, merge meshes that never move into chunks of
+// a STATIC_BATCH_CELLS x STATIC_BATCH_CELLS grid over the square trees are
+// planted in (10 units apart, WORLD_WIDTH across)
+constexpr bool STATIC_BATCHING = true;
+constexpr int STATIC_BATCH_CELLS = 4;
+constexpr float STATIC_BATCH_HALF_EXTENT = WORLD_WIDTH * 5.f;
+// Draw trees further than IMPOSTOR_DISTANCE as camera-facing quads from a
+// baked atlas, cross-fading over the next IMPOSTOR_FADE_DISTANCE units
+constexpr bool TREE_IMPOSTORS = true;
+constexpr float IMPOSTOR_DISTANCE = 60.f;
+constexpr float IMPOSTOR_FADE_DISTANCE = 10.f;
+// Seconds between render queue counter printouts
+constexpr float RENDER_STATS_INTERVAL = 5.f;
+
 struct InputState {
   bool w = false, a = false, s = false, d = false;
   bool q = false, e = false;
@@ -45,8 +97,12 @@ struct InputState {
 class App {
 public:
   App(int width, int height, const std::string &title);
+  ~App();
 
   void run();
+  // Time the vertex shader with the normal matrix computed per vertex
+  // against the precomputed per-instance one. Returns the exit code.
+  int runNormalMatrixBenchmark();
   void moveCamera(float deltaTime);
 
   Window *getWindow() { return &window; };
@@ -58,10 +114,13 @@ public:
 
 private:
   bool loadShaders();
-  void loadObjectFromConfig(const ObjectConfig &cfg);
+  // Returns the new entity
+  int loadObjectFromConfig(const ObjectConfig &cfg);
   void loadObjectsFromConfig(const std::vector<ObjectConfig> &configs);
   void regenerateTerrain();
 
+  // First, so it is destroyed last: every GL object below goes away while
+  // the context is still alive
   Window window;
   Shader shader;
   std::vector<std::shared_ptr<Camera>> cameras;
@@ -70,8 +129,24 @@ private:
   unsigned int frameCounter;
   ResourceManager resourceManager;
   Registry registry;
-  UniformBuffer lightUniformBuffer;
+  LightStore lightStore;
+  LightClusters lightClusters;
   UniformBuffer cameraUniformBuffer;
+  InstanceBuffer instanceBuffer;
+  IndirectDrawBuffer indirectDraws;
+  bool useIndirectDraw = false;
+  MaterialTable materialTable;
+  bool useMaterialTable = false;
+  RenderQueue renderQueue;
+  StaticBatcher staticBatcher;
+  TreeImpostors treeImpostors;
+  bool useImpostors = false;
+  CullStats cullStats;
+  LodSelector lodSelector;
+  // Entity bounds index for frustum culling
+  BVH sceneBvh;
+  OcclusionCuller occlusionCuller;
+  std::vector<OccluderBox> occluders;
 
   int subdivLevel = 0;
   GLuint terrainEntityId;
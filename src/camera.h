@@ -1,5 +1,6 @@
 #pragma once
 
+#include "math/frustum.h"
 #include <glm/ext/matrix_clip_space.hpp>
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/glm.hpp>
@@ -61,7 +62,15 @@ public:
   };
 
   const glm::mat4 &getProjectionMatrix() { return projection; }
+  Frustum getFrustum() {
+    return Frustum::fromMatrix(projection * getViewMatrix());
+  }
   const glm::vec3 &getPosition() const { return position; }
+  float getFOV() const { return FOV; }
+  int getWidth() const { return width; }
+  int getHeight() const { return height; }
+  float getNear() const { return zNear; }
+  float getFar() const { return zFar; }
 
 private:
   float FOV, zNear, zFar;
@@ -1,4 +1,5 @@
 #pragma once
+#include "../math/bounds.h"
 #include <glm/glm.hpp>
 #include <memory>
 #include <optional>
@@ -9,6 +10,24 @@ class Mesh;
 
 struct MeshComp {
   std::shared_ptr<Mesh> mesh;
+  glm::vec3 color{1.f}; // multiplied into every texture sample
+  // Applied before the entity transform, places shared canonical meshes
+  glm::mat4 localMatrix{1.f};
+  // > 0: mesh is the unit cylinder from Mesh::buildPrimitive with this many
+  // sides, which lets occlusion culling use the box inside it
+  int cylinderSides = 0;
+  // Inverse transpose of localMatrix, computed once when the mesh is placed
+  glm::mat3 localNormalMatrix{1.f};
+  // >= 0: handle of the StaticBatcher chunk the mesh is baked into. The
+  // entity is then drawn and culled as part of that chunk.
+  int staticChunk = -1;
+  // Instance of a shared unit primitive. Those are already drawn in one
+  // instanced run per mesh, so static batching leaves them alone instead of
+  // copying their vertices once per entity.
+  bool primitive = false;
+  // Coarser stand-ins for mesh, finest first, picked per instance by
+  // LodSelector. Empty: mesh is drawn at every distance.
+  std::vector<std::shared_ptr<Mesh>> lods{};
 };
 
 struct Transform {
@@ -18,6 +37,16 @@ struct Transform {
   int parentId; // any neg # will be no parent
   glm::mat4 matrix{1.f};
   glm::vec3 position{0.f, 0.f, 0.f};
+  // Transforms normals to world space, up to a scale the fragment shader
+  // normalizes away. Written by updateTransforms() alongside matrix.
+  glm::mat3 normalMatrix{1.f};
+};
+
+// World space bounds of an entity's mesh, written by updateWorldBounds()
+struct WorldBounds {
+  AABB box;
+  BoundingSphere sphere;
+  bool valid = false; // false until the mesh has loaded
 };
 
 struct Light {
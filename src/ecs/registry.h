@@ -12,6 +12,7 @@ public:
   int createEntity() {
     int id = transforms.size();
     transforms.push_back({});
+    worldBounds.push_back({});
     meshes.push_back({});
     lights.push_back({});
     sineAnimators.push_back({});
@@ -24,6 +25,7 @@ public:
   // FIXME: change this so it actualy frees the memeory
   void destroyEntity(int entity) {
     transforms[entity] = {};
+    worldBounds[entity] = {};
     meshes[entity].reset();
     lights[entity].reset();
     sineAnimators[entity].reset();
@@ -64,6 +66,7 @@ public:
   }
 
   Transform &getTransform(int entity) { return transforms[entity]; }
+  WorldBounds &getWorldBounds(int entity) { return worldBounds[entity]; }
 
   const std::optional<MeshComp> &getMesh(int entity) const {
     return meshes[entity];
@@ -111,6 +114,7 @@ public:
 
 private:
   std::vector<Transform> transforms;
+  std::vector<WorldBounds> worldBounds;
 
   std::vector<std::optional<MeshComp>> meshes;
   std::unordered_set<size_t> meshEntityIds;
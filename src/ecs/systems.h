@@ -1,17 +1,50 @@
 #pragma once
 #include "../../include/glad/glad.h"
 #include "../math/spline.h"
+#include "../instanceBuffer.h"
+#include "../lodSelector.h"
+#include "../math/bvh.h"
+#include "../math/frustum.h"
 #include "../mesh.h"
+#include "../occlusion.h"
+#include "../renderQueue.h"
+#include "../textureStreamer.h"
+#include "../treeImpostors.h"
 #include "registry.h"
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
+#include <vector>
+
+// Normal matrix of rotation * scale without an inverse: (R S)^-T = R S^-1,
+// so each column is divided by its scale squared. Under uniform scale that
+// only changes the length, so the matrix is used as is.
+inline glm::mat3 trsNormalMatrix(const glm::mat3 &rotationScale,
+                                 const glm::vec3 &scale) {
+  if (scale.x == scale.y && scale.y == scale.z) {
+    return rotationScale;
+  }
+  glm::mat3 n = rotationScale;
+  for (int i = 0; i < 3; ++i) {
+    float s2 = scale[i] * scale[i];
+    n[i] /= s2 > 1e-12f ? s2 : 1e-12f;
+  }
+  return n;
+}
 
 inline void updateTransforms(Registry &reg) {
   static bool init = false;
 
-  for (auto &t : reg.getTransforms()) {
+  auto &transforms = reg.getTransforms();
+  for (size_t id = 0; id < transforms.size(); ++id) {
+    auto &t = transforms[id];
+    // Baked into a static chunk, so it never moves
+    if (init && reg.getMesh(id) && reg.getMesh(id)->staticChunk >= 0)
+      continue;
+
     t.matrix = glm::mat4(1.0f);
 
     if (!init) {
@@ -26,16 +59,93 @@ inline void updateTransforms(Registry &reg) {
     t.matrix =
         glm::rotate(t.matrix, glm::radians(t.rotation.z), glm::vec3(0, 0, 1));
     t.matrix = glm::scale(t.matrix, t.scale);
+    t.normalMatrix = trsNormalMatrix(glm::mat3(t.matrix), t.scale);
 
     // NOTE: parrents must ALWAYS come before children when loading
     if (t.parentId >= 0) {
       auto &parentTransform = reg.getTransform(t.parentId);
       t.matrix = parentTransform.matrix * t.matrix;
+      t.normalMatrix = parentTransform.normalMatrix * t.normalMatrix;
     }
   }
   init = true;
 }
 
+// Move every loaded mesh's local bounds into world space and keep the scene
+// BVH in sync; run after updateTransforms(). Static entities produce the same
+// box every frame, which the BVH ignores, so only movers cause refits.
+inline void updateWorldBounds(Registry &reg, BVH &bvh) {
+  for (size_t id : reg.getMeshEntityIds()) {
+    auto &meshComp = reg.getMesh(id);
+    const Mesh &mesh = *meshComp->mesh;
+    WorldBounds &bounds = reg.getWorldBounds(id);
+    bounds.valid = mesh.isLoaded();
+    if (!bounds.valid) {
+      bvh.remove(id);
+      continue;
+    }
+    // Drawn and culled as part of its static chunk. The bounds from before
+    // it was batched still hold for occluder selection.
+    if (meshComp->staticChunk >= 0) {
+      bvh.remove(id);
+      continue;
+    }
+
+    glm::mat4 model = reg.getTransform(id).matrix * meshComp->localMatrix;
+    bounds.box = transformAABB(mesh.getBounds(), model);
+    bounds.sphere = transformSphere(mesh.getBoundingSphere(), model);
+    bvh.update(id, bounds.box);
+  }
+  bvh.commit();
+}
+
+// Pick this frame's occluders: the biggest unit cylinders on screen that
+// the camera cannot look straight through. Run after updateWorldBounds().
+inline void gatherOccluders(Registry &reg, const glm::vec3 &cameraPos,
+                            const glm::mat4 &viewProjection,
+                            std::vector<OccluderBox> &occluders) {
+  struct Candidate {
+    size_t id;
+    float size;
+  };
+  static std::vector<Candidate> candidates;
+  candidates.clear();
+  for (size_t id : reg.getMeshEntityIds()) {
+    const WorldBounds &bounds = reg.getWorldBounds(id);
+    if (!bounds.valid || reg.getMesh(id)->cylinderSides <= 0)
+      continue;
+    float distance =
+        std::max(glm::length(bounds.sphere.center - cameraPos), 0.1f);
+    float size = bounds.sphere.radius / distance;
+    if (size >= OCCLUSION_MIN_SIZE)
+      candidates.push_back({id, size});
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            [](const Candidate &a, const Candidate &b) {
+              return a.size > b.size;
+            });
+
+  Frustum frustum = Frustum::fromMatrix(viewProjection);
+  occluders.clear();
+  for (const auto &candidate : candidates) {
+    if (occluders.size() >= OCCLUSION_MAX_OCCLUDERS)
+      break;
+    if (!frustum.intersects(reg.getWorldBounds(candidate.id).sphere))
+      continue;
+
+    auto &meshComp = reg.getMesh(candidate.id);
+    glm::mat4 model = reg.getTransform(candidate.id).matrix *
+                      meshComp->localMatrix;
+    glm::vec3 localCamera =
+        glm::vec3(glm::inverse(model) * glm::vec4(cameraPos, 1.f));
+    if (canSeeThroughUnitCylinder(localCamera))
+      continue;
+
+    occluders.push_back(
+        {model, unitCylinderOccluder(meshComp->cylinderSides)});
+  }
+}
+
 inline void updateCamera(Registry &reg) {
   for (const auto &id : reg.getCameraEntityIds()) {
     // get the cams transform
@@ -110,21 +220,103 @@ inline void updateAnimations(Registry &reg, float deltaTime) {
   }
 }
 
-inline void renderAll(Registry &reg, GLuint modelUniform, GLuint imageTexUnit,
-                      GLint diffuseTexUnit, GLint specularTexUnit,
-                      GLuint shininessLoc) {
+// Tell the streamer how many pixels each textured mesh covers on screen,
+// estimated from its bounding sphere
+inline void requestTextureResolutions(Registry &reg, TextureStreamer &streamer,
+                                      const glm::vec3 &cameraPos, float fovDeg,
+                                      int viewportHeight) {
+  // Pixels per world unit at distance 1
+  float pixelsPerUnit =
+      viewportHeight * 0.5f / std::tan(glm::radians(fovDeg) * 0.5f);
 
   for (size_t id : reg.getMeshEntityIds()) {
     auto &meshComp = reg.getMesh(id);
-    glUniformMatrix4fv(modelUniform, 1, GL_FALSE,
-                       glm::value_ptr(reg.getTransform(id).matrix));
+    const Mesh &mesh = *meshComp->mesh;
+    if (!mesh.isLoaded())
+      continue;
+
+    glm::mat4 m = reg.getTransform(id).matrix * meshComp->localMatrix;
+    float scale = std::max({glm::length(glm::vec3(m[0])),
+                            glm::length(glm::vec3(m[1])),
+                            glm::length(glm::vec3(m[2]))});
+    float radius = mesh.getBoundingRadius() * scale;
+    float distance =
+        std::max(glm::length(glm::vec3(m[3]) - cameraPos) - radius, 0.1f);
+    float pixels = 2.f * radius * pixelsPerUnit / distance;
+
+    streamer.requestResolution(mesh.getImageTexture().get(), pixels);
+    for (const auto &material : mesh.getMaterials()) {
+      streamer.requestResolution(material.diffuse.get(), pixels);
+      streamer.requestResolution(material.specular.get(), pixels);
+    }
+  }
+}
 
-    // Set texture units for specular lighting
-    glUniform1i(imageTexUnit, 0);
-    glUniform1i(diffuseTexUnit, 2);
-    glUniform1i(specularTexUnit, 1);
-    glUniform1f(shininessLoc, meshComp->mesh->getShininess());
+// Cull, queue and draw every visible mesh, at the level of detail lods picks
+// for it and dithered by its impostor coverage. With an indirect buffer the
+// queue is submitted GPU-driven (the shader must be built with
+// INDIRECT_DRAW), otherwise with instanced draws.
+inline void renderAll(Registry &reg, RenderQueue &queue,
+                      InstanceBuffer &instanceBuffer, GLint shininessLoc,
+                      const glm::vec3 &cameraPos, const Frustum &frustum,
+                      const BVH &bvh, OcclusionCuller &occlusion,
+                      LodSelector &lods, const TreeImpostors &impostors,
+                      CullStats &cullStats,
+                      IndirectDrawBuffer *indirect = nullptr) {
+  // Only entities with loaded meshes are in the BVH
+  static std::vector<uint32_t> visible;
+  visible.clear();
+  bvh.queryFrustum(frustum, visible);
+  cullStats.culled = bvh.size() - visible.size();
+
+  // Drop what the occluders hide (occluders themselves always pass: their
+  // bounds reach in front of the box inside them)
+  visible.erase(std::remove_if(visible.begin(), visible.end(),
+                               [&](uint32_t id) {
+                                 return !occlusion.isVisible(
+                                     reg.getWorldBounds(id).box);
+                               }),
+                visible.end());
+  cullStats.occluded = bvh.size() - cullStats.culled - visible.size();
+  cullStats.visible = visible.size();
+
+  queue.clear();
+  for (uint32_t id : visible) {
+    // Trees past the fade band are drawn as impostors only
+    float coverage = impostors.getCoverage(id);
+    if (coverage <= 0.f)
+      continue;
+
+    auto &meshComp = reg.getMesh(id);
+    const Mesh *mesh = meshComp->mesh.get();
+
+    // Levels still loading fall back to the next finer one
+    int level = 0;
+    if (!meshComp->lods.empty()) {
+      level = lods.select(id, reg.getWorldBounds(id).sphere,
+                          int(meshComp->lods.size()) + 1);
+      while (level > 0 && !meshComp->lods[level - 1]->isLoaded()) {
+        --level;
+      }
+      if (level > 0) {
+        mesh = meshComp->lods[level - 1].get();
+      }
+    }
+    lods.count(level, *mesh);
+
+    const Transform &transform = reg.getTransform(id);
+    InstanceData instance{transform.matrix * meshComp->localMatrix,
+                          glm::vec4(meshComp->color, coverage),
+                          transform.normalMatrix *
+                              meshComp->localNormalMatrix};
+    float depth = glm::length(glm::vec3(instance.model[3]) - cameraPos);
+    queue.pushMesh(RenderPass::Opaque, 0, *mesh, instance, depth);
+  }
 
-    meshComp->mesh->draw();
+  queue.sort();
+  if (indirect) {
+    queue.submitIndirect(*indirect);
+  } else {
+    queue.submit(instanceBuffer, shininessLoc);
   }
 }
@@ -0,0 +1,169 @@
+#include "geometryArena.h"
+#include "../include/glad/glad.h"
+#include "glState.h"
+#include <algorithm>
+
+GeometryArena &GeometryArena::get() {
+  static GeometryArena arena;
+  return arena;
+}
+
+GeometryArena::GeometryArena()
+    : vertexAllocator(GEOMETRY_ARENA_INITIAL_VERTICES),
+      indexAllocator(GEOMETRY_ARENA_INITIAL_INDICES) {
+  glGenVertexArrays(1, &VAO);
+  glGenBuffers(1, &VBO);
+  glGenBuffers(1, &EBO);
+
+  GLState::get().bindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBufferData(GL_ARRAY_BUFFER,
+               size_t(GEOMETRY_ARENA_INITIAL_VERTICES) * sizeof(Vertex),
+               nullptr, GL_STATIC_DRAW);
+  GLState::get().bindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+  glBufferData(GL_COPY_WRITE_BUFFER,
+               size_t(GEOMETRY_ARENA_INITIAL_INDICES) * sizeof(unsigned int),
+               nullptr, GL_STATIC_DRAW);
+  setupVertexArray();
+}
+
+GeometryArena::~GeometryArena() {
+  GLState::get().forgetBuffer(VBO);
+  GLState::get().forgetBuffer(EBO);
+  GLState::get().forgetVertexArray(VAO);
+  glDeleteBuffers(1, &VBO);
+  glDeleteBuffers(1, &EBO);
+  glDeleteVertexArrays(1, &VAO);
+}
+
+void GeometryArena::setupVertexArray() {
+  GLState::get().bindVertexArray(VAO);
+  GLState::get().bindBuffer(GL_ARRAY_BUFFER, VBO);
+
+  // position, texture coordinates, normal, material, color
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                        (void *)offsetof(Vertex, texCoord));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                        (void *)offsetof(Vertex, normal));
+  glEnableVertexAttribArray(2);
+  glVertexAttribIPointer(VERTEX_ATTRIB_MATERIAL, 1, GL_UNSIGNED_INT,
+                         sizeof(Vertex), (void *)offsetof(Vertex, materialId));
+  glEnableVertexAttribArray(VERTEX_ATTRIB_MATERIAL);
+  glVertexAttribPointer(VERTEX_ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+                        sizeof(Vertex), (void *)offsetof(Vertex, color));
+  glEnableVertexAttribArray(VERTEX_ATTRIB_COLOR);
+
+  // The element buffer binding is VAO state
+  GLState::get().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+}
+
+void GeometryArena::bindVertexArray() const {
+  GLState::get().bindVertexArray(VAO);
+}
+
+unsigned int
+GeometryArena::reallocate(unsigned int buffer, size_t unitSize,
+                          size_t newUnits,
+                          const std::vector<RangeAllocator::Move> &moves) {
+  unsigned int newBuffer;
+  glGenBuffers(1, &newBuffer);
+  GLState::get().bindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+  glBufferData(GL_COPY_WRITE_BUFFER, newUnits * unitSize, nullptr,
+               GL_STATIC_DRAW);
+
+  // Neighbouring ranges that stay neighbours are copied in one go
+  GLState::get().bindBuffer(GL_COPY_READ_BUFFER, buffer);
+  for (size_t i = 0; i < moves.size();) {
+    size_t from = moves[i].from, to = moves[i].to, size = moves[i].size;
+    for (++i; i < moves.size() && moves[i].from == from + size &&
+              moves[i].to == to + size;
+         ++i) {
+      size += moves[i].size;
+    }
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                        from * unitSize, to * unitSize, size * unitSize);
+  }
+
+  GLState::get().forgetBuffer(buffer);
+  glDeleteBuffers(1, &buffer);
+  return newBuffer;
+}
+
+void GeometryArena::ensureCapacity(RangeAllocator &allocator,
+                                   unsigned int &buffer, size_t unitSize,
+                                   uint32_t size) {
+  uint32_t capacity = allocator.getCapacity();
+  uint32_t newCapacity = std::max(capacity * 2, capacity + size);
+
+  // Everything stays where it is, copy it as one range
+  std::vector<RangeAllocator::Move> all = {{0, 0, 0, capacity}};
+  buffer = reallocate(buffer, unitSize, newCapacity, all);
+  allocator.grow(newCapacity);
+  setupVertexArray();
+  ++grows;
+}
+
+GeometryRange GeometryArena::allocate(const std::vector<Vertex> &vertices,
+                                      const std::vector<unsigned int> &indices) {
+  GeometryRange range;
+  if (vertices.empty())
+    return range;
+
+  range.vertices = vertexAllocator.allocate(uint32_t(vertices.size()));
+  if (range.vertices == INVALID_RANGE) {
+    ensureCapacity(vertexAllocator, VBO, sizeof(Vertex),
+                   uint32_t(vertices.size()));
+    range.vertices = vertexAllocator.allocate(uint32_t(vertices.size()));
+  }
+  GLState::get().bindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBufferSubData(GL_ARRAY_BUFFER,
+                  size_t(getFirstVertex(range)) * sizeof(Vertex),
+                  vertices.size() * sizeof(Vertex), vertices.data());
+
+  if (!indices.empty()) {
+    range.indices = indexAllocator.allocate(uint32_t(indices.size()));
+    if (range.indices == INVALID_RANGE) {
+      ensureCapacity(indexAllocator, EBO, sizeof(unsigned int),
+                     uint32_t(indices.size()));
+      range.indices = indexAllocator.allocate(uint32_t(indices.size()));
+    }
+    // Through the copy target, binding GL_ELEMENT_ARRAY_BUFFER would
+    // change whatever VAO is bound
+    GLState::get().bindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER,
+                    size_t(getFirstIndex(range)) * sizeof(unsigned int),
+                    indices.size() * sizeof(unsigned int), indices.data());
+  }
+  return range;
+}
+
+void GeometryArena::free(GeometryRange &range) {
+  vertexAllocator.free(range.vertices);
+  indexAllocator.free(range.indices);
+  range = GeometryRange();
+}
+
+void GeometryArena::defragment() {
+  vertexAllocator.compact(moves);
+  VBO = reallocate(VBO, sizeof(Vertex), vertexAllocator.getCapacity(), moves);
+  indexAllocator.compact(moves);
+  EBO = reallocate(EBO, sizeof(unsigned int), indexAllocator.getCapacity(),
+                   moves);
+  setupVertexArray();
+  ++defragmentations;
+}
+
+GeometryArenaStats GeometryArena::getStats() const {
+  GeometryArenaStats stats;
+  stats.vertices = vertexAllocator.getStats();
+  stats.indices = indexAllocator.getStats();
+  stats.bytesUsed = stats.vertices.used * sizeof(Vertex) +
+                    stats.indices.used * sizeof(unsigned int);
+  stats.bytesAllocated = stats.vertices.capacity * sizeof(Vertex) +
+                         stats.indices.capacity * sizeof(unsigned int);
+  stats.grows = grows;
+  stats.defragmentations = defragmentations;
+  return stats;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "rangeAllocator.h"
+#include "vertexBuffer.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Starting size of the shared buffers; they double when an allocation
+// doesn't fit
+constexpr uint32_t GEOMETRY_ARENA_INITIAL_VERTICES = 1u << 18;
+constexpr uint32_t GEOMETRY_ARENA_INITIAL_INDICES = 1u << 20;
+
+// Where one mesh's data lives in the arena
+struct GeometryRange {
+  uint32_t vertices = INVALID_RANGE;
+  uint32_t indices = INVALID_RANGE; // none: drawn with glDrawArrays
+};
+
+struct GeometryArenaStats {
+  RangeAllocatorStats vertices; // in vertices
+  RangeAllocatorStats indices;  // in indices
+  size_t bytesUsed = 0;
+  size_t bytesAllocated = 0; // GPU storage of both buffers
+  size_t grows = 0;
+  size_t defragmentations = 0;
+};
+
+// One vertex buffer, one index buffer and one VAO shared by every Mesh.
+// Meshes hold ranges handed out by a TLSF allocator per buffer, so they
+// all draw from the same VAO (indices stay mesh-relative and are drawn
+// with a base vertex) and any set of them can go into one multi-draw.
+class GeometryArena {
+public:
+  // Created on first use, which must be on the main thread after GL is up
+  static GeometryArena &get();
+
+  // Prevent copying/moving (OpenGL resources must stay in one place)
+  GeometryArena(const GeometryArena &) = delete;
+  GeometryArena &operator=(const GeometryArena &) = delete;
+  GeometryArena(GeometryArena &&) = delete;
+  GeometryArena &operator=(GeometryArena &&) = delete;
+
+  // Find room for and upload a mesh's vertices and indices (indices may be
+  // empty), growing the buffers if needed
+  GeometryRange allocate(const std::vector<Vertex> &vertices,
+                         const std::vector<unsigned int> &indices);
+  // Give a range back and reset it to empty
+  void free(GeometryRange &range);
+
+  uint32_t getFirstVertex(const GeometryRange &range) const {
+    return vertexAllocator.getOffset(range.vertices);
+  }
+  uint32_t getFirstIndex(const GeometryRange &range) const {
+    return indexAllocator.getOffset(range.indices);
+  }
+  unsigned int getVertexArray() const { return VAO; }
+  void bindVertexArray() const;
+
+  // Pack both buffers so their free space is one block at the end, by
+  // copying the live ranges into fresh storage. Ranges stay valid.
+  void defragment();
+
+  GeometryArenaStats getStats() const;
+
+private:
+  GeometryArena();
+  ~GeometryArena();
+
+  // Reallocate a buffer at newUnits, copying the given unit ranges over
+  unsigned int reallocate(unsigned int buffer, size_t unitSize,
+                          size_t newUnits,
+                          const std::vector<RangeAllocator::Move> &moves);
+  void ensureCapacity(RangeAllocator &allocator, unsigned int &buffer,
+                      size_t unitSize, uint32_t size);
+  // Point the VAO's vertex attributes and element buffer at the buffers
+  void setupVertexArray();
+
+  unsigned int VAO = 0;
+  unsigned int VBO = 0;
+  unsigned int EBO = 0;
+  RangeAllocator vertexAllocator;
+  RangeAllocator indexAllocator;
+  std::vector<RangeAllocator::Move> moves;
+  size_t grows = 0;
+  size_t defragmentations = 0;
+};
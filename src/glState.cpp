@@ -0,0 +1,150 @@
+#include "glState.h"
+#include "../include/glad/glad.h"
+
+GLState &GLState::get() {
+  static GLState state;
+  return state;
+}
+
+void GLState::useProgram(unsigned int newProgram) {
+  if (program == newProgram) {
+    ++stats.programs.elided;
+    return;
+  }
+  glUseProgram(newProgram);
+  program = newProgram;
+  ++stats.programs.issued;
+}
+
+void GLState::bindVertexArray(unsigned int vao) {
+  if (vertexArray == vao) {
+    ++stats.vertexArrays.elided;
+    return;
+  }
+  glBindVertexArray(vao);
+  vertexArray = vao;
+  ++stats.vertexArrays.issued;
+}
+
+void GLState::bindTexture(unsigned int unit, unsigned int texture) {
+  bindTextureTarget(unit, GL_TEXTURE_2D, texture);
+}
+
+void GLState::bindTextureBuffer(unsigned int unit, unsigned int texture) {
+  bindTextureTarget(unit, GL_TEXTURE_BUFFER, texture);
+}
+
+void GLState::bindTextureArray(unsigned int unit, unsigned int texture) {
+  bindTextureTarget(unit, GL_TEXTURE_2D_ARRAY, texture);
+}
+
+void GLState::bindTextureTarget(unsigned int unit, unsigned int target,
+                                unsigned int texture) {
+  if (textures[unit] == texture) {
+    ++stats.textures.elided;
+    return;
+  }
+  if (activeUnit != unit) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    activeUnit = unit;
+  }
+  glBindTexture(target, texture);
+  textures[unit] = texture;
+  ++stats.textures.issued;
+}
+
+unsigned int *GLState::genericBuffer(unsigned int target) {
+  switch (target) {
+  case GL_ARRAY_BUFFER:
+    return &arrayBuffer;
+  case GL_UNIFORM_BUFFER:
+    return &uniformBuffer;
+  case GL_DRAW_INDIRECT_BUFFER:
+    return &drawIndirectBuffer;
+  default:
+    return nullptr;
+  }
+}
+
+void GLState::bindBuffer(unsigned int target, unsigned int buffer) {
+  unsigned int *bound = genericBuffer(target);
+  if (bound && *bound == buffer) {
+    ++stats.buffers.elided;
+    return;
+  }
+  glBindBuffer(target, buffer);
+  if (bound) {
+    *bound = buffer;
+  }
+  ++stats.buffers.issued;
+}
+
+void GLState::bindBufferBase(unsigned int target, unsigned int index,
+                             unsigned int buffer) {
+  bool tracked =
+      target == GL_UNIFORM_BUFFER && index < GL_STATE_MAX_BUFFER_BASES;
+  if (tracked && uniformBases[index] == buffer) {
+    ++stats.bufferBases.elided;
+    return;
+  }
+  glBindBufferBase(target, index, buffer);
+  if (tracked) {
+    uniformBases[index] = buffer;
+  }
+  if (unsigned int *bound = genericBuffer(target)) {
+    *bound = buffer;
+  }
+  ++stats.bufferBases.issued;
+}
+
+void GLState::bindBufferRange(unsigned int target, unsigned int index,
+                              unsigned int buffer, size_t offset,
+                              size_t size) {
+  glBindBufferRange(target, index, buffer, offset, size);
+  if (target == GL_UNIFORM_BUFFER && index < GL_STATE_MAX_BUFFER_BASES) {
+    uniformBases[index] = 0;
+  }
+  if (unsigned int *bound = genericBuffer(target)) {
+    *bound = buffer;
+  }
+  ++stats.bufferBases.issued;
+}
+
+void GLState::forgetProgram(unsigned int deleted) {
+  // A program in use stays current until another is bound; drop it anyway so
+  // the next useProgram always reaches GL
+  if (program == deleted) {
+    program = 0;
+  }
+}
+
+void GLState::forgetVertexArray(unsigned int vao) {
+  if (vertexArray == vao) {
+    vertexArray = 0;
+  }
+}
+
+void GLState::forgetTexture(unsigned int texture) {
+  for (auto &bound : textures) {
+    if (bound == texture) {
+      bound = 0;
+    }
+  }
+}
+
+void GLState::forgetBuffer(unsigned int buffer) {
+  if (arrayBuffer == buffer) {
+    arrayBuffer = 0;
+  }
+  if (uniformBuffer == buffer) {
+    uniformBuffer = 0;
+  }
+  if (drawIndirectBuffer == buffer) {
+    drawIndirectBuffer = 0;
+  }
+  for (auto &bound : uniformBases) {
+    if (bound == buffer) {
+      bound = 0;
+    }
+  }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+
+// Texture unit used for uploads and parameter changes, so editing a texture
+// never disturbs the units draws sample from
+constexpr unsigned int GL_STATE_UPLOAD_UNIT = 15;
+constexpr unsigned int GL_STATE_MAX_TEXTURE_UNITS = 16;
+constexpr unsigned int GL_STATE_MAX_BUFFER_BASES = 16;
+
+struct GLStateCounter {
+  size_t issued = 0;
+  size_t elided = 0;
+};
+
+struct GLStateStats {
+  GLStateCounter programs;
+  GLStateCounter vertexArrays;
+  GLStateCounter textures; // glBindTexture (+ glActiveTexture when needed)
+  GLStateCounter buffers;
+  GLStateCounter bufferBases;
+};
+
+// Shadow copy of the GL bindings the engine uses. Every bind goes through
+// here and is dropped when the binding already matches. Anything that
+// deletes a GL object must call the matching forget*() so a recycled name
+// isn't mistaken for a live binding.
+class GLState {
+public:
+  static GLState &get();
+
+  // Prevent copying/moving (there is one context and one shadow of it)
+  GLState(const GLState &) = delete;
+  GLState &operator=(const GLState &) = delete;
+  GLState(GLState &&) = delete;
+  GLState &operator=(GLState &&) = delete;
+
+  void useProgram(unsigned int program);
+  void bindVertexArray(unsigned int vao);
+  // GL_TEXTURE_2D on the given unit
+  void bindTexture(unsigned int unit, unsigned int texture);
+  // GL_TEXTURE_BUFFER on the given unit (shares the unit's shadow slot, so
+  // keep buffer textures on units of their own)
+  void bindTextureBuffer(unsigned int unit, unsigned int texture);
+  // GL_TEXTURE_2D_ARRAY on the given unit (same caveat)
+  void bindTextureArray(unsigned int unit, unsigned int texture);
+  // Bind to GL_STATE_UPLOAD_UNIT for glTexImage2D/glTexParameteri
+  void bindTextureForUpload(unsigned int texture) {
+    bindTexture(GL_STATE_UPLOAD_UNIT, texture);
+  }
+  // GL_ARRAY_BUFFER / GL_UNIFORM_BUFFER / GL_DRAW_INDIRECT_BUFFER.
+  // GL_ELEMENT_ARRAY_BUFFER is VAO state and is always passed through.
+  void bindBuffer(unsigned int target, unsigned int buffer);
+  // Indexed GL_UNIFORM_BUFFER binding; also sets the generic binding
+  void bindBufferBase(unsigned int target, unsigned int index,
+                      unsigned int buffer);
+  // Part of a buffer on an indexed binding. Not shadowed (ranges move every
+  // frame), but keeps the whole-buffer shadow from going stale.
+  void bindBufferRange(unsigned int target, unsigned int index,
+                       unsigned int buffer, size_t offset, size_t size);
+
+  void forgetProgram(unsigned int program);
+  void forgetVertexArray(unsigned int vao);
+  void forgetTexture(unsigned int texture);
+  void forgetBuffer(unsigned int buffer);
+
+  // Counts since the last resetStats()
+  const GLStateStats &getStats() const { return stats; }
+  void resetStats() { stats = GLStateStats(); }
+
+private:
+  GLState() = default;
+
+  unsigned int *genericBuffer(unsigned int target);
+  void bindTextureTarget(unsigned int unit, unsigned int target,
+                         unsigned int texture);
+
+  unsigned int program = 0;
+  unsigned int vertexArray = 0;
+  unsigned int activeUnit = 0;
+  unsigned int textures[GL_STATE_MAX_TEXTURE_UNITS] = {};
+  unsigned int arrayBuffer = 0;
+  unsigned int uniformBuffer = 0;
+  unsigned int drawIndirectBuffer = 0;
+  unsigned int uniformBases[GL_STATE_MAX_BUFFER_BASES] = {};
+  GLStateStats stats;
+};
@@ -641,6 +641,16 @@ PFNGLVERTEXP4UIPROC glad_glVertexP4ui = NULL;
 PFNGLVERTEXP4UIVPROC glad_glVertexP4uiv = NULL;
 PFNGLVIEWPORTPROC glad_glViewport = NULL;
 PFNGLWAITSYNCPROC glad_glWaitSync = NULL;
+int GLAD_GL_ARB_buffer_storage = 0;
+PFNGLBUFFERSTORAGEPROC glad_glBufferStorage = NULL;
+int GLAD_GL_ARB_multi_draw_indirect = 0;
+PFNGLMULTIDRAWARRAYSINDIRECTPROC glad_glMultiDrawArraysIndirect = NULL;
+PFNGLMULTIDRAWELEMENTSINDIRECTPROC glad_glMultiDrawElementsIndirect = NULL;
+int GLAD_GL_ARB_base_instance = 0;
+int GLAD_GL_ARB_shader_storage_buffer_object = 0;
+int GLAD_GL_ARB_shading_language_420pack = 0;
+int GLAD_GL_ARB_copy_image = 0;
+PFNGLCOPYIMAGESUBDATAPROC glad_glCopyImageSubData = NULL;
 static void load_GL_VERSION_1_0(GLADloadproc load) {
   if (!GLAD_GL_VERSION_1_0)
     return;
@@ -1233,10 +1243,36 @@ static void load_GL_VERSION_3_3(GLADloadproc load) {
   glad_glSecondaryColorP3uiv =
       (PFNGLSECONDARYCOLORP3UIVPROC)load("glSecondaryColorP3uiv");
 }
+static void load_GL_ARB_buffer_storage(GLADloadproc load) {
+  if (!GLAD_GL_ARB_buffer_storage)
+    return;
+  glad_glBufferStorage = (PFNGLBUFFERSTORAGEPROC)load("glBufferStorage");
+}
+static void load_GL_ARB_multi_draw_indirect(GLADloadproc load) {
+  if (!GLAD_GL_ARB_multi_draw_indirect)
+    return;
+  glad_glMultiDrawArraysIndirect =
+      (PFNGLMULTIDRAWARRAYSINDIRECTPROC)load("glMultiDrawArraysIndirect");
+  glad_glMultiDrawElementsIndirect =
+      (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)load("glMultiDrawElementsIndirect");
+}
+static void load_GL_ARB_copy_image(GLADloadproc load) {
+  if (!GLAD_GL_ARB_copy_image)
+    return;
+  glad_glCopyImageSubData =
+      (PFNGLCOPYIMAGESUBDATAPROC)load("glCopyImageSubData");
+}
 static int find_extensionsGL(void) {
   if (!get_exts())
     return 0;
-  (void)&has_ext;
+  GLAD_GL_ARB_buffer_storage = has_ext("GL_ARB_buffer_storage");
+  GLAD_GL_ARB_multi_draw_indirect = has_ext("GL_ARB_multi_draw_indirect");
+  GLAD_GL_ARB_base_instance = has_ext("GL_ARB_base_instance");
+  GLAD_GL_ARB_shader_storage_buffer_object =
+      has_ext("GL_ARB_shader_storage_buffer_object");
+  GLAD_GL_ARB_shading_language_420pack =
+      has_ext("GL_ARB_shading_language_420pack");
+  GLAD_GL_ARB_copy_image = has_ext("GL_ARB_copy_image");
   free_exts();
   return 1;
 }
@@ -1318,5 +1354,8 @@ int gladLoadGLLoader(GLADloadproc load) {
 
   if (!find_extensionsGL())
     return 0;
+  load_GL_ARB_buffer_storage(load);
+  load_GL_ARB_multi_draw_indirect(load);
+  load_GL_ARB_copy_image(load);
   return GLVersion.major != 0 || GLVersion.minor != 0;
 }
@@ -0,0 +1,68 @@
+#include "indirectDraw.h"
+#include "../include/glad/glad.h"
+#include "glState.h"
+#include <numeric>
+
+IndirectDrawBuffer::IndirectDrawBuffer() {
+  glGenBuffers(1, &objectBuffer);
+  glGenBuffers(1, &commandBuffer);
+  glGenBuffers(1, &indexBuffer);
+}
+
+IndirectDrawBuffer::~IndirectDrawBuffer() {
+  for (unsigned int buffer : {objectBuffer, commandBuffer, indexBuffer}) {
+    GLState::get().forgetBuffer(buffer);
+    glDeleteBuffers(1, &buffer);
+  }
+}
+
+bool IndirectDrawBuffer::isSupported() {
+  return GLAD_GL_ARB_multi_draw_indirect && GLAD_GL_ARB_base_instance &&
+         GLAD_GL_ARB_shader_storage_buffer_object &&
+         GLAD_GL_ARB_shading_language_420pack;
+}
+
+void IndirectDrawBuffer::upload(const std::vector<ObjectData> &objects,
+                                const std::vector<uint32_t> &commands) {
+  if (objects.empty())
+    return;
+
+  // Grow geometrically like InstanceBuffer, orphan every frame
+  if (objects.size() > objectCapacity) {
+    objectCapacity = objects.size() + objects.size() / 2;
+  }
+  GLState::get().bindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, objectCapacity * sizeof(ObjectData),
+               nullptr, GL_STREAM_DRAW);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0,
+                  objects.size() * sizeof(ObjectData), objects.data());
+  GLState::get().bindBufferBase(GL_SHADER_STORAGE_BUFFER,
+                                OBJECT_BUFFER_BINDING, objectBuffer);
+
+  if (commands.size() > commandCapacity) {
+    commandCapacity = commands.size() + commands.size() / 2;
+  }
+  GLState::get().bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+  glBufferData(GL_DRAW_INDIRECT_BUFFER, commandCapacity * sizeof(uint32_t),
+               nullptr, GL_STREAM_DRAW);
+  glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0,
+                  commands.size() * sizeof(uint32_t), commands.data());
+
+  // The identity indices never change, only grow
+  if (objects.size() > indexCapacity) {
+    indexCapacity = objectCapacity;
+    std::vector<uint32_t> indices(indexCapacity);
+    std::iota(indices.begin(), indices.end(), 0u);
+    GLState::get().bindBuffer(GL_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, indices.size() * sizeof(uint32_t),
+                 indices.data(), GL_STATIC_DRAW);
+  }
+}
+
+void IndirectDrawBuffer::bindObjectIndices() const {
+  GLState::get().bindBuffer(GL_ARRAY_BUFFER, indexBuffer);
+  glVertexAttribIPointer(OBJECT_INDEX_ATTRIB, 1, GL_UNSIGNED_INT,
+                         sizeof(uint32_t), nullptr);
+  glEnableVertexAttribArray(OBJECT_INDEX_ATTRIB);
+  glVertexAttribDivisor(OBJECT_INDEX_ATTRIB, 1);
+}
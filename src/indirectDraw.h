@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/ext/matrix_float4x4.hpp>
+#include <glm/ext/vector_float3.hpp>
+#include <glm/ext/vector_float4.hpp>
+#include <vector>
+
+// Storage buffer binding of the object table and the vertex attribute that
+// carries each instance's index into it. Keep in sync with shader.vert.
+constexpr unsigned int OBJECT_BUFFER_BINDING = 0;
+constexpr unsigned int OBJECT_INDEX_ATTRIB = 11;
+// ObjectData::material of draws that sample the bound textures
+constexpr uint32_t OBJECT_NO_MATERIAL = UINT32_MAX;
+
+// One drawn entity and submesh, std430 layout
+struct ObjectData {
+  glm::mat4 model;
+  glm::vec4 normalMatrix[3]; // columns, w unused
+  glm::vec3 color;
+  float shininess;
+  // First of the mesh's entries in the MaterialTable, or OBJECT_NO_MATERIAL
+  uint32_t material;
+  float coverage; // fraction of pixels drawn (InstanceData::color.a)
+  uint32_t padding[2];
+};
+
+// The command layouts glMultiDraw*Indirect read
+struct DrawArraysIndirectCommand {
+  uint32_t count;
+  uint32_t instanceCount;
+  uint32_t first;
+  uint32_t baseInstance;
+};
+
+struct DrawElementsIndirectCommand {
+  uint32_t count;
+  uint32_t instanceCount;
+  uint32_t firstIndex;
+  int32_t baseVertex;
+  uint32_t baseInstance;
+};
+
+// GPU-driven submission: per-object data in a shader storage buffer and the
+// draws in an indirect command buffer, both rewritten every frame. The
+// vertex shader finds its object through an instanced attribute reading an
+// identity index buffer, so a command's baseInstance selects where its run
+// of objects starts (this needs GL 4.2 base instance, not
+// shader_draw_parameters).
+class IndirectDrawBuffer {
+public:
+  IndirectDrawBuffer();
+  ~IndirectDrawBuffer();
+
+  // Prevent copying/moving (OpenGL resources must stay in one place)
+  IndirectDrawBuffer(const IndirectDrawBuffer &) = delete;
+  IndirectDrawBuffer &operator=(const IndirectDrawBuffer &) = delete;
+  IndirectDrawBuffer(IndirectDrawBuffer &&) = delete;
+  IndirectDrawBuffer &operator=(IndirectDrawBuffer &&) = delete;
+
+  // The GL 4.3 pieces this path needs: multi-draw indirect, base instance,
+  // storage buffers and binding layout qualifiers in GLSL 3.30
+  static bool isSupported();
+
+  // Replace the objects and the packed commands (orphaning the old
+  // storage), then bind the object table and the command buffer
+  void upload(const std::vector<ObjectData> &objects,
+              const std::vector<uint32_t> &commands);
+
+  // Point OBJECT_INDEX_ATTRIB of the currently bound VAO at the identity
+  // index buffer, one index per instance
+  void bindObjectIndices() const;
+
+private:
+  unsigned int objectBuffer = 0;
+  unsigned int commandBuffer = 0;
+  unsigned int indexBuffer = 0;
+  size_t objectCapacity = 0;  // in objects
+  size_t commandCapacity = 0; // in uint32_t
+  size_t indexCapacity = 0;   // in indices
+};
@@ -0,0 +1,59 @@
+#include "instanceBuffer.h"
+#include "../include/glad/glad.h"
+#include "glState.h"
+
+InstanceBuffer::InstanceBuffer() : VBO(0) { glGenBuffers(1, &VBO); }
+
+InstanceBuffer::~InstanceBuffer() {
+  if (VBO) {
+    GLState::get().forgetBuffer(VBO);
+    glDeleteBuffers(1, &VBO);
+  }
+}
+
+void InstanceBuffer::upload(const std::vector<InstanceData> &instances) {
+  if (instances.empty())
+    return;
+
+  GLState::get().bindBuffer(GL_ARRAY_BUFFER, VBO);
+  // Grow geometrically so a slowly growing scene doesn't reallocate every
+  // frame; orphan the old storage either way
+  if (instances.size() > capacity) {
+    capacity = instances.size() + instances.size() / 2;
+  }
+  glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceData), nullptr,
+               GL_STREAM_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(InstanceData),
+                  instances.data());
+}
+
+void InstanceBuffer::bindAttributes(size_t firstInstance) const {
+  GLState::get().bindBuffer(GL_ARRAY_BUFFER, VBO);
+  size_t base = firstInstance * sizeof(InstanceData);
+
+  // A mat4 attribute is four vec4 columns
+  for (unsigned int column = 0; column < 4; ++column) {
+    unsigned int location = INSTANCE_ATTRIB_MODEL + column;
+    glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                          (void *)(base + offsetof(InstanceData, model) +
+                                   column * sizeof(glm::vec4)));
+    glEnableVertexAttribArray(location);
+    glVertexAttribDivisor(location, 1);
+  }
+
+  glVertexAttribPointer(INSTANCE_ATTRIB_COLOR, 4, GL_FLOAT, GL_FALSE,
+                        sizeof(InstanceData),
+                        (void *)(base + offsetof(InstanceData, color)));
+  glEnableVertexAttribArray(INSTANCE_ATTRIB_COLOR);
+  glVertexAttribDivisor(INSTANCE_ATTRIB_COLOR, 1);
+
+  // And a mat3 three vec3 columns
+  for (unsigned int column = 0; column < 3; ++column) {
+    unsigned int location = INSTANCE_ATTRIB_NORMAL + column;
+    glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                          (void *)(base + offsetof(InstanceData, normalMatrix) +
+                                   column * sizeof(glm::vec3)));
+    glEnableVertexAttribArray(location);
+    glVertexAttribDivisor(location, 1);
+  }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <glm/ext/matrix_float3x3.hpp>
+#include <glm/ext/matrix_float4x4.hpp>
+#include <glm/ext/vector_float4.hpp>
+#include <vector>
+
+// First vertex attribute used for per-instance data (after position, uv,
+// normal). The model matrix takes four locations, the color one more and
+// the normal matrix three.
+constexpr unsigned int INSTANCE_ATTRIB_MODEL = 3;
+constexpr unsigned int INSTANCE_ATTRIB_COLOR = 7;
+constexpr unsigned int INSTANCE_ATTRIB_NORMAL = 8;
+
+// Per-instance data, one entry per drawn entity
+struct InstanceData {
+  glm::mat4 model;
+  // rgb multiplied into every texture sample, a is the fraction of pixels
+  // drawn (dithered, while cross-fading to an impostor)
+  glm::vec4 color;
+  // Inverse transpose of model's upper 3x3 (any scale of it), so the vertex
+  // shader doesn't have to invert per vertex
+  glm::mat3 normalMatrix;
+};
+
+// Vertex buffer of InstanceData rewritten every frame and read with
+// glVertexAttribDivisor(1) by instanced draws
+class InstanceBuffer {
+public:
+  InstanceBuffer();
+  ~InstanceBuffer();
+
+  // Prevent copying/moving (OpenGL resources must stay in one place)
+  InstanceBuffer(const InstanceBuffer &) = delete;
+  InstanceBuffer &operator=(const InstanceBuffer &) = delete;
+  InstanceBuffer(InstanceBuffer &&) = delete;
+  InstanceBuffer &operator=(InstanceBuffer &&) = delete;
+
+  // Replace the contents. The old storage is orphaned so the driver never
+  // has to wait for last frame's draws.
+  void upload(const std::vector<InstanceData> &instances);
+
+  // Point the instance attributes of the currently bound VAO at the
+  // instances starting at firstInstance (GL 3.3 has no base instance)
+  void bindAttributes(size_t firstInstance) const;
+
+private:
+  unsigned int VBO;
+  size_t capacity = 0; // in instances
+};
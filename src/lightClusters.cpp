@@ -0,0 +1,286 @@
+#include "lightClusters.h"
+#include "../include/glad/glad.h"
+#include "glState.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr int TILES_PER_SLICE = CLUSTER_X * CLUSTER_Y;
+static_assert(TILES_PER_SLICE % 4 == 0, "tiles are tested 4 at a time");
+
+// Buffer textures: lights (two RGBA32F texels each), the grid, the indices
+constexpr unsigned int BUFFER_FORMATS[3] = {GL_RGBA32F, GL_RG32UI, GL_R32UI};
+constexpr unsigned int BUFFER_UNITS[3] = {LIGHT_DATA_UNIT, CLUSTER_GRID_UNIT,
+                                          LIGHT_INDEX_UNIT};
+
+} // namespace
+
+LightClusters::LightClusters(size_t threads)
+    : clusterLights(CLUSTER_COUNT), grid(CLUSTER_COUNT * 2, 0),
+      workers(threads) {
+  size_t boundsSize = size_t(CLUSTER_COUNT);
+  for (auto *bounds : {&minX, &minY, &minZ, &maxX, &maxY, &maxZ}) {
+    bounds->assign(boundsSize, 0.f);
+  }
+
+  glGenBuffers(3, buffers);
+  glGenTextures(3, textures);
+  for (int i = 0; i < 3; ++i) {
+    // Never empty, so every sampler has storage behind it
+    GLState::get().bindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+    glBufferData(GL_TEXTURE_BUFFER, i == 1 ? grid.size() * sizeof(uint32_t)
+                                           : 16,
+                 i == 1 ? grid.data() : nullptr, GL_STREAM_DRAW);
+    GLState::get().bindTextureBuffer(BUFFER_UNITS[i], textures[i]);
+    glTexBuffer(GL_TEXTURE_BUFFER, BUFFER_FORMATS[i], buffers[i]);
+  }
+}
+
+LightClusters::~LightClusters() {
+  for (int i = 0; i < 3; ++i) {
+    GLState::get().forgetTexture(textures[i]);
+    GLState::get().forgetBuffer(buffers[i]);
+  }
+  glDeleteTextures(3, textures);
+  glDeleteBuffers(3, buffers);
+}
+
+void LightClusters::updateClusterBounds(const glm::mat4 &projection,
+                                        int width, int height, float zNear,
+                                        float zFar) {
+  if (projection == boundsProjection && width == boundsWidth &&
+      height == boundsHeight && zNear == boundsNear && zFar == boundsFar)
+    return;
+  boundsProjection = projection;
+  boundsWidth = width;
+  boundsHeight = height;
+  boundsNear = zNear;
+  boundsFar = zFar;
+
+  // Exponential slices keep froxels roughly cube shaped with distance
+  float clusterFar = std::max(std::min(CLUSTER_FAR, zFar), zNear * 2.f);
+  float logRange = std::log(clusterFar / zNear);
+  for (int slice = 0; slice < CLUSTER_Z; ++slice) {
+    sliceDepths[slice] =
+        zNear * std::exp(logRange * float(slice) / CLUSTER_Z);
+  }
+  sliceDepths[CLUSTER_Z] = std::max(zFar, clusterFar);
+  shaderParams = glm::vec4(float(width) / CLUSTER_X,
+                           float(height) / CLUSTER_Y, CLUSTER_Z / logRange,
+                           -CLUSTER_Z * std::log(zNear) / logRange);
+
+  // A view space point at depth d lands on NDC x = x * P00 / d (symmetric
+  // perspective), so a tile edge at NDC x runs along x = ndc * d / P00
+  float invScaleX = 1.f / projection[0][0];
+  float invScaleY = 1.f / projection[1][1];
+  for (int slice = 0; slice < CLUSTER_Z; ++slice) {
+    float depthNear = sliceDepths[slice];
+    float depthFar = sliceDepths[slice + 1];
+    for (int y = 0; y < CLUSTER_Y; ++y) {
+      float ndcY0 = -1.f + 2.f * y / CLUSTER_Y;
+      float ndcY1 = -1.f + 2.f * (y + 1) / CLUSTER_Y;
+      for (int x = 0; x < CLUSTER_X; ++x) {
+        float ndcX0 = -1.f + 2.f * x / CLUSTER_X;
+        float ndcX1 = -1.f + 2.f * (x + 1) / CLUSTER_X;
+        size_t cluster = size_t(slice) * TILES_PER_SLICE + y * CLUSTER_X + x;
+        minX[cluster] = std::min(ndcX0 * depthNear, ndcX0 * depthFar) *
+                        invScaleX;
+        maxX[cluster] = std::max(ndcX1 * depthNear, ndcX1 * depthFar) *
+                        invScaleX;
+        minY[cluster] = std::min(ndcY0 * depthNear, ndcY0 * depthFar) *
+                        invScaleY;
+        maxY[cluster] = std::max(ndcY1 * depthNear, ndcY1 * depthFar) *
+                        invScaleY;
+        // The camera looks down -z
+        minZ[cluster] = -depthFar;
+        maxZ[cluster] = -depthNear;
+      }
+    }
+  }
+}
+
+void LightClusters::build(const LightStore &store, const glm::mat4 &view,
+                          const glm::mat4 &projection, int width, int height,
+                          float zNear, float zFar) {
+  auto start = std::chrono::steady_clock::now();
+  updateClusterBounds(projection, width, height, zNear, zFar);
+
+  const std::vector<LightData> &lights = store.getSlots();
+  // Move lights to view space and find the slices their spheres reach
+  viewLights.resize(lights.size());
+  firstSlices.resize(lights.size());
+  lastSlices.resize(lights.size());
+  for (size_t i = 0; i < lights.size(); ++i) {
+    glm::vec3 position = glm::vec3(view * glm::vec4(lights[i].position, 1.f));
+    float radius = lights[i].radius;
+    viewLights[i] = glm::vec4(position, radius);
+
+    float depthNear = -position.z - radius;
+    float depthFar = -position.z + radius;
+    if (radius <= 0.f || depthFar < zNear) {
+      // Never binned
+      firstSlices[i] = CLUSTER_Z;
+      lastSlices[i] = -1;
+      continue;
+    }
+    auto sliceOf = [&](float depth) {
+      int slice = int(std::floor(std::log(std::max(depth, zNear)) *
+                                     shaderParams.z +
+                                 shaderParams.w));
+      return std::clamp(slice, 0, CLUSTER_Z - 1);
+    };
+    firstSlices[i] = sliceOf(depthNear);
+    lastSlices[i] = sliceOf(depthFar);
+  }
+
+  // Each job owns whole slices, so no two jobs touch the same cluster list
+  int slicesPerJob = (CLUSTER_Z + LIGHT_CLUSTER_JOBS - 1) / LIGHT_CLUSTER_JOBS;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    jobsLeft = LIGHT_CLUSTER_JOBS;
+  }
+  for (int job = 0; job < LIGHT_CLUSTER_JOBS; ++job) {
+    int firstSlice = std::min(CLUSTER_Z, job * slicesPerJob);
+    int endSlice = std::min(CLUSTER_Z, firstSlice + slicesPerJob);
+    workers.submit([this, firstSlice, endSlice] {
+      binSlices(firstSlice, endSlice);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        --jobsLeft;
+      }
+      jobsDone.notify_one();
+    });
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    jobsDone.wait(lock, [this] { return jobsLeft == 0; });
+  }
+
+  // Flatten into (offset, count) per cluster plus one index list
+  indices.clear();
+  stats.maxPerCluster = 0;
+  for (size_t cluster = 0; cluster < clusterLights.size(); ++cluster) {
+    const auto &list = clusterLights[cluster];
+    grid[cluster * 2] = static_cast<uint32_t>(indices.size());
+    grid[cluster * 2 + 1] = static_cast<uint32_t>(list.size());
+    indices.insert(indices.end(), list.begin(), list.end());
+    stats.maxPerCluster = std::max(stats.maxPerCluster, list.size());
+  }
+
+  stats.lights = store.getActiveCount();
+  stats.indices = indices.size();
+  stats.buildMs = std::chrono::duration<float, std::milli>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+}
+
+void LightClusters::binSlices(int firstSlice, int endSlice) {
+  for (int slice = firstSlice; slice < endSlice; ++slice) {
+    size_t first = size_t(slice) * TILES_PER_SLICE;
+    for (int tile = 0; tile < TILES_PER_SLICE; ++tile) {
+      clusterLights[first + tile].clear();
+    }
+
+    for (size_t light = 0; light < viewLights.size(); ++light) {
+      if (slice < firstSlices[light] || slice > lastSlices[light])
+        continue;
+      const glm::vec4 &sphere = viewLights[light];
+      float radiusSq = sphere.w * sphere.w;
+
+#if defined(__SSE2__)
+      // Sphere vs box, four tiles at a time: squared distance from the
+      // center to the box, per axis max(min - c, c - max, 0)
+      __m128 cx = _mm_set1_ps(sphere.x);
+      __m128 cy = _mm_set1_ps(sphere.y);
+      __m128 cz = _mm_set1_ps(sphere.z);
+      __m128 r2 = _mm_set1_ps(radiusSq);
+      __m128 zero = _mm_setzero_ps();
+      for (int tile = 0; tile < TILES_PER_SLICE; tile += 4) {
+        size_t cluster = first + tile;
+        __m128 dx = _mm_max_ps(
+            _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minX[cluster]), cx),
+                       _mm_sub_ps(cx, _mm_loadu_ps(&maxX[cluster]))),
+            zero);
+        __m128 dy = _mm_max_ps(
+            _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minY[cluster]), cy),
+                       _mm_sub_ps(cy, _mm_loadu_ps(&maxY[cluster]))),
+            zero);
+        __m128 dz = _mm_max_ps(
+            _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minZ[cluster]), cz),
+                       _mm_sub_ps(cz, _mm_loadu_ps(&maxZ[cluster]))),
+            zero);
+        __m128 distSq = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+            _mm_mul_ps(dz, dz));
+        int hits = _mm_movemask_ps(_mm_cmple_ps(distSq, r2));
+        while (hits) {
+          int lane = __builtin_ctz(hits);
+          clusterLights[cluster + lane].push_back(uint32_t(light));
+          hits &= hits - 1;
+        }
+      }
+#else
+      for (int tile = 0; tile < TILES_PER_SLICE; ++tile) {
+        size_t cluster = first + tile;
+        float dx = std::max({minX[cluster] - sphere.x,
+                             sphere.x - maxX[cluster], 0.f});
+        float dy = std::max({minY[cluster] - sphere.y,
+                             sphere.y - maxY[cluster], 0.f});
+        float dz = std::max({minZ[cluster] - sphere.z,
+                             sphere.z - maxZ[cluster], 0.f});
+        if (dx * dx + dy * dy + dz * dz <= radiusSq)
+          clusterLights[cluster].push_back(uint32_t(light));
+      }
+#endif
+    }
+  }
+}
+
+void LightClusters::upload(LightStore &store) {
+  const std::vector<LightData> &lights = store.getSlots();
+  store.takeDirtyRanges(dirtyRanges);
+  uploadStats = LightUploadStats();
+
+  // Lights persist: only changed slots are rewritten, unless the buffer
+  // has to grow and everything goes up once
+  GLState::get().bindBuffer(GL_TEXTURE_BUFFER, buffers[0]);
+  if (lights.size() > lightCapacity) {
+    lightCapacity = std::max(lights.size(), lightCapacity * 3 / 2);
+    glBufferData(GL_TEXTURE_BUFFER, lightCapacity * sizeof(LightData), nullptr,
+                 GL_DYNAMIC_DRAW);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, lights.size() * sizeof(LightData),
+                    lights.data());
+    uploadStats.lightBytes = lights.size() * sizeof(LightData);
+    uploadStats.lightRanges = 1;
+  } else {
+    for (const auto &[first, end] : dirtyRanges) {
+      glBufferSubData(GL_TEXTURE_BUFFER, first * sizeof(LightData),
+                      (end - first) * sizeof(LightData), &lights[first]);
+      uploadStats.lightBytes += (end - first) * sizeof(LightData);
+      ++uploadStats.lightRanges;
+    }
+  }
+  GLState::get().bindTextureBuffer(LIGHT_DATA_UNIT, textures[0]);
+
+  // The grid and indices follow the camera, so they are rebuilt whole
+  const std::vector<uint32_t> *lists[2] = {&grid, &indices};
+  size_t *counters[2] = {&uploadStats.gridBytes, &uploadStats.indexBytes};
+  for (int i = 1; i < 3; ++i) {
+    const std::vector<uint32_t> &list = *lists[i - 1];
+    size_t size = list.size() * sizeof(uint32_t);
+    // Orphan: last frame's draws may still read the old contents
+    GLState::get().bindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+    glBufferData(GL_TEXTURE_BUFFER, std::max(size, size_t(16)), nullptr,
+                 GL_STREAM_DRAW);
+    if (size > 0) {
+      glBufferSubData(GL_TEXTURE_BUFFER, 0, size, list.data());
+    }
+    *counters[i - 1] = size;
+    GLState::get().bindTextureBuffer(BUFFER_UNITS[i], textures[i]);
+  }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "lightStore.h"
+#include "threadPool.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <mutex>
+#include <vector>
+
+// View-space froxel grid: screen tiles times exponential depth slices. Keep
+// in sync with shader.frag.
+constexpr int CLUSTER_X = 16;
+constexpr int CLUSTER_Y = 9;
+constexpr int CLUSTER_Z = 24;
+constexpr int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+// Depth slices stop here; the last slice takes everything farther away
+constexpr float CLUSTER_FAR = 500.f;
+// Slices are binned in this many parallel jobs
+constexpr int LIGHT_CLUSTER_JOBS = 4;
+
+// Texture units of the light buffers (after the material samplers)
+constexpr unsigned int LIGHT_DATA_UNIT = 3;
+constexpr unsigned int CLUSTER_GRID_UNIT = 4;
+constexpr unsigned int LIGHT_INDEX_UNIT = 5;
+
+struct ClusterStats {
+  size_t lights = 0;
+  size_t indices = 0;       // light references over all clusters
+  size_t maxPerCluster = 0; // the worst case a fragment loops over
+  float buildMs = 0.f;
+};
+
+// Bytes sent to the GPU by the last upload()
+struct LightUploadStats {
+  size_t lightBytes = 0;
+  size_t lightRanges = 0; // glBufferSubData calls for the lights
+  size_t gridBytes = 0;
+  size_t indexBytes = 0;
+};
+
+// Clustered forward lighting: lights are binned into the froxels their
+// sphere of influence touches on worker threads, then the lights, the
+// per-cluster (offset, count) grid and the flat light index list go to the
+// GPU as buffer textures (GL 3.3 has no storage buffers). The fragment
+// shader only loops over the lights of its own cluster.
+class LightClusters {
+public:
+  explicit LightClusters(size_t threads = LIGHT_CLUSTER_JOBS);
+  ~LightClusters();
+
+  // Prevent copying/moving (OpenGL resources must stay in one place)
+  LightClusters(const LightClusters &) = delete;
+  LightClusters &operator=(const LightClusters &) = delete;
+  LightClusters(LightClusters &&) = delete;
+  LightClusters &operator=(LightClusters &&) = delete;
+
+  // Bin the store's lights for this view; shader light indices are store
+  // slots. Touches no GL state.
+  void build(const LightStore &store, const glm::mat4 &view,
+             const glm::mat4 &projection, int width, int height, float zNear,
+             float zFar);
+  // Upload the lights that changed, the last build's grid and index list,
+  // and bind the buffer textures (main thread)
+  void upload(LightStore &store);
+
+  // Pixels per tile in x and y, then the slice scale and bias:
+  // slice = log(viewDepth) * z + w
+  const glm::vec4 &getShaderParams() const { return shaderParams; }
+  const ClusterStats &getStats() const { return stats; }
+  const LightUploadStats &getUploadStats() const { return uploadStats; }
+
+private:
+  void updateClusterBounds(const glm::mat4 &projection, int width, int height,
+                           float zNear, float zFar);
+  void binSlices(int firstSlice, int endSlice);
+
+  // View space bounds of every cluster, one SoA row of tiles per slice
+  std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+  glm::mat4 boundsProjection{0.f};
+  int boundsWidth = 0, boundsHeight = 0;
+  float boundsNear = 0.f, boundsFar = 0.f;
+  float sliceDepths[CLUSTER_Z + 1];
+  glm::vec4 shaderParams{0.f};
+
+  // This frame's lights in view space and the slices each one touches
+  std::vector<glm::vec4> viewLights; // xyz, radius
+  std::vector<int> firstSlices, lastSlices;
+  std::vector<std::vector<uint32_t>> clusterLights;
+
+  // GPU copy: (offset, count) per cluster and the flat index list
+  std::vector<uint32_t> grid;
+  std::vector<uint32_t> indices;
+  unsigned int buffers[3] = {};
+  unsigned int textures[3] = {};
+  size_t lightCapacity = 0; // slots the light buffer has storage for
+  std::vector<std::pair<size_t, size_t>> dirtyRanges;
+  LightUploadStats uploadStats;
+
+  std::mutex mutex;
+  std::condition_variable jobsDone;
+  int jobsLeft = 0;
+  ClusterStats stats;
+
+  // Declared last so the workers are joined before the state above goes
+  ThreadPool workers;
+};
@@ -0,0 +1,97 @@
+#include "lightStore.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+float lightRadius(const glm::vec3 &color, float intensity) {
+  float peak = intensity * std::max({color.r, color.g, color.b});
+  if (peak <= LIGHT_CUTOFF)
+    return 0.f;
+  // Solve peak / (1 + 0.1d + 0.01d^2) = LIGHT_CUTOFF for d
+  float c = 1.f - peak / LIGHT_CUTOFF;
+  return (-0.1f + std::sqrt(0.01f - 0.04f * c)) / 0.02f;
+}
+
+bool LightStore::set(size_t entity, const glm::vec3 &position,
+                     const glm::vec3 &color, float intensity) {
+  if (entity >= slotOfEntity.size()) {
+    slotOfEntity.resize(entity + 1, -1);
+  }
+
+  int slot = slotOfEntity[entity];
+  if (slot < 0) {
+    // Reuse a freed slot before growing, so the array stays dense
+    if (!freeSlots.empty()) {
+      slot = static_cast<int>(freeSlots.back());
+      freeSlots.pop_back();
+    } else if (slots.size() < size_t(MAX_LIGHTS)) {
+      slot = static_cast<int>(slots.size());
+      slots.push_back({});
+      lastSeen.push_back(0);
+      entityOfSlot.push_back(0);
+      dirty.push_back(0);
+    } else {
+      return false;
+    }
+    slotOfEntity[entity] = slot;
+    entityOfSlot[slot] = entity;
+    ++activeCount;
+  }
+  lastSeen[slot] = frame;
+
+  LightData light{};
+  light.position = position;
+  light.radius = lightRadius(color, intensity);
+  light.color = color;
+  light.intensity = intensity;
+  // Static lights end here every frame
+  if (std::memcmp(&light, &slots[slot], sizeof(LightData)) == 0)
+    return true;
+  slots[slot] = light;
+  markDirty(slot);
+  return true;
+}
+
+void LightStore::remove(size_t entity) {
+  if (entity >= slotOfEntity.size() || slotOfEntity[entity] < 0)
+    return;
+  size_t slot = slotOfEntity[entity];
+  slotOfEntity[entity] = -1;
+  slots[slot] = LightData{};
+  markDirty(slot);
+  freeSlots.push_back(slot);
+  --activeCount;
+}
+
+void LightStore::removeStale() {
+  for (size_t slot = 0; slot < slots.size(); ++slot) {
+    size_t entity = entityOfSlot[slot];
+    if (lastSeen[slot] != frame && slotOfEntity[entity] == int(slot)) {
+      remove(entity);
+    }
+  }
+}
+
+void LightStore::markDirty(size_t slot) {
+  if (!dirty[slot]) {
+    dirty[slot] = 1;
+    dirtySlots.push_back(slot);
+  }
+}
+
+void LightStore::takeDirtyRanges(
+    std::vector<std::pair<size_t, size_t>> &ranges) {
+  ranges.clear();
+  std::sort(dirtySlots.begin(), dirtySlots.end());
+  for (size_t slot : dirtySlots) {
+    dirty[slot] = 0;
+    // A few clean slots in between cost less than another upload call
+    if (!ranges.empty() &&
+        slot <= ranges.back().second + LIGHT_RANGE_MERGE_GAP) {
+      ranges.back().second = slot + 1;
+    } else {
+      ranges.emplace_back(slot, slot + 1);
+    }
+  }
+  dirtySlots.clear();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "uniformBuffer.h"
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <utility>
+#include <vector>
+
+// Lights are cut off where they add less than one 8-bit step
+constexpr float LIGHT_CUTOFF = 1.f / 256.f;
+// Dirty slots closer than this are uploaded as one range
+constexpr size_t LIGHT_RANGE_MERGE_GAP = 4;
+
+// Distance at which intensity * color falls below LIGHT_CUTOFF under the
+// shader's 1 / (1 + 0.1d + 0.01d^2) attenuation
+float lightRadius(const glm::vec3 &color, float intensity);
+
+// Persistent CPU copy of the GPU light array. Each light entity keeps its
+// slot (and so its index in the shader) for as long as it exists, and only
+// slots whose contents changed are reported for upload. Touches no GL state.
+class LightStore {
+public:
+  // Call once per frame before the set() calls
+  void beginFrame() { ++frame; }
+  // Add or update an entity's light. Returns false when all MAX_LIGHTS
+  // slots are taken.
+  bool set(size_t entity, const glm::vec3 &position, const glm::vec3 &color,
+           float intensity);
+  void remove(size_t entity);
+  // Remove the lights of entities not set() since beginFrame()
+  void removeStale();
+
+  // Every slot; free ones have radius 0 and are never binned
+  const std::vector<LightData> &getSlots() const { return slots; }
+  size_t getActiveCount() const { return activeCount; }
+
+  // Coalesced [first, end) slot ranges changed since the last call
+  void takeDirtyRanges(std::vector<std::pair<size_t, size_t>> &ranges);
+
+private:
+  void markDirty(size_t slot);
+
+  std::vector<LightData> slots;
+  std::vector<uint32_t> lastSeen; // frame each slot was last set()
+  std::vector<int> slotOfEntity;  // -1 = no light
+  std::vector<size_t> entityOfSlot;
+  std::vector<size_t> freeSlots;
+  std::vector<uint8_t> dirty;
+  std::vector<size_t> dirtySlots;
+  size_t activeCount = 0;
+  uint32_t frame = 0;
+};
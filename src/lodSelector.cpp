@@ -0,0 +1,49 @@
+#include "lodSelector.h"
+#include "mesh.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/geometric.hpp>
+#include <glm/trigonometric.hpp>
+
+void sweepLodSegments(int level, int &pathSegments, int &circleSegments) {
+  pathSegments = std::max(1, pathSegments >> level);
+  circleSegments = std::max(3, circleSegments >> level);
+}
+
+void LodSelector::setView(const glm::vec3 &cameraPos, float fovDeg,
+                          int viewportHeight) {
+  this->cameraPos = cameraPos;
+  pixelsPerUnit =
+      viewportHeight * 0.5f / std::tan(glm::radians(fovDeg) * 0.5f);
+  stats = LodStats();
+}
+
+int LodSelector::select(uint32_t entity, const BoundingSphere &bounds,
+                        int levels) {
+  if (entity >= this->levels.size()) {
+    this->levels.resize(entity + 1, 0);
+  }
+
+  float distance = std::max(
+      glm::length(bounds.center - cameraPos) - bounds.radius, 0.1f);
+  float pixels = 2.f * bounds.radius * pixelsPerUnit / distance;
+
+  // Refine while clearly above the threshold of the finer level, coarsen
+  // while clearly below our own
+  int level = std::min<int>(this->levels[entity], levels - 1);
+  while (level > 0 &&
+         pixels > LOD_PIXELS[level - 1] * (1.f + LOD_HYSTERESIS)) {
+    --level;
+  }
+  while (level < levels - 1 &&
+         pixels < LOD_PIXELS[level] * (1.f - LOD_HYSTERESIS)) {
+    ++level;
+  }
+  this->levels[entity] = static_cast<uint8_t>(level);
+  return level;
+}
+
+void LodSelector::count(int level, const Mesh &mesh) {
+  ++stats.instances[level];
+  stats.triangles[level] += mesh.getElementCount() / 3;
+}
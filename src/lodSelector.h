@@ -0,0 +1,48 @@
+#pragma once
+
+#include "math/bounds.h"
+#include <cstddef>
+#include <cstdint>
+#include <glm/ext/vector_float3.hpp>
+#include <vector>
+
+class Mesh;
+
+// Detail levels per sweep, the full resolution mesh included
+constexpr int LOD_LEVELS = 4;
+// Screen diameter in pixels below which an instance drops to the next
+// coarser level
+constexpr float LOD_PIXELS[LOD_LEVELS - 1] = {160.f, 48.f, 16.f};
+// How far past a threshold (as a fraction of it) the size has to move
+// before the level changes, so instances sitting on one don't flicker
+constexpr float LOD_HYSTERESIS = 0.2f;
+
+// Path and circle resolution of a sweep at level; every level halves both
+void sweepLodSegments(int level, int &pathSegments, int &circleSegments);
+
+struct LodStats {
+  size_t instances[LOD_LEVELS] = {};
+  size_t triangles[LOD_LEVELS] = {};
+};
+
+// Picks the detail level of each instance from its projected size. The
+// level of every entity is kept between frames for the hysteresis.
+class LodSelector {
+public:
+  // Call once per frame before select(); also restarts the counters
+  void setView(const glm::vec3 &cameraPos, float fovDeg, int viewportHeight);
+
+  // Level (0 = finest, < levels) to draw the entity with these world bounds
+  int select(uint32_t entity, const BoundingSphere &bounds, int levels);
+  // Count a submitted instance of mesh at level
+  void count(int level, const Mesh &mesh);
+
+  // Counters of the last frame
+  const LodStats &getStats() const { return stats; }
+
+private:
+  glm::vec3 cameraPos{0.f};
+  float pixelsPerUnit = 1.f; // at distance 1
+  std::vector<uint8_t> levels; // by entity id
+  LodStats stats;
+};
@@ -1,14 +1,36 @@
 #include "app.h"
 #include "ecs/registry.h"
+#include "meshCooker.h"
+#include "textureCooker.h"
+#include "uniformBuffer.h"
+#include <string>
+#include <vector>
 
 Registry g_registry;
 
 const unsigned int WIDTH = 1000;
 const unsigned int HEIGHT = 1000;
 
-int main() {
+int main(int argc, char **argv) {
+  std::vector<std::string> args(argv + 1, argv + argc);
+
+  // Tool modes run without creating a window
+  if (!args.empty() && args[0] == "--cook") {
+    return runCookTool({args.begin() + 1, args.end()});
+  }
+  if (!args.empty() && args[0] == "--simplify") {
+    return runSimplifyTool({args.begin() + 1, args.end()});
+  }
+  if (!args.empty() && args[0] == "--test-uniform-ring") {
+    return runUniformRingTest();
+  }
+
   App app(WIDTH, HEIGHT, "OpenGL Template");
 
+  if (!args.empty() && args[0] == "--bench-normals") {
+    return app.runNormalMatrixBenchmark();
+  }
+
   app.run();
 
   return 0;
@@ -0,0 +1,334 @@
+#include "materialTable.h"
+#include "../include/glad/glad.h"
+#include "glState.h"
+#include "indirectDraw.h"
+#include "mesh.h"
+#include <algorithm>
+#include <iostream>
+
+namespace {
+int levelSize(int size, int level) { return std::max(1, size >> level); }
+
+bool isCompressed(GLenum internalFormat) {
+  return internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+}
+} // namespace
+
+MaterialTable::MaterialTable() : allocator(MATERIAL_TABLE_INITIAL_ENTRIES) {
+  glGenBuffers(1, &buffer);
+  entries.resize(MATERIAL_TABLE_INITIAL_ENTRIES);
+  glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+}
+
+MaterialTable::~MaterialTable() {
+  GLState::get().forgetBuffer(buffer);
+  glDeleteBuffers(1, &buffer);
+  for (TextureArray &array : arrays) {
+    GLState::get().forgetTexture(array.id);
+    glDeleteTextures(1, &array.id);
+  }
+}
+
+bool MaterialTable::isSupported() {
+  return GLAD_GL_ARB_copy_image && IndirectDrawBuffer::isSupported();
+}
+
+unsigned int MaterialTable::createArrayStorage(const TextureArray &array,
+                                               int layers) {
+  unsigned int id;
+  glGenTextures(1, &id);
+  GLState::get().bindTextureArray(GL_STATE_UPLOAD_UNIT, id);
+
+  GLenum pixelFormat = GL_RGBA;
+  if (array.internalFormat == GL_R8) {
+    pixelFormat = GL_RED;
+  } else if (array.internalFormat == GL_RGB8) {
+    pixelFormat = GL_RGB;
+  }
+  for (int level = 0; level < array.levels; ++level) {
+    int width = levelSize(array.width, level);
+    int height = levelSize(array.height, level);
+    if (isCompressed(array.internalFormat)) {
+      glCompressedTexImage3D(
+          GL_TEXTURE_2D_ARRAY, level, array.internalFormat, width, height,
+          layers, 0,
+          GLsizei(Texture::levelBytes(array.internalFormat, width, height) *
+                  layers),
+          nullptr);
+    } else {
+      glTexImage3D(GL_TEXTURE_2D_ARRAY, level, array.internalFormat, width,
+                   height, layers, 0, pixelFormat, GL_UNSIGNED_BYTE, nullptr);
+    }
+  }
+
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, array.levels - 1);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, array.sampler.wrap);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, array.sampler.wrap);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                  array.sampler.minFilter);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER,
+                  array.sampler.magFilter);
+  return id;
+}
+
+bool MaterialTable::growArray(TextureArray &array, int capacity) {
+  capacity = std::min(capacity, maxLayers);
+  if (capacity <= array.capacity)
+    return false;
+
+  unsigned int id = createArrayStorage(array, capacity);
+  if (array.used > 0) {
+    for (int level = 0; level < array.levels; ++level) {
+      glCopyImageSubData(array.id, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, id,
+                         GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+                         levelSize(array.width, level),
+                         levelSize(array.height, level), array.used);
+    }
+  }
+  if (array.id) {
+    GLState::get().forgetTexture(array.id);
+    glDeleteTextures(1, &array.id);
+  }
+  array.id = id;
+  array.capacity = capacity;
+  return true;
+}
+
+int MaterialTable::findArray(const Texture &texture) {
+  if (texture.getLevelCount() == 0)
+    return -1;
+  std::string key = std::to_string(texture.getInternalFormat()) + "/" +
+                    std::to_string(texture.getWidth()) + "x" +
+                    std::to_string(texture.getHeight()) + "/" +
+                    std::to_string(texture.getLevelCount()) + "/" +
+                    texture.getSampler().key();
+  for (size_t i = 0; i < arrays.size(); ++i) {
+    if (arrays[i].key == key)
+      return int(i);
+  }
+  if (arrays.size() >= size_t(MATERIAL_TEXTURE_ARRAYS))
+    return -1;
+
+  TextureArray array;
+  array.key = key;
+  array.width = texture.getWidth();
+  array.height = texture.getHeight();
+  array.levels = texture.getLevelCount();
+  array.internalFormat = texture.getInternalFormat();
+  array.sampler = texture.getSampler();
+  for (int level = 0; level < array.levels; ++level) {
+    array.layerBytes +=
+        Texture::levelBytes(array.internalFormat, levelSize(array.width, level),
+                            levelSize(array.height, level));
+  }
+  if (!growArray(array, MATERIAL_ARRAY_INITIAL_LAYERS))
+    return -1;
+  arrays.push_back(std::move(array));
+  return int(arrays.size() - 1);
+}
+
+void MaterialTable::releaseLayer(PackedTexture &packed) {
+  if (packed.array < 0)
+    return;
+  arrays[packed.array].freeLayers.push_back(packed.layer);
+  packed.array = -1;
+  packed.layer = -1;
+  ++generation;
+}
+
+bool MaterialTable::pack(const std::shared_ptr<Texture> &texture, int &array,
+                         int &layer) {
+  if (!texture || texture->isStreamed())
+    return false;
+
+  PackedTexture &packed = packedTextures[texture.get()];
+  if (packed.array >= 0 && packed.texture.lock() == texture &&
+      packed.version == texture->getVersion()) {
+    array = packed.array;
+    layer = packed.layer;
+    return true;
+  }
+  // Changed since it was copied, or a new texture at a dead one's address
+  releaseLayer(packed);
+  packed.texture = texture;
+  packed.version = texture->getVersion();
+
+  int index = findArray(*texture);
+  if (index < 0)
+    return false;
+  TextureArray &target = arrays[index];
+  if (!target.freeLayers.empty()) {
+    layer = target.freeLayers.back();
+    target.freeLayers.pop_back();
+  } else {
+    if (target.used == target.capacity &&
+        !growArray(target, target.capacity * 2))
+      return false;
+    layer = target.used++;
+  }
+
+  for (int level = 0; level < target.levels; ++level) {
+    glCopyImageSubData(texture->getId(), GL_TEXTURE_2D, level, 0, 0, 0,
+                       target.id, GL_TEXTURE_2D_ARRAY, level, 0, 0, layer,
+                       levelSize(target.width, level),
+                       levelSize(target.height, level), 1);
+  }
+  ++copies;
+  packed.array = array = index;
+  packed.layer = layer;
+  return true;
+}
+
+bool MaterialTable::isCurrent(const MeshEntry &entry, const Mesh &mesh) const {
+  const std::vector<Material> &materials = mesh.getMaterials();
+  if (entry.generation != generation ||
+      entry.shininess.size() != materials.size() ||
+      entry.textures[0] != mesh.getImageTexture().get() ||
+      entry.versions[0] != mesh.getImageTexture()->getVersion())
+    return false;
+  for (size_t i = 0; i < materials.size(); ++i) {
+    const Texture *diffuse = materials[i].diffuse.get();
+    const Texture *specular = materials[i].specular.get();
+    if (entry.shininess[i] != materials[i].shininess ||
+        entry.textures[1 + 2 * i] != diffuse ||
+        entry.versions[1 + 2 * i] != diffuse->getVersion() ||
+        entry.textures[2 + 2 * i] != specular ||
+        entry.versions[2 + 2 * i] != specular->getVersion())
+      return false;
+  }
+  return true;
+}
+
+MeshMaterials MaterialTable::resolve(const Mesh &mesh) {
+  MeshEntry &entry = meshes[mesh.getId()];
+  // Every instance of a mesh resolves the same way within a frame
+  if (entry.lastFrame == frame && !entry.textures.empty()) {
+    return {entry.packed, entry.packed ? allocator.getOffset(entry.handle) : 0};
+  }
+  entry.lastFrame = frame;
+  if (!entry.textures.empty() && isCurrent(entry, mesh)) {
+    return {entry.packed, entry.packed ? allocator.getOffset(entry.handle) : 0};
+  }
+
+  const std::vector<Material> &materials = mesh.getMaterials();
+  entry.textures.clear();
+  entry.versions.clear();
+  entry.shininess.clear();
+  auto remember = [&](const std::shared_ptr<Texture> &texture) {
+    entry.textures.push_back(texture.get());
+    entry.versions.push_back(texture->getVersion());
+  };
+  remember(mesh.getImageTexture());
+  for (const Material &material : materials) {
+    remember(material.diffuse);
+    remember(material.specular);
+    entry.shininess.push_back(material.shininess);
+  }
+
+  std::vector<MaterialEntry> built(materials.size());
+  int imageArray, imageLayer;
+  bool packed = pack(mesh.getImageTexture(), imageArray, imageLayer);
+  for (size_t i = 0; packed && i < materials.size(); ++i) {
+    MaterialEntry &out = built[i];
+    out.imageArray = imageArray;
+    out.imageLayer = imageLayer;
+    packed = pack(materials[i].diffuse, out.diffuseArray, out.diffuseLayer) &&
+             pack(materials[i].specular, out.specularArray,
+                  out.specularLayer);
+    out.shininess = materials[i].shininess;
+    out.padding = 0.f;
+  }
+  entry.generation = generation;
+
+  if (!packed) {
+    allocator.free(entry.handle);
+    entry.handle = INVALID_RANGE;
+    entry.count = 0;
+    entry.packed = false;
+    return {};
+  }
+
+  uint32_t count = uint32_t(built.size());
+  if (entry.count != count) {
+    allocator.free(entry.handle);
+    entry.handle = allocator.allocate(count);
+    if (entry.handle == INVALID_RANGE) {
+      uint32_t capacity = allocator.getCapacity();
+      allocator.grow(std::max(capacity * 2, capacity + count));
+      entries.resize(allocator.getCapacity());
+      entry.handle = allocator.allocate(count);
+    }
+    entry.count = count;
+  }
+  std::copy(built.begin(), built.end(),
+            entries.begin() + allocator.getOffset(entry.handle));
+  entry.packed = true;
+  dirty = true;
+  return {true, allocator.getOffset(entry.handle)};
+}
+
+void MaterialTable::evict() {
+  for (auto it = meshes.begin(); it != meshes.end();) {
+    if (frame - it->second.lastFrame > MATERIAL_EVICT_FRAMES) {
+      allocator.free(it->second.handle);
+      it = meshes.erase(it);
+      ++evictions;
+    } else {
+      ++it;
+    }
+  }
+  for (auto it = packedTextures.begin(); it != packedTextures.end();) {
+    if (it->second.texture.expired()) {
+      releaseLayer(it->second);
+      it = packedTextures.erase(it);
+      ++evictions;
+    } else {
+      ++it;
+    }
+  }
+}
+
+void MaterialTable::upload() {
+  if (++frame % MATERIAL_EVICT_FRAMES == 0) {
+    evict();
+  }
+
+  // Materials rarely change, so the whole table goes up when one does
+  GLState::get().bindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+  if (entries.size() > bufferCapacity) {
+    bufferCapacity = entries.size();
+    glBufferData(GL_SHADER_STORAGE_BUFFER,
+                 bufferCapacity * sizeof(MaterialEntry), entries.data(),
+                 GL_DYNAMIC_DRAW);
+  } else if (dirty) {
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0,
+                    entries.size() * sizeof(MaterialEntry), entries.data());
+  }
+  dirty = false;
+  GLState::get().bindBufferBase(GL_SHADER_STORAGE_BUFFER,
+                                MATERIAL_BUFFER_BINDING, buffer);
+
+  for (size_t i = 0; i < arrays.size(); ++i) {
+    GLState::get().bindTextureArray(MATERIAL_ARRAY_FIRST_UNIT + i,
+                                    arrays[i].id);
+  }
+}
+
+MaterialTableStats MaterialTable::takeStats() {
+  MaterialTableStats stats;
+  for (const auto &[id, entry] : meshes) {
+    stats.meshes += entry.packed;
+  }
+  stats.entries = allocator.getStats().used;
+  for (const TextureArray &array : arrays) {
+    stats.textures += array.used - array.freeLayers.size();
+    stats.textureBytes += array.layerBytes * array.capacity;
+  }
+  stats.arrays = arrays.size();
+  stats.copies = copies;
+  stats.evictions = evictions;
+  copies = 0;
+  evictions = 0;
+  return stats;
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "rangeAllocator.h"
+#include "texture.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Mesh;
+
+// Storage buffer binding of the material table, and the texture units of the
+// arrays textures are packed into. Keep in sync with the shaders.
+constexpr unsigned int MATERIAL_BUFFER_BINDING = 1;
+constexpr int MATERIAL_TEXTURE_ARRAYS = 8;
+constexpr unsigned int MATERIAL_ARRAY_FIRST_UNIT = 6;
+// Starting sizes; both double when full
+constexpr int MATERIAL_ARRAY_INITIAL_LAYERS = 4;
+constexpr uint32_t MATERIAL_TABLE_INITIAL_ENTRIES = 256;
+// Frames a mesh may go undrawn before its entries are given back
+constexpr uint32_t MATERIAL_EVICT_FRAMES = 600;
+
+// One material of one mesh, std430. Each texture is an (array, layer) pair
+// into the packed texture arrays.
+struct MaterialEntry {
+  int32_t imageArray;
+  int32_t imageLayer;
+  int32_t diffuseArray;
+  int32_t diffuseLayer;
+  int32_t specularArray;
+  int32_t specularLayer;
+  float shininess;
+  float padding;
+};
+
+// Where a mesh's materials start in the table. Vertex::materialId is added
+// to base in the vertex shader.
+struct MeshMaterials {
+  bool packed = false; // false: bind the mesh's textures per draw instead
+  uint32_t base = 0;
+};
+
+struct MaterialTableStats {
+  size_t meshes = 0;       // meshes with entries in the table
+  size_t entries = 0;      // materials in the table
+  size_t textures = 0;     // layers in use
+  size_t arrays = 0;
+  size_t textureBytes = 0; // GPU storage of the arrays
+  size_t copies = 0;       // textures copied in since the last takeStats()
+  size_t evictions = 0;
+};
+
+// Registry of every mesh material drawn on the indirect path. Materials live
+// in a storage buffer and their textures are copied into 2D texture arrays
+// (one per format, size, mip count and sampler), so a draw only needs a
+// material index and meshes with different textures share one multi-draw.
+// Textures that keep changing (streamed mips) are left out; meshes using
+// them resolve as not packed and draw with bound textures as before.
+class MaterialTable {
+public:
+  MaterialTable();
+  ~MaterialTable();
+
+  // Prevent copying/moving (OpenGL resources must stay in one place)
+  MaterialTable(const MaterialTable &) = delete;
+  MaterialTable &operator=(const MaterialTable &) = delete;
+  MaterialTable(MaterialTable &&) = delete;
+  MaterialTable &operator=(MaterialTable &&) = delete;
+
+  // glCopyImageSubData on top of what IndirectDrawBuffer needs
+  static bool isSupported();
+
+  // Entries for the mesh's materials, packing its textures on first use and
+  // again whenever one of them changed
+  MeshMaterials resolve(const Mesh &mesh);
+
+  // Upload changed entries, bind the table and the arrays, and every so
+  // often give back what undrawn meshes and dead textures held
+  void upload();
+
+  // Counters, copies and evictions since the last call
+  MaterialTableStats takeStats();
+
+private:
+  // Texture arrays share format, size, mip count and sampler
+  struct TextureArray {
+    std::string key;
+    unsigned int id = 0;
+    int width = 0;
+    int height = 0;
+    int levels = 0;
+    GLenum internalFormat = GL_RGBA8;
+    SamplerSettings sampler;
+    size_t layerBytes = 0; // all levels of one layer
+    int capacity = 0;      // layers allocated
+    int used = 0;          // layers ever handed out
+    std::vector<int> freeLayers;
+  };
+
+  struct PackedTexture {
+    std::weak_ptr<Texture> texture;
+    uint32_t version = 0;
+    int array = -1;
+    int layer = -1;
+  };
+
+  struct MeshEntry {
+    uint32_t handle = INVALID_RANGE;
+    uint32_t count = 0;
+    bool packed = false;
+    uint32_t lastFrame = 0;
+    uint32_t generation = 0; // of the layers when built
+    // Textures and shininess the entries were built from
+    std::vector<const Texture *> textures;
+    std::vector<uint32_t> versions;
+    std::vector<float> shininess;
+  };
+
+  // Array and layer holding the texture's current contents, copying it in
+  // if needed. false if it can't be packed.
+  bool pack(const std::shared_ptr<Texture> &texture, int &array, int &layer);
+  void releaseLayer(PackedTexture &packed);
+  int findArray(const Texture &texture);
+  // Reallocate an array with more layers, copying the used ones over
+  bool growArray(TextureArray &array, int capacity);
+  unsigned int createArrayStorage(const TextureArray &array, int layers);
+  bool isCurrent(const MeshEntry &entry, const Mesh &mesh) const;
+  void evict();
+
+  unsigned int buffer = 0;
+  size_t bufferCapacity = 0; // in entries
+  bool dirty = false;
+  std::vector<MaterialEntry> entries; // CPU copy of the whole table
+  RangeAllocator allocator;
+  std::vector<TextureArray> arrays;
+  std::unordered_map<const Texture *, PackedTexture> packedTextures;
+  std::unordered_map<uint32_t, MeshEntry> meshes; // by mesh id
+  uint32_t frame = 0;
+  // Bumped whenever a layer is given back, so entries pointing at it rebuild
+  uint32_t generation = 0;
+  int maxLayers = 0;
+  size_t copies = 0;
+  size_t evictions = 0;
+};
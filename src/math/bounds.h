@@ -0,0 +1,57 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <limits>
+
+// Axis aligned box. An empty box has min > max.
+struct AABB {
+  glm::vec3 min{std::numeric_limits<float>::max()};
+  glm::vec3 max{std::numeric_limits<float>::lowest()};
+
+  bool isEmpty() const { return min.x > max.x; }
+  glm::vec3 center() const { return (min + max) * 0.5f; }
+  glm::vec3 extent() const { return (max - min) * 0.5f; }
+
+  void expand(const glm::vec3 &point) {
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+  }
+  void expand(const AABB &other) {
+    min = glm::min(min, other.min);
+    max = glm::max(max, other.max);
+  }
+};
+
+struct BoundingSphere {
+  glm::vec3 center{0.f};
+  float radius = 0.f;
+};
+
+// Box enclosing box after transform (Arvo: project the extent onto each
+// axis of the matrix instead of transforming all eight corners)
+inline AABB transformAABB(const AABB &box, const glm::mat4 &m) {
+  if (box.isEmpty())
+    return box;
+
+  glm::vec3 center = glm::vec3(m * glm::vec4(box.center(), 1.f));
+  glm::vec3 extent = box.extent();
+  glm::vec3 worldExtent(0.f);
+  for (int axis = 0; axis < 3; ++axis) {
+    worldExtent += glm::abs(glm::vec3(m[axis])) * extent[axis];
+  }
+
+  AABB result;
+  result.min = center - worldExtent;
+  result.max = center + worldExtent;
+  return result;
+}
+
+// Sphere enclosing sphere after transform, scaled by the largest axis scale
+inline BoundingSphere transformSphere(const BoundingSphere &sphere,
+                                      const glm::mat4 &m) {
+  float scale = std::max({glm::length(glm::vec3(m[0])),
+                          glm::length(glm::vec3(m[1])),
+                          glm::length(glm::vec3(m[2]))});
+  return {glm::vec3(m * glm::vec4(sphere.center, 1.f)), sphere.radius * scale};
+}
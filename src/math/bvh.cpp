@@ -0,0 +1,308 @@
+#include "bvh.h"
+#include <algorithm>
+
+constexpr int SAH_BINS = 12;
+
+static float surfaceArea(const AABB &box) {
+  if (box.isEmpty())
+    return 0.f;
+  glm::vec3 d = box.max - box.min;
+  return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static bool sameBox(const AABB &a, const AABB &b) {
+  return a.min == b.min && a.max == b.max;
+}
+
+enum class Containment { Outside, Partial, Inside };
+
+static Containment classify(const Frustum &frustum, const AABB &box) {
+  Containment result = Containment::Inside;
+  for (const auto &plane : frustum.planes) {
+    glm::vec3 normal(plane);
+    // Corners furthest along and against the normal
+    glm::vec3 positive(normal.x > 0.f ? box.max.x : box.min.x,
+                       normal.y > 0.f ? box.max.y : box.min.y,
+                       normal.z > 0.f ? box.max.z : box.min.z);
+    glm::vec3 negative(normal.x > 0.f ? box.min.x : box.max.x,
+                       normal.y > 0.f ? box.min.y : box.max.y,
+                       normal.z > 0.f ? box.min.z : box.max.z);
+    if (glm::dot(normal, positive) + plane.w < 0.f)
+      return Containment::Outside;
+    if (glm::dot(normal, negative) + plane.w < 0.f)
+      result = Containment::Partial;
+  }
+  return result;
+}
+
+void BVH::update(uint32_t id, const AABB &box) {
+  if (!contains(id)) {
+    if (id >= itemOfId.size()) {
+      itemOfId.resize(id + 1, -1);
+    }
+    itemOfId[id] = static_cast<int>(items.size());
+    items.push_back({id, box, -1});
+    structureChanged = true;
+    return;
+  }
+
+  Item &item = items[itemOfId[id]];
+  if (sameBox(item.box, box))
+    return;
+  item.box = box;
+  if (item.leaf >= 0) {
+    dirtyLeaves.push_back(item.leaf);
+  }
+}
+
+void BVH::remove(uint32_t id) {
+  if (!contains(id))
+    return;
+
+  // Swap with the last item; order is rebuilt anyway
+  int index = itemOfId[id];
+  items[index] = items.back();
+  itemOfId[items[index].id] = index;
+  items.pop_back();
+  itemOfId[id] = -1;
+  structureChanged = true;
+}
+
+void BVH::commit() {
+  if (structureChanged) {
+    rebuild();
+    return;
+  }
+  if (dirtyLeaves.empty())
+    return;
+
+  std::sort(dirtyLeaves.begin(), dirtyLeaves.end());
+  dirtyLeaves.erase(std::unique(dirtyLeaves.begin(), dirtyLeaves.end()),
+                    dirtyLeaves.end());
+  for (int leaf : dirtyLeaves) {
+    refitLeaf(leaf);
+  }
+  dirtyLeaves.clear();
+  ++refits;
+
+  // Moving items stretch boxes the build never planned for
+  if (computeCost() > builtCost * BVH_REBUILD_RATIO) {
+    rebuild();
+  }
+}
+
+void BVH::refitLeaf(int leaf) {
+  Node &node = nodes[leaf];
+  node.box = AABB();
+  for (int i = node.first; i < node.first + node.count; ++i) {
+    node.box.expand(items[order[i]].box);
+  }
+
+  for (int parent = node.parent; parent >= 0;
+       parent = nodes[parent].parent) {
+    AABB box = nodes[nodes[parent].left].box;
+    box.expand(nodes[nodes[parent].right].box);
+    if (sameBox(box, nodes[parent].box))
+      break; // nothing above changes either
+    nodes[parent].box = box;
+  }
+}
+
+void BVH::rebuild() {
+  nodes.clear();
+  dirtyLeaves.clear();
+  structureChanged = false;
+  order.resize(items.size());
+  for (size_t i = 0; i < items.size(); ++i) {
+    order[i] = static_cast<int>(i);
+  }
+
+  if (!items.empty()) {
+    nodes.reserve(2 * items.size());
+    build(0, static_cast<int>(items.size()), -1);
+  }
+  builtCost = computeCost();
+  ++rebuilds;
+}
+
+int BVH::build(int first, int count, int parent) {
+  int index = static_cast<int>(nodes.size());
+  nodes.emplace_back();
+  nodes[index].parent = parent;
+
+  AABB box, centroids;
+  for (int i = first; i < first + count; ++i) {
+    box.expand(items[order[i]].box);
+    centroids.expand(items[order[i]].box.center());
+  }
+  nodes[index].box = box;
+
+  auto makeLeaf = [&] {
+    nodes[index].first = first;
+    nodes[index].count = count;
+    for (int i = first; i < first + count; ++i) {
+      items[order[i]].leaf = index;
+    }
+    return index;
+  };
+  if (count <= BVH_LEAF_SIZE)
+    return makeLeaf();
+
+  // Binned SAH along the axis with the widest centroid spread
+  glm::vec3 spread = centroids.max - centroids.min;
+  int axis = spread.x > spread.y ? (spread.x > spread.z ? 0 : 2)
+                                 : (spread.y > spread.z ? 1 : 2);
+  int mid = first + count / 2;
+
+  if (spread[axis] > 0.f) {
+    AABB binBoxes[SAH_BINS];
+    int binCounts[SAH_BINS] = {};
+    float scale = SAH_BINS / spread[axis];
+    auto binOf = [&](int item) {
+      float c = items[item].box.center()[axis];
+      return std::min(SAH_BINS - 1, int((c - centroids.min[axis]) * scale));
+    };
+    for (int i = first; i < first + count; ++i) {
+      int bin = binOf(order[i]);
+      binBoxes[bin].expand(items[order[i]].box);
+      ++binCounts[bin];
+    }
+
+    // Sweep from the right to get suffix areas, then from the left
+    float rightArea[SAH_BINS];
+    int rightCount[SAH_BINS];
+    AABB accum;
+    int accumCount = 0;
+    for (int bin = SAH_BINS - 1; bin > 0; --bin) {
+      accum.expand(binBoxes[bin]);
+      accumCount += binCounts[bin];
+      rightArea[bin] = surfaceArea(accum);
+      rightCount[bin] = accumCount;
+    }
+
+    float bestCost = surfaceArea(box) * count; // cost of staying a leaf
+    int bestSplit = -1;
+    accum = AABB();
+    accumCount = 0;
+    for (int split = 1; split < SAH_BINS; ++split) {
+      accum.expand(binBoxes[split - 1]);
+      accumCount += binCounts[split - 1];
+      if (accumCount == 0 || rightCount[split] == 0)
+        continue;
+      float cost = surfaceArea(accum) * accumCount +
+                   rightArea[split] * rightCount[split];
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestSplit = split;
+      }
+    }
+
+    if (bestSplit > 0) {
+      auto isLeft = [&](int item) { return binOf(item) < bestSplit; };
+      mid = int(std::partition(order.begin() + first,
+                               order.begin() + first + count, isLeft) -
+                order.begin());
+    } else if (count <= 4 * BVH_LEAF_SIZE) {
+      return makeLeaf();
+    }
+  }
+
+  // No useful SAH split (e.g. identical centroids): halve by position
+  if (mid == first || mid == first + count) {
+    mid = first + count / 2;
+    std::nth_element(order.begin() + first, order.begin() + mid,
+                     order.begin() + first + count, [&](int a, int b) {
+                       return items[a].box.center()[axis] <
+                              items[b].box.center()[axis];
+                     });
+  }
+
+  int left = build(first, mid - first, index);
+  int right = build(mid, first + count - mid, index);
+  nodes[index].left = left;
+  nodes[index].right = right;
+  return index;
+}
+
+float BVH::computeCost() const {
+  if (nodes.empty())
+    return 0.f;
+  float rootArea = surfaceArea(nodes[0].box);
+  if (rootArea <= 0.f)
+    return 0.f;
+
+  float cost = 0.f;
+  for (const auto &node : nodes) {
+    cost += surfaceArea(node.box) * (node.isLeaf() ? node.count : 1);
+  }
+  return cost / rootArea;
+}
+
+void BVH::collectSubtree(int node, std::vector<uint32_t> &out) const {
+  // Leaves of a subtree are not contiguous in order after refits, walk it
+  size_t base = stack.size();
+  stack.push_back(node);
+  while (stack.size() > base) {
+    const Node &current = nodes[stack.back()];
+    stack.pop_back();
+    if (current.isLeaf()) {
+      for (int i = current.first; i < current.first + current.count; ++i) {
+        out.push_back(items[order[i]].id);
+      }
+    } else {
+      stack.push_back(current.left);
+      stack.push_back(current.right);
+    }
+  }
+}
+
+void BVH::queryFrustum(const Frustum &frustum,
+                       std::vector<uint32_t> &out) const {
+  if (nodes.empty())
+    return;
+
+  batchBoxes.clear();
+  batchIds.clear();
+  stack.clear();
+  stack.push_back(0);
+  while (!stack.empty()) {
+    int index = stack.back();
+    stack.pop_back();
+    const Node &node = nodes[index];
+
+    Containment containment = classify(frustum, node.box);
+    if (containment == Containment::Outside)
+      continue;
+    if (containment == Containment::Inside) {
+      collectSubtree(index, out);
+    } else if (node.isLeaf()) {
+      for (int i = node.first; i < node.first + node.count; ++i) {
+        batchBoxes.push(items[order[i]].box);
+        batchIds.push_back(items[order[i]].id);
+      }
+    } else {
+      stack.push_back(node.left);
+      stack.push_back(node.right);
+    }
+  }
+
+  // Items of partially visible leaves, 8 at a time
+  batchVisible.resize(batchIds.size());
+  cullAABBs(frustum, batchBoxes, batchVisible.data());
+  for (size_t i = 0; i < batchIds.size(); ++i) {
+    if (batchVisible[i]) {
+      out.push_back(batchIds[i]);
+    }
+  }
+}
+
+BVHStats BVH::getStats() const {
+  BVHStats stats;
+  stats.items = items.size();
+  stats.nodes = nodes.size();
+  stats.refits = refits;
+  stats.rebuilds = rebuilds;
+  stats.cost = computeCost();
+  stats.builtCost = builtCost;
+  return stats;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "bounds.h"
+#include "frustum.h"
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Items per leaf when building; small leaves keep refits tight, the cull
+// kernel tests partially visible leaves in batches anyway
+constexpr int BVH_LEAF_SIZE = 4;
+// Rebuild once the SAH cost has grown this much since the last build
+constexpr float BVH_REBUILD_RATIO = 1.5f;
+
+struct BVHStats {
+  size_t items = 0;
+  size_t nodes = 0;
+  size_t refits = 0;   // since startup
+  size_t rebuilds = 0; // since startup
+  float cost = 0.f;    // SAH cost relative to a single leaf
+  float builtCost = 0.f;
+};
+
+// Bounding volume hierarchy over world boxes of scene entities, keyed by
+// entity id. Moving items only refit their ancestors; inserting or removing
+// items, or refits degrading the tree, trigger a binned SAH rebuild on the
+// next commit().
+class BVH {
+public:
+  // Insert id or move it to box
+  void update(uint32_t id, const AABB &box);
+  void remove(uint32_t id);
+  size_t size() const { return items.size(); }
+  bool contains(uint32_t id) const {
+    return id < itemOfId.size() && itemOfId[id] >= 0;
+  }
+
+  // Apply pending updates: refit or rebuild. Queries see the tree as of the
+  // last commit().
+  void commit();
+
+  // Ids whose boxes may intersect the frustum. Partially visible leaves are
+  // tested with cullAABBs().
+  void queryFrustum(const Frustum &frustum, std::vector<uint32_t> &out) const;
+
+  BVHStats getStats() const;
+
+private:
+  struct Node {
+    AABB box;
+    int left = -1; // children, -1 for leaves
+    int right = -1;
+    int parent = -1;
+    int first = 0; // leaves: range in order
+    int count = 0;
+    bool isLeaf() const { return left < 0; }
+  };
+
+  struct Item {
+    uint32_t id;
+    AABB box;
+    int leaf = -1;
+  };
+
+  void rebuild();
+  int build(int first, int count, int parent);
+  void refitLeaf(int leaf);
+  float computeCost() const;
+  void collectSubtree(int node, std::vector<uint32_t> &out) const;
+
+  std::vector<Node> nodes;
+  std::vector<Item> items;
+  std::vector<int> order;     // item indices, leaves own contiguous ranges
+  std::vector<int> itemOfId;  // -1 = not in the tree
+  std::vector<int> dirtyLeaves;
+  bool structureChanged = false;
+  float builtCost = 0.f;
+  size_t refits = 0;
+  size_t rebuilds = 0;
+
+  // Batch buffers reused by queryFrustum
+  mutable AABBArray batchBoxes;
+  mutable std::vector<uint32_t> batchIds;
+  mutable std::vector<uint8_t> batchVisible;
+  mutable std::vector<int> stack;
+};
@@ -0,0 +1,159 @@
+#include "frustum.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+Frustum Frustum::fromMatrix(const glm::mat4 &m) {
+  // Rows of the (column-major) matrix
+  glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+  glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+  glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+  glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+  Frustum frustum;
+  frustum.planes[0] = row3 + row0; // left
+  frustum.planes[1] = row3 - row0; // right
+  frustum.planes[2] = row3 + row1; // bottom
+  frustum.planes[3] = row3 - row1; // top
+  frustum.planes[4] = row3 + row2; // near
+  frustum.planes[5] = row3 - row2; // far
+  for (auto &plane : frustum.planes) {
+    plane /= glm::length(glm::vec3(plane));
+  }
+  return frustum;
+}
+
+bool Frustum::intersects(const AABB &box) const {
+  for (const auto &plane : planes) {
+    // Corner furthest along the plane normal
+    glm::vec3 p(plane.x > 0.f ? box.max.x : box.min.x,
+                plane.y > 0.f ? box.max.y : box.min.y,
+                plane.z > 0.f ? box.max.z : box.min.z);
+    if (glm::dot(glm::vec3(plane), p) + plane.w < 0.f)
+      return false;
+  }
+  return true;
+}
+
+bool Frustum::intersects(const BoundingSphere &sphere) const {
+  for (const auto &plane : planes) {
+    if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius)
+      return false;
+  }
+  return true;
+}
+
+void AABBArray::clear() {
+  minX.clear();
+  minY.clear();
+  minZ.clear();
+  maxX.clear();
+  maxY.clear();
+  maxZ.clear();
+  count = 0;
+}
+
+void AABBArray::push(const AABB &box) {
+  // Fill a whole group of 8 at a time; unused lanes are never reported
+  if (count % 8 == 0) {
+    size_t padded = count + 8;
+    minX.resize(padded, 0.f);
+    minY.resize(padded, 0.f);
+    minZ.resize(padded, 0.f);
+    maxX.resize(padded, 0.f);
+    maxY.resize(padded, 0.f);
+    maxZ.resize(padded, 0.f);
+  }
+  minX[count] = box.min.x;
+  minY[count] = box.min.y;
+  minZ[count] = box.min.z;
+  maxX[count] = box.max.x;
+  maxY[count] = box.max.y;
+  maxZ[count] = box.max.z;
+  ++count;
+}
+
+// Store lanes of an 8 bit inside mask, skipping the padding past count
+static size_t storeMask(unsigned int inside, size_t first, size_t count,
+                        uint8_t *visible) {
+  size_t lanes = std::min<size_t>(8, count - first);
+  size_t visibleCount = 0;
+  for (size_t lane = 0; lane < lanes; ++lane) {
+    uint8_t in = (inside >> lane) & 1u;
+    visible[first + lane] = in;
+    visibleCount += in;
+  }
+  return visibleCount;
+}
+
+size_t cullAABBs(const Frustum &frustum, const AABBArray &boxes,
+                 uint8_t *visible) {
+  // The corner to test depends only on the sign of the plane normal, which
+  // is the same for every box: pick the min or max array per plane once
+  const float *px[6], *py[6], *pz[6];
+  for (int i = 0; i < 6; ++i) {
+    const glm::vec4 &plane = frustum.planes[i];
+    px[i] = plane.x > 0.f ? boxes.maxX.data() : boxes.minX.data();
+    py[i] = plane.y > 0.f ? boxes.maxY.data() : boxes.minY.data();
+    pz[i] = plane.z > 0.f ? boxes.maxZ.data() : boxes.minZ.data();
+  }
+
+  size_t visibleCount = 0;
+  for (size_t first = 0; first < boxes.count; first += 8) {
+#if defined(__AVX__)
+    __m256 outside = _mm256_setzero_ps();
+    for (int i = 0; i < 6; ++i) {
+      const glm::vec4 &plane = frustum.planes[i];
+      __m256 d = _mm256_add_ps(
+          _mm256_add_ps(
+              _mm256_mul_ps(_mm256_set1_ps(plane.x),
+                            _mm256_loadu_ps(px[i] + first)),
+              _mm256_mul_ps(_mm256_set1_ps(plane.y),
+                            _mm256_loadu_ps(py[i] + first))),
+          _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.z),
+                                      _mm256_loadu_ps(pz[i] + first)),
+                        _mm256_set1_ps(plane.w)));
+      outside = _mm256_or_ps(
+          outside, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_LT_OQ));
+    }
+    unsigned int inside = ~unsigned(_mm256_movemask_ps(outside)) & 0xffu;
+#elif defined(__SSE2__)
+    // Two halves of 4
+    unsigned int inside = 0;
+    for (size_t half = 0; half < 8; half += 4) {
+      __m128 outside = _mm_setzero_ps();
+      for (int i = 0; i < 6; ++i) {
+        const glm::vec4 &plane = frustum.planes[i];
+        size_t at = first + half;
+        __m128 d = _mm_add_ps(
+            _mm_add_ps(
+                _mm_mul_ps(_mm_set1_ps(plane.x), _mm_loadu_ps(px[i] + at)),
+                _mm_mul_ps(_mm_set1_ps(plane.y), _mm_loadu_ps(py[i] + at))),
+            _mm_add_ps(
+                _mm_mul_ps(_mm_set1_ps(plane.z), _mm_loadu_ps(pz[i] + at)),
+                _mm_set1_ps(plane.w)));
+        outside = _mm_or_ps(outside, _mm_cmplt_ps(d, _mm_setzero_ps()));
+      }
+      inside |= (~unsigned(_mm_movemask_ps(outside)) & 0xfu) << half;
+    }
+#else
+    unsigned int inside = 0;
+    for (size_t lane = 0; lane < 8; ++lane) {
+      bool in = true;
+      for (int i = 0; i < 6 && in; ++i) {
+        const glm::vec4 &plane = frustum.planes[i];
+        size_t at = first + lane;
+        in = plane.x * px[i][at] + plane.y * py[i][at] + plane.z * pz[i][at] +
+                 plane.w >=
+             0.f;
+      }
+      inside |= unsigned(in) << lane;
+    }
+#endif
+    visibleCount += storeMask(inside, first, boxes.count, visible);
+  }
+  return visibleCount;
+}
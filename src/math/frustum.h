@@ -0,0 +1,40 @@
+#pragma once
+#include "bounds.h"
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Six planes (left, right, bottom, top, near, far) as (normal, d) with
+// normals pointing inwards: a point p is inside when dot(n, p) + d >= 0.
+struct Frustum {
+  glm::vec4 planes[6];
+
+  // Gribb/Hartmann extraction from projection * view
+  static Frustum fromMatrix(const glm::mat4 &viewProjection);
+
+  bool intersects(const AABB &box) const;
+  bool intersects(const BoundingSphere &sphere) const;
+};
+
+// World boxes in structure-of-arrays form so the cull kernel can load 8 of
+// a coordinate at once. Always padded to a multiple of 8 entries.
+struct AABBArray {
+  std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+  size_t count = 0;
+
+  void clear();
+  void push(const AABB &box);
+};
+
+struct CullStats {
+  size_t visible = 0;
+  size_t culled = 0;
+  size_t occluded = 0; // in the frustum but hidden behind occluders
+};
+
+// Test every box against the frustum, 8 boxes per iteration (one AVX or two
+// SSE registers; scalar on other targets). visible[i] is set to 1 if box i
+// may be on screen. Returns the number of visible boxes.
+size_t cullAABBs(const Frustum &frustum, const AABBArray &boxes,
+                 uint8_t *visible);
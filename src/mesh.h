@@ -7,42 +7,179 @@
 #include <vector>
 
 #pragma once
+#include "math/bounds.h"
+#include "geometryArena.h"
+#include "texture.h"
 #include "vertexBuffer.h"
 #include <glm/glm.hpp>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 enum TextureType { Diffuse, Specular, Image };
 
+// Shared meshes straight sweeps are drawn as (see Mesh::matchPrimitive)
+enum class Primitive { None, Cylinder, Disc };
+
+// Segments shorter than this times their radius become discs
+constexpr float PRIMITIVE_DISC_RATIO = 0.05f;
+
+// Texture set of one OBJ material (units 1/2 when bound)
+struct Material {
+  std::shared_ptr<Texture> diffuse = Texture::white();
+  std::shared_ptr<Texture> specular = Texture::white();
+  float shininess = 32.0f;
+
+  void bind() const;
+  bool hasSameTextures(const Material &other) const {
+    return diffuse == other.diffuse && specular == other.specular;
+  }
+};
+
+// Range of a mesh's indices (or vertices, for meshes without indices) drawn
+// with one material
+struct Submesh {
+  int material = 0;
+  unsigned int first = 0;
+  unsigned int count = 0;
+};
+
+// Texture files of a material, resolved by whoever uploads the mesh
+struct MaterialData {
+  std::string diffusePath; // empty = white
+  std::string specularPath;
+  float shininess = 0.f; // <= 1 keeps the default
+};
+
+// CPU-side result of loading a mesh. Building one never touches OpenGL, so it
+// can be done on a worker thread and handed to Mesh::upload() later.
+struct MeshData {
+  std::vector<Vertex> vertices;
+  // empty = draw the vertices in order (sweeps, terrain)
+  std::vector<unsigned int> indices;
+  // sorted by material; empty = one range using material 0
+  std::vector<Submesh> submeshes;
+  std::vector<MaterialData> materials;
+  std::string imagePath; // drawn over every material, empty = white
+};
+
 class Mesh {
 public:
-  Mesh(glm::vec3 color = glm::vec3(1.0f));
-  void draw();
+  Mesh();
+  ~Mesh();
+
+  // Prevent copying/moving (owns a range of the geometry arena)
+  Mesh(const Mesh &) = delete;
+  Mesh &operator=(const Mesh &) = delete;
+  Mesh(Mesh &&) = delete;
+  Mesh &operator=(Mesh &&) = delete;
+
+  // Bind the image texture to unit 0 (materials use units 1/2)
+  void bindImageTexture() const;
+  // The arena VAO, shared by every mesh
+  void bindVertexArray() const;
+  unsigned int getVertexArray() const;
+  // Draw instanceCount copies of one range; the vertex array must be bound
+  // and its instance attributes set (see InstanceBuffer)
+  void drawSubmesh(const Submesh &submesh, int instanceCount) const;
   int loadObj(const std::string &filePath, const std::string &objFileName,
               const std::string &texturePath = "");
   int loadVertices(const std::vector<Vertex> &v) {
     vertices.clear();
     vertices = v;
-    vertexCount = vertices.size();
-    buffer.uploadVertices(vertices);
+    indices.clear();
+    submeshes.clear();
+    uploadGeometry();
+    finishUpload();
     return vertices.size();
   }
-  bool setTexture(const std::string &path, TextureType type);
+  // Decode and upload a texture owned by this mesh alone
+  bool setTexture(const std::string &path, TextureType type,
+                  int material = 0);
+  // Use a (possibly shared) texture for the given slot. The image slot is
+  // shared by all materials.
+  void setTexture(const std::shared_ptr<Texture> &texture, TextureType type,
+                  int material = 0);
   int loadSweep(const std::vector<glm::vec3> &points, int pathSegments,
                 int circleSegments, float radius);
 
-  float getShininess() const { return shininess; }
+  // Upload vertices produced by parseObj()/buildSweep(). Textures listed in
+  // data are left to the caller so they can go through a cache.
+  int upload(MeshData &data);
+
+  // CPU-only loaders, safe to call from any thread
+  static bool parseObj(const std::string &filePath,
+                       const std::string &objFileName,
+                       const std::string &texturePath, MeshData &out);
+  // With sections > 1, only the part of the tube in section (of that many
+  // equal parts of the path), capped only where the path ends
+  static std::vector<Vertex> buildSweep(const std::vector<glm::vec3> &points,
+                                        int pathSegments, int circleSegments,
+                                        float radius, int section = 0,
+                                        int sections = 1);
+  // Recognize a straight 2-point sweep as a unit primitive and return the
+  // matrix placing it, so all of them share a few meshes per side count:
+  // the cylinder (0,0,0)-(0,1,0) of radius 1, or for segments much shorter
+  // than their radius (leaves) the disc of radius 1 facing +y.
+  // Anything else is Primitive::None and leaves localMatrix alone.
+  static Primitive matchPrimitive(const std::vector<glm::vec3> &points,
+                                  float radius, glm::mat4 &localMatrix);
+  // Indexed geometry of a unit primitive with the given number of sides
+  static MeshData buildPrimitive(Primitive primitive, int sides);
+
+  const std::shared_ptr<Texture> &getImageTexture() const {
+    return imageTexture;
+  }
+  const std::vector<Material> &getMaterials() const { return materials; }
+  const Material &getMaterial(int index) const { return materials[index]; }
+  const std::vector<Submesh> &getSubmeshes() const { return submeshes; }
+  // CPU copies of what was uploaded (static batching merges from these)
+  const std::vector<Vertex> &getVertices() const { return vertices; }
+  const std::vector<unsigned int> &getIndices() const { return indices; }
+  // Distance from the local origin to the furthest vertex
+  float getBoundingRadius() const { return boundingRadius; }
+  // Local space bounds, valid once loaded
+  const AABB &getBounds() const { return bounds; }
+  const BoundingSphere &getBoundingSphere() const { return boundingSphere; }
+  int getVertexCount() const { return vertexCount; }
+  // Drawn with glDrawElements* (submesh ranges are in indices)
+  bool isIndexed() const { return !indices.empty(); }
+  // Indices (or vertices) of all submeshes together, for drawing the whole
+  // mesh in one go
+  unsigned int getElementCount() const {
+    return static_cast<unsigned int>(isIndexed() ? indices.size()
+                                                 : vertices.size());
+  }
+  // Where the data starts in the arena buffers. Submesh ranges are relative
+  // to these, and indices to the first vertex.
+  uint32_t getFirstVertex() const;
+  uint32_t getFirstIndex() const;
+  // Unique per Mesh ever created, used for sorting draws
+  uint32_t getId() const { return id; }
+  // false until vertex data has been uploaded (async loads start empty)
+  bool isLoaded() const { return vertexCount > 0; }
 
 private:
-  vertexBuffer buffer;
+  uint32_t id;
+  GeometryRange geometry;
   int vertexCount;
-  unsigned int imageTextureId;
-  unsigned int specularTextureId;
-  unsigned int diffuseTextureId;
-  float shininess;
-  glm::vec3 color;
+  std::shared_ptr<Texture> imageTexture;
+  std::vector<Material> materials;
+  std::vector<Submesh> submeshes;
+  float boundingRadius = 0.f;
+  AABB bounds;
+  BoundingSphere boundingSphere;
   std::vector<Vertex> vertices;
+  std::vector<unsigned int> indices;
+
+  // Move vertices/indices into the arena, replacing the old range
+  void uploadGeometry();
+  // Set vertexCount, default submesh and bounds after new data was uploaded
+  void finishUpload();
+  void updateBounds();
 
   // other helper methods (generateCircle, loadSweep, etc.)
-  const std::vector<glm::vec3> generateCircle(int res, float radius);
+  static const std::vector<glm::vec3> generateCircle(int res, float radius);
 };
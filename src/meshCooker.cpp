@@ -0,0 +1,312 @@
+#include "meshCooker.h"
+#include "meshSimplifier.h"
+#include "textureCooker.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <glm/ext/scalar_constants.hpp>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+// Longest material path a cooked mesh may hold
+constexpr uint32_t MAX_COOKED_PATH = 4096;
+
+static size_t triangleCount(const MeshData &data) {
+  return (data.indices.empty() ? data.vertices.size() : data.indices.size()) /
+         3;
+}
+
+std::vector<MeshData> buildMeshLods(MeshData data) {
+  std::vector<MeshData> levels;
+  // Reserved, levels.front() is read while the others are added
+  levels.reserve(LOD_LEVELS);
+  size_t triangles = triangleCount(data);
+  levels.push_back(std::move(data));
+
+  // Every level from the full mesh, so errors don't add up
+  size_t previous = triangles;
+  for (int level = 1; level < LOD_LEVELS; ++level) {
+    size_t target =
+        size_t(triangles * std::pow(MESH_LOD_TRIANGLE_RATIO, float(level)));
+    SimplifyStats stats;
+    MeshData simplified = simplifyMesh(levels.front(), target,
+                                       MESH_LOD_MAX_ERROR[level - 1], &stats);
+    // Seams and the error budget can stop it early; a level less than a
+    // quarter smaller than the last isn't worth its memory
+    if (stats.trianglesOut == 0 || stats.trianglesOut * 4 > previous * 3)
+      break;
+    previous = stats.trianglesOut;
+    levels.push_back(std::move(simplified));
+  }
+  return levels;
+}
+
+static void writeString(std::ofstream &file, const std::string &value) {
+  uint32_t length = static_cast<uint32_t>(value.size());
+  file.write(reinterpret_cast<const char *>(&length), sizeof(length));
+  file.write(value.data(), length);
+}
+
+static bool readString(std::ifstream &file, std::string &value) {
+  uint32_t length = 0;
+  if (!file.read(reinterpret_cast<char *>(&length), sizeof(length)) ||
+      length > MAX_COOKED_PATH)
+    return false;
+  value.resize(length);
+  return bool(file.read(value.data(), length));
+}
+
+bool writeCookedMesh(const std::string &dstPath,
+                     const std::vector<MeshData> &levels) {
+  if (levels.empty())
+    return false;
+  const MeshData &first = levels.front();
+
+  // Write next to the target and rename, so readers never see half a file
+  std::error_code ec;
+  fs::create_directories(fs::path(dstPath).parent_path(), ec);
+  std::ostringstream tmpName;
+  tmpName << dstPath << ".tmp" << std::this_thread::get_id();
+  std::string tmpPath = tmpName.str();
+
+  std::ofstream file(tmpPath, std::ios::binary);
+  if (!file) {
+    std::cerr << "Failed to write cooked mesh: " << tmpPath << std::endl;
+    return false;
+  }
+
+  CookedMeshHeader header;
+  std::memcpy(header.magic, COOKED_MESH_MAGIC, 4);
+  header.version = COOKED_MESH_VERSION;
+  header.levelCount = static_cast<uint32_t>(levels.size());
+  header.materialCount = static_cast<uint32_t>(first.materials.size());
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  for (const MaterialData &material : first.materials) {
+    writeString(file, material.diffusePath);
+    writeString(file, material.specularPath);
+    file.write(reinterpret_cast<const char *>(&material.shininess),
+               sizeof(material.shininess));
+  }
+  writeString(file, first.imagePath);
+
+  for (const MeshData &level : levels) {
+    CookedMeshLevel counts{static_cast<uint32_t>(level.vertices.size()),
+                           static_cast<uint32_t>(level.indices.size()),
+                           static_cast<uint32_t>(level.submeshes.size())};
+    file.write(reinterpret_cast<const char *>(&counts), sizeof(counts));
+    file.write(reinterpret_cast<const char *>(level.vertices.data()),
+               sizeof(Vertex) * level.vertices.size());
+    file.write(reinterpret_cast<const char *>(level.indices.data()),
+               sizeof(unsigned int) * level.indices.size());
+    file.write(reinterpret_cast<const char *>(level.submeshes.data()),
+               sizeof(Submesh) * level.submeshes.size());
+  }
+  file.close();
+
+  fs::rename(tmpPath, dstPath, ec);
+  if (ec) {
+    std::cerr << "Failed to write cooked mesh: " << dstPath << std::endl;
+    fs::remove(tmpPath, ec);
+    return false;
+  }
+  return true;
+}
+
+bool readCookedMesh(const std::string &srcPath,
+                    std::vector<MeshData> &levels) {
+  std::ifstream file(srcPath, std::ios::binary);
+  if (!file)
+    return false;
+
+  std::error_code ec;
+  uintmax_t fileSize = fs::file_size(srcPath, ec);
+  CookedMeshHeader header;
+  bool valid =
+      !ec && file.read(reinterpret_cast<char *>(&header), sizeof(header)) &&
+      std::memcmp(header.magic, COOKED_MESH_MAGIC, 4) == 0 &&
+      header.version == COOKED_MESH_VERSION && header.levelCount > 0 &&
+      header.levelCount <= LOD_LEVELS && header.materialCount < 1024;
+
+  MeshData shared;
+  for (uint32_t i = 0; valid && i < header.materialCount; ++i) {
+    MaterialData material;
+    valid = readString(file, material.diffusePath) &&
+            readString(file, material.specularPath) &&
+            file.read(reinterpret_cast<char *>(&material.shininess),
+                      sizeof(material.shininess));
+    shared.materials.push_back(material);
+  }
+  valid = valid && readString(file, shared.imagePath);
+
+  levels.clear();
+  for (uint32_t i = 0; valid && i < header.levelCount; ++i) {
+    CookedMeshLevel counts;
+    // Reject anything that would make us allocate or index past the file
+    valid = file.read(reinterpret_cast<char *>(&counts), sizeof(counts)) &&
+            uint64_t(counts.vertexCount) * sizeof(Vertex) +
+                    uint64_t(counts.indexCount) * sizeof(unsigned int) +
+                    uint64_t(counts.submeshCount) * sizeof(Submesh) <=
+                fileSize;
+    if (!valid)
+      break;
+
+    MeshData level;
+    level.materials = shared.materials;
+    level.imagePath = shared.imagePath;
+    level.vertices.resize(counts.vertexCount);
+    level.indices.resize(counts.indexCount);
+    level.submeshes.resize(counts.submeshCount);
+    valid = file.read(reinterpret_cast<char *>(level.vertices.data()),
+                      sizeof(Vertex) * level.vertices.size()) &&
+            file.read(reinterpret_cast<char *>(level.indices.data()),
+                      sizeof(unsigned int) * level.indices.size()) &&
+            file.read(reinterpret_cast<char *>(level.submeshes.data()),
+                      sizeof(Submesh) * level.submeshes.size());
+    for (size_t j = 0; valid && j < level.indices.size(); ++j) {
+      valid = level.indices[j] < counts.vertexCount;
+    }
+    for (size_t j = 0; valid && j < level.submeshes.size(); ++j) {
+      const Submesh &submesh = level.submeshes[j];
+      valid = submesh.material >= 0 &&
+              size_t(submesh.material) < level.materials.size() + 1 &&
+              uint64_t(submesh.first) + submesh.count <=
+                  (level.indices.empty() ? counts.vertexCount
+                                         : counts.indexCount);
+    }
+    levels.push_back(std::move(level));
+  }
+
+  if (!valid) {
+    std::cerr << "Invalid cooked mesh: " << srcPath << std::endl;
+    levels.clear();
+    return false;
+  }
+  return true;
+}
+
+std::string cookedMeshPath(const std::string &objPath,
+                           const std::string &texturePath) {
+  std::error_code ec;
+  std::string canonical = fs::weakly_canonical(objPath, ec).string();
+  if (ec) {
+    canonical = objPath;
+  }
+
+  // The image path is stored too, so it is part of the name
+  std::ostringstream name;
+  name << "cache/meshes/" << std::hex
+       << std::hash<std::string>{}(canonical + "|" + texturePath) << ".mesh";
+  return name.str();
+}
+
+bool loadMeshLods(const std::string &filePath, const std::string &objFileName,
+                  const std::string &texturePath,
+                  std::vector<MeshData> &levels) {
+  std::string objPath = filePath + objFileName;
+  std::string cookedPath = cookedMeshPath(objPath, texturePath);
+  // Same freshness rule as cooked textures
+  if (isCookedTextureFresh(objPath, cookedPath) &&
+      readCookedMesh(cookedPath, levels))
+    return true;
+
+  MeshData data;
+  if (!Mesh::parseObj(filePath, objFileName, texturePath, data))
+    return false;
+  levels = buildMeshLods(std::move(data));
+  // A failed write only costs the next run the simplification again
+  writeCookedMesh(cookedPath, levels);
+  return true;
+}
+
+// Smooth, indexed tube of radius 1 around a wavy ring of radius 10, dense
+// enough to stand in for a large scanned model. The first row and column
+// are repeated with the closing UVs, so the seams are locked.
+static MeshData buildBenchmarkRing(int pathSegments, int circleSegments) {
+  MeshData data;
+  auto center = [](float angle) {
+    return glm::vec3(10.f * std::cos(angle), 2.f * std::sin(3.f * angle),
+                     10.f * std::sin(angle));
+  };
+  for (int i = 0; i <= pathSegments; ++i) {
+    float angle = 2.f * glm::pi<float>() * float(i) / float(pathSegments);
+    glm::vec3 position = center(angle);
+    glm::vec3 tangent = glm::normalize(center(angle + 1e-3f) - position);
+    glm::vec3 side = glm::normalize(glm::cross(tangent, glm::vec3(0, 1, 0)));
+    glm::vec3 up = glm::cross(side, tangent);
+    for (int j = 0; j <= circleSegments; ++j) {
+      float around = 2.f * glm::pi<float>() * float(j) / float(circleSegments);
+      Vertex vertex;
+      vertex.normal = std::cos(around) * up + std::sin(around) * side;
+      vertex.position = position + vertex.normal;
+      vertex.texCoord = glm::vec2(float(i) / float(pathSegments),
+                                  float(j) / float(circleSegments));
+      data.vertices.push_back(vertex);
+    }
+  }
+  // Counter-clockwise seen from outside
+  unsigned int row = circleSegments + 1;
+  for (int i = 0; i < pathSegments; ++i) {
+    for (int j = 0; j < circleSegments; ++j) {
+      unsigned int a = i * row + j, b = a + 1, c = a + row, d = c + 1;
+      data.indices.insert(data.indices.end(), {a, b, c, b, d, c});
+    }
+  }
+  return data;
+}
+
+int runSimplifyTool(const std::vector<std::string> &args) {
+  MeshData data;
+  std::string name;
+  if (args.size() == 2) {
+    name = args[0] + args[1];
+    if (!Mesh::parseObj(args[0], args[1], "", data)) {
+      std::cerr << "Failed to load mesh: " << name << std::endl;
+      return 1;
+    }
+  } else if (args.empty()) {
+    name = "generated ring";
+    data = buildBenchmarkRing(SIMPLIFY_BENCH_PATH_SEGMENTS,
+                              SIMPLIFY_BENCH_CIRCLE_SEGMENTS);
+  } else {
+    std::cerr << "usage: --simplify [<dir> <file.obj>]" << std::endl;
+    return 1;
+  }
+
+  size_t triangles = triangleCount(data);
+  std::cerr << name << ": " << triangles << " triangles, "
+            << data.vertices.size() << " vertices" << std::endl;
+
+  // Error vs triangle count, without an error cap
+  for (size_t target = triangles / 2; target >= 64; target /= 2) {
+    auto start = std::chrono::steady_clock::now();
+    SimplifyStats stats;
+    MeshData simplified = simplifyMesh(data, target, 1e30f, &stats);
+    float ms = std::chrono::duration<float, std::milli>(
+                   std::chrono::steady_clock::now() - start)
+                   .count();
+    std::cerr << "target " << target << ": " << stats.trianglesOut
+              << " triangles, " << simplified.vertices.size()
+              << " vertices, error " << stats.error << " of radius, "
+              << stats.passes << " passes, " << ms << " ms" << std::endl;
+  }
+
+  // What the import pipeline would cache
+  auto start = std::chrono::steady_clock::now();
+  std::vector<MeshData> levels = buildMeshLods(std::move(data));
+  float ms = std::chrono::duration<float, std::milli>(
+                 std::chrono::steady_clock::now() - start)
+                 .count();
+  std::cerr << "LOD chain (" << ms << " ms):";
+  for (const MeshData &level : levels) {
+    std::cerr << " " << triangleCount(level);
+  }
+  std::cerr << " triangles" << std::endl;
+  return 0;
+}
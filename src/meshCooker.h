@@ -0,0 +1,61 @@
+#pragma once
+
+#include "lodSelector.h"
+#include "mesh.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// On-disk layout of a cooked mesh (".mesh"): a header, the materials and the
+// image path, then every LOD level (finest first) as a CookedMeshLevel
+// followed by its vertices, indices and submeshes. Vertices are stored as
+// raw Vertex structs, so bump the version whenever Vertex changes.
+constexpr char COOKED_MESH_MAGIC[4] = {'M', 'E', 'S', 'H'};
+constexpr uint32_t COOKED_MESH_VERSION = 1;
+
+struct CookedMeshHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t levelCount;
+  uint32_t materialCount;
+};
+
+struct CookedMeshLevel {
+  uint32_t vertexCount;
+  uint32_t indexCount;
+  uint32_t submeshCount;
+};
+
+// Each LOD aims for this fraction of the triangles of the one before
+constexpr float MESH_LOD_TRIANGLE_RATIO = 0.5f;
+// Error each coarser level may reach, as a fraction of the bounding radius:
+// under a pixel at the LOD_PIXELS size the level is first drawn at. The
+// chain ends early once a level can't get any smaller within its budget.
+constexpr float MESH_LOD_MAX_ERROR[LOD_LEVELS - 1] = {0.01f, 0.03f, 0.09f};
+// "--simplify" without a model: a smooth indexed tube with this many
+// quads (x2 triangles)
+constexpr int SIMPLIFY_BENCH_PATH_SEGMENTS = 2000;
+constexpr int SIMPLIFY_BENCH_CIRCLE_SEGMENTS = 64;
+
+// data followed by its simplified levels, up to LOD_LEVELS in all
+std::vector<MeshData> buildMeshLods(MeshData data);
+
+bool writeCookedMesh(const std::string &dstPath,
+                     const std::vector<MeshData> &levels);
+bool readCookedMesh(const std::string &srcPath, std::vector<MeshData> &levels);
+
+// Where the cooked copy of an OBJ lives ("cache/meshes/<hash>.mesh")
+std::string cookedMeshPath(const std::string &objPath,
+                           const std::string &texturePath);
+
+// LOD levels of an OBJ, from the cache when it is newer than the OBJ and
+// otherwise parsed, simplified and written back. Edits to only the .mtl go
+// unnoticed, like edits to textures a cooked texture came from.
+bool loadMeshLods(const std::string &filePath, const std::string &objFileName,
+                  const std::string &texturePath,
+                  std::vector<MeshData> &levels);
+
+// "--simplify [<dir> <file.obj>]" tool mode: simplifies the model (or a
+// generated dense tube) to ever fewer triangles and reports the error and
+// time of each step. Returns the process exit code.
+int runSimplifyTool(const std::vector<std::string> &args);
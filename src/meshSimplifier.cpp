@@ -0,0 +1,398 @@
+#include "meshSimplifier.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <glm/geometric.hpp>
+#include <glm/glm.hpp>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// FNV-1a, continuing from hash
+uint64_t hashBytes(const void *data, size_t size,
+                   uint64_t hash = 14695981039346656037ull) {
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+// Field by field, a Vertex may have padding
+struct VertexHash {
+  size_t operator()(const Vertex &v) const {
+    uint64_t hash = hashBytes(&v.position, sizeof v.position);
+    hash = hashBytes(&v.texCoord, sizeof v.texCoord, hash);
+    hash = hashBytes(&v.normal, sizeof v.normal, hash);
+    hash = hashBytes(&v.materialId, sizeof v.materialId, hash);
+    return size_t(hashBytes(v.color, sizeof v.color, hash));
+  }
+};
+struct VertexEqual {
+  bool operator()(const Vertex &a, const Vertex &b) const {
+    return a.position == b.position && a.texCoord == b.texCoord &&
+           a.normal == b.normal && a.materialId == b.materialId &&
+           std::memcmp(a.color, b.color, sizeof a.color) == 0;
+  }
+};
+struct PositionHash {
+  size_t operator()(const glm::vec3 &p) const {
+    return size_t(hashBytes(&p, sizeof p));
+  }
+};
+
+// Weighted sum of squared distances to a set of planes, as the upper
+// triangle of a symmetric 4x4 matrix, and the sum of the weights
+struct Quadric {
+  double xx = 0, xy = 0, xz = 0, xw = 0;
+  double yy = 0, yz = 0, yw = 0;
+  double zz = 0, zw = 0;
+  double ww = 0;
+  double weight = 0;
+
+  void addPlane(double nx, double ny, double nz, double d, double weight) {
+    xx += weight * nx * nx;
+    xy += weight * nx * ny;
+    xz += weight * nx * nz;
+    xw += weight * nx * d;
+    yy += weight * ny * ny;
+    yz += weight * ny * nz;
+    yw += weight * ny * d;
+    zz += weight * nz * nz;
+    zw += weight * nz * d;
+    ww += weight * d * d;
+    this->weight += weight;
+  }
+
+  Quadric &operator+=(const Quadric &o) {
+    xx += o.xx, xy += o.xy, xz += o.xz, xw += o.xw;
+    yy += o.yy, yz += o.yz, yw += o.yw;
+    zz += o.zz, zw += o.zw;
+    ww += o.ww;
+    weight += o.weight;
+    return *this;
+  }
+
+  // Mean squared distance, so it doesn't depend on triangle size or count
+  double error(const glm::vec3 &p) const {
+    double x = p.x, y = p.y, z = p.z;
+    double e = xx * x * x + yy * y * y + zz * z * z + ww +
+               2.0 * (xy * x * y + xz * x * z + yz * y * z + xw * x + yw * y +
+                      zw * z);
+    // Rounding can take it slightly below zero
+    return weight > 0.0 ? std::max(e, 0.0) / weight : 0.0;
+  }
+};
+
+struct Collapse {
+  double cost;
+  unsigned int from; // removed
+  unsigned int to;   // kept, with its attributes
+};
+
+} // namespace
+
+MeshData simplifyMesh(const MeshData &data, size_t targetTriangles,
+                      float maxError, SimplifyStats *stats) {
+  MeshData out;
+  out.materials = data.materials;
+  out.imagePath = data.imagePath;
+
+  // Weld identical vertices first: unindexed meshes come with a copy per
+  // triangle corner
+  std::vector<Vertex> vertices;
+  std::vector<unsigned int> indices;   // 3 per triangle
+  std::vector<int> triangleMaterials; // per triangle
+  std::unordered_map<Vertex, unsigned int, VertexHash, VertexEqual> welded;
+  auto addRange = [&](unsigned int first, unsigned int count, int material) {
+    for (unsigned int i = first; i + 3 <= first + count; i += 3) {
+      for (unsigned int corner = 0; corner < 3; ++corner) {
+        const Vertex &vertex =
+            data.vertices[data.indices.empty() ? i + corner
+                                               : data.indices[i + corner]];
+        auto inserted = welded.emplace(
+            vertex, static_cast<unsigned int>(vertices.size()));
+        if (inserted.second) {
+          vertices.push_back(vertex);
+        }
+        indices.push_back(inserted.first->second);
+      }
+      triangleMaterials.push_back(material);
+    }
+  };
+  if (data.submeshes.empty()) {
+    addRange(0,
+             static_cast<unsigned int>(data.indices.empty()
+                                           ? data.vertices.size()
+                                           : data.indices.size()),
+             0);
+  } else {
+    for (const Submesh &submesh : data.submeshes) {
+      addRange(submesh.first, submesh.count, submesh.material);
+    }
+  }
+  size_t trianglesIn = triangleMaterials.size();
+  size_t vertexCount = vertices.size();
+
+  // Vertices at one position form a group, the first of them names it.
+  // Copies that differ in more than their normal are a UV seam, a material
+  // border or a crease and lock the group. Copies that only differ by a
+  // soft normal (a flat shaded surface, like sweeps) are merged into the
+  // first one and get face normals back on output.
+  std::vector<unsigned int> groups(vertexCount);
+  std::vector<char> locked(vertexCount, 0);  // by group
+  std::vector<char> faceted(vertexCount, 0); // by group
+  {
+    float minDot = std::cos(glm::radians(SIMPLIFY_CREASE_ANGLE));
+    std::unordered_map<glm::vec3, unsigned int, PositionHash> firstAt;
+    for (unsigned int v = 0; v < vertexCount; ++v) {
+      auto inserted = firstAt.emplace(vertices[v].position, v);
+      unsigned int group = inserted.first->second;
+      groups[v] = group;
+      if (inserted.second)
+        continue;
+      const Vertex &a = vertices[group];
+      const Vertex &b = vertices[v];
+      bool soft = a.texCoord == b.texCoord && a.materialId == b.materialId &&
+                  std::memcmp(a.color, b.color, sizeof a.color) == 0 &&
+                  glm::dot(a.normal, b.normal) >=
+                      minDot * glm::length(a.normal) * glm::length(b.normal);
+      if (soft) {
+        faceted[group] = 1;
+      } else {
+        locked[group] = 1;
+      }
+    }
+    // A locked group keeps all of its copies
+    for (unsigned int &index : indices) {
+      unsigned int group = groups[index];
+      if (faceted[group] && !locked[group]) {
+        index = group;
+      }
+    }
+    for (unsigned int v = 0; v < vertexCount; ++v) {
+      faceted[v] = faceted[v] && !locked[v];
+    }
+  }
+
+  // Open borders (and non-manifold edges): edges between groups not shared
+  // by exactly two triangles
+  {
+    std::unordered_map<uint64_t, int> edgeUses;
+    for (size_t i = 0; i < indices.size(); i += 3) {
+      for (int e = 0; e < 3; ++e) {
+        uint64_t a = groups[indices[i + e]];
+        uint64_t b = groups[indices[i + (e + 1) % 3]];
+        ++edgeUses[std::min(a, b) << 32 | std::max(a, b)];
+      }
+    }
+    for (const auto &[edge, uses] : edgeUses) {
+      if (uses != 2) {
+        locked[edge >> 32] = 1;
+        locked[edge & 0xffffffffu] = 1;
+      }
+    }
+  }
+
+  // Plane quadrics of the triangles around each group, weighted by area
+  // (error() divides it back out)
+  std::vector<Quadric> quadrics(vertexCount);
+  AABB bounds;
+  for (const Vertex &vertex : vertices) {
+    bounds.expand(vertex.position);
+  }
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    const glm::vec3 &p0 = vertices[indices[i]].position;
+    const glm::vec3 &p1 = vertices[indices[i + 1]].position;
+    const glm::vec3 &p2 = vertices[indices[i + 2]].position;
+    glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+    double length = glm::length(normal);
+    if (length == 0.0)
+      continue;
+    double nx = normal.x / length, ny = normal.y / length,
+           nz = normal.z / length;
+    double d = -(nx * p0.x + ny * p0.y + nz * p0.z);
+    for (int corner = 0; corner < 3; ++corner) {
+      quadrics[groups[indices[i + corner]]].addPlane(nx, ny, nz, d,
+                                                     length * 0.5);
+    }
+  }
+
+  float radius = vertexCount > 0 ? glm::length(bounds.max - bounds.min) * 0.5f
+                                 : 0.f;
+  double maxCost = double(maxError) * radius * double(maxError) * radius;
+  double worstCost = 0.0;
+  int passes = 0;
+
+  std::vector<unsigned int> remap(vertexCount);
+  std::iota(remap.begin(), remap.end(), 0u);
+  std::vector<char> touched(vertexCount);
+  std::vector<unsigned int> adjacencyStart(vertexCount + 1);
+  std::vector<unsigned int> adjacency;
+  std::vector<Collapse> collapses;
+
+  // Would moving from onto to turn any of from's remaining triangles over
+  // (or squash it flat)?
+  auto flips = [&](unsigned int from, unsigned int to) {
+    for (unsigned int k = adjacencyStart[from]; k < adjacencyStart[from + 1];
+         ++k) {
+      const unsigned int *corners = &indices[adjacency[k] * 3];
+      glm::vec3 before[3], after[3];
+      bool removed = false;
+      for (int c = 0; c < 3; ++c) {
+        removed = removed || corners[c] == to;
+        before[c] = vertices[corners[c]].position;
+        after[c] = corners[c] == from ? vertices[to].position : before[c];
+      }
+      if (removed)
+        continue;
+      glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+      glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+      if (glm::dot(n0, n1) <= 0.25f * glm::length(n0) * glm::length(n1))
+        return true;
+    }
+    return false;
+  };
+
+  size_t live = trianglesIn;
+  while (live > targetTriangles) {
+    ++passes;
+
+    // Triangles around every vertex
+    std::fill(adjacencyStart.begin(), adjacencyStart.end(), 0u);
+    for (unsigned int index : indices) {
+      ++adjacencyStart[index + 1];
+    }
+    std::partial_sum(adjacencyStart.begin(), adjacencyStart.end(),
+                     adjacencyStart.begin());
+    adjacency.resize(indices.size());
+    {
+      std::vector<unsigned int> fill(adjacencyStart.begin(),
+                                     adjacencyStart.end() - 1);
+      for (size_t i = 0; i < indices.size(); ++i) {
+        adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+      }
+    }
+
+    // Every edge both ways, cheapest first
+    collapses.clear();
+    for (size_t i = 0; i < indices.size(); i += 3) {
+      for (int e = 0; e < 3; ++e) {
+        unsigned int a = indices[i + e];
+        unsigned int b = indices[i + (e + 1) % 3];
+        Quadric sum = quadrics[groups[a]];
+        sum += quadrics[groups[b]];
+        if (!locked[groups[a]]) {
+          collapses.push_back({sum.error(vertices[b].position), a, b});
+        }
+        if (!locked[groups[b]]) {
+          collapses.push_back({sum.error(vertices[a].position), b, a});
+        }
+      }
+    }
+    std::sort(collapses.begin(), collapses.end(),
+              [](const Collapse &a, const Collapse &b) {
+                return a.cost < b.cost;
+              });
+
+    // Each vertex takes part in at most one collapse per pass, so the
+    // neighbourhoods checked above stay valid
+    std::fill(touched.begin(), touched.end(), 0);
+    size_t removed = 0;
+    for (const Collapse &collapse : collapses) {
+      if (collapse.cost > maxCost || live - removed <= targetTriangles)
+        break;
+      if (touched[collapse.from] || touched[collapse.to] ||
+          flips(collapse.from, collapse.to))
+        continue;
+
+      for (unsigned int k = adjacencyStart[collapse.from];
+           k < adjacencyStart[collapse.from + 1]; ++k) {
+        const unsigned int *corners = &indices[adjacency[k] * 3];
+        for (int c = 0; c < 3; ++c) {
+          touched[corners[c]] = 1;
+        }
+        removed += corners[0] == collapse.to || corners[1] == collapse.to ||
+                   corners[2] == collapse.to;
+      }
+      remap[collapse.from] = collapse.to;
+      quadrics[groups[collapse.to]] += quadrics[groups[collapse.from]];
+      worstCost = std::max(worstCost, collapse.cost);
+    }
+    if (removed == 0)
+      break;
+
+    // Apply the pass and drop what collapsed to a line
+    size_t kept = 0;
+    for (size_t t = 0; t < live; ++t) {
+      unsigned int i0 = remap[indices[t * 3]];
+      unsigned int i1 = remap[indices[t * 3 + 1]];
+      unsigned int i2 = remap[indices[t * 3 + 2]];
+      if (i0 == i1 || i1 == i2 || i0 == i2)
+        continue;
+      indices[kept * 3] = i0;
+      indices[kept * 3 + 1] = i1;
+      indices[kept * 3 + 2] = i2;
+      triangleMaterials[kept] = triangleMaterials[t];
+      ++kept;
+    }
+    indices.resize(kept * 3);
+    triangleMaterials.resize(kept);
+    live = kept;
+  }
+
+  // Keep only referenced vertices, and cut submeshes where the material
+  // changes (triangles are still in the input's submesh order). Merged
+  // flat shaded corners take the normal of their new triangle, facing the
+  // same side as the input's.
+  std::vector<unsigned int> compacted(vertexCount, UINT_MAX);
+  std::unordered_map<Vertex, unsigned int, VertexHash, VertexEqual> facets;
+  for (size_t t = 0; t < live; ++t) {
+    if (out.submeshes.empty() ||
+        out.submeshes.back().material != triangleMaterials[t]) {
+      Submesh submesh;
+      submesh.material = triangleMaterials[t];
+      submesh.first = static_cast<unsigned int>(t * 3);
+      out.submeshes.push_back(submesh);
+    }
+    out.submeshes.back().count += 3;
+
+    const unsigned int *corners = &indices[t * 3];
+    const glm::vec3 &p0 = vertices[corners[0]].position;
+    glm::vec3 faceNormal = glm::cross(vertices[corners[1]].position - p0,
+                                      vertices[corners[2]].position - p0);
+    float faceLength = glm::length(faceNormal);
+    for (int c = 0; c < 3; ++c) {
+      if (faceted[corners[c]] && faceLength > 0.f) {
+        Vertex vertex = vertices[corners[c]];
+        float side = glm::dot(faceNormal, vertex.normal) < 0.f ? -1.f : 1.f;
+        vertex.normal = faceNormal * (side / faceLength);
+        auto inserted = facets.emplace(
+            vertex, static_cast<unsigned int>(out.vertices.size()));
+        if (inserted.second) {
+          out.vertices.push_back(vertex);
+        }
+        out.indices.push_back(inserted.first->second);
+        continue;
+      }
+      unsigned int &index = compacted[corners[c]];
+      if (index == UINT_MAX) {
+        index = static_cast<unsigned int>(out.vertices.size());
+        out.vertices.push_back(vertices[corners[c]]);
+      }
+      out.indices.push_back(index);
+    }
+  }
+
+  if (stats) {
+    stats->trianglesIn = trianglesIn;
+    stats->trianglesOut = live;
+    stats->error = radius > 0.f ? float(std::sqrt(worstCost)) / radius : 0.f;
+    stats->passes = passes;
+  }
+  return out;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "mesh.h"
+#include <cstddef>
+
+// Vertices at one position whose normals differ by less than this (in
+// degrees) are one flat shaded vertex, more is a crease and stays in place
+constexpr float SIMPLIFY_CREASE_ANGLE = 45.f;
+
+struct SimplifyStats {
+  size_t trianglesIn = 0;
+  size_t trianglesOut = 0;
+  float error = 0.f; // largest collapse error, as a fraction of the radius
+  int passes = 0;
+};
+
+// Quadric error metric simplification (Garland & Heckbert) by half-edge
+// collapses: a vertex is merged into one of its neighbours, which keeps its
+// own attributes, so no UV or normal is ever interpolated. Vertices on UV
+// seams, normal creases, material borders and open borders are locked in
+// place; flat shaded triangles keep flat normals. Collapses stop at
+// targetTriangles or once the next one would move the surface further than
+// maxError times the bounding radius (as the area-weighted RMS distance to
+// the planes of the merged triangles).
+// Materials, image and submesh order of data are kept; the result is always
+// indexed and holds only the vertices still referenced.
+MeshData simplifyMesh(const MeshData &data, size_t targetTriangles,
+                      float maxError, SimplifyStats *stats = nullptr);
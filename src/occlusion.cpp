@@ -0,0 +1,393 @@
+#include "occlusion.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Corner i of a box has x from bit 0, y from bit 1, z from bit 2. Faces are
+// wound counter-clockwise seen from outside.
+constexpr int BOX_FACES[6][4] = {
+    {0, 4, 6, 2}, // -x
+    {1, 3, 7, 5}, // +x
+    {0, 1, 5, 4}, // -y
+    {2, 6, 7, 3}, // +y
+    {0, 2, 3, 1}, // -z
+    {4, 5, 7, 6}, // +z
+};
+
+glm::vec3 boxCorner(const AABB &box, int i) {
+  return glm::vec3(i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y,
+                   i & 4 ? box.max.z : box.min.z);
+}
+
+// Distance to the near plane in clip space (z >= -w inside)
+float nearDistance(const glm::vec4 &p) { return p.z + p.w; }
+
+glm::vec3 toScreen(const glm::vec4 &clip) {
+  glm::vec3 ndc = glm::vec3(clip) / clip.w;
+  return glm::vec3((ndc.x * 0.5f + 0.5f) * OCCLUSION_WIDTH,
+                   (ndc.y * 0.5f + 0.5f) * OCCLUSION_HEIGHT,
+                   ndc.z * 0.5f + 0.5f);
+}
+
+// Twice the signed area of triangle abc in screen space
+float signedArea(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+  return (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+}
+
+// Counter-clockwise convex hull (Andrew's monotone chain), collinear points
+// dropped
+std::vector<glm::vec2> convexHull(std::vector<glm::vec2> points) {
+  std::sort(points.begin(), points.end(),
+            [](const glm::vec2 &a, const glm::vec2 &b) {
+              return a.x < b.x || (a.x == b.x && a.y < b.y);
+            });
+  if (points.size() < 3)
+    return {};
+
+  auto cross = [](const glm::vec2 &o, const glm::vec2 &a, const glm::vec2 &b) {
+    return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+  };
+  std::vector<glm::vec2> hull(points.size() * 2);
+  size_t k = 0;
+  for (size_t i = 0; i < points.size(); ++i) {
+    while (k >= 2 && cross(hull[k - 2], hull[k - 1], points[i]) <= 0.f)
+      --k;
+    hull[k++] = points[i];
+  }
+  for (size_t i = points.size() - 1, lower = k + 1; i-- > 0;) {
+    while (k >= lower && cross(hull[k - 2], hull[k - 1], points[i]) <= 0.f)
+      --k;
+    hull[k++] = points[i];
+  }
+  hull.resize(k - 1);
+  return hull;
+}
+
+} // namespace
+
+// The Hi-Z lookup maps pixels to texels with shifts
+static_assert((OCCLUSION_WIDTH & (OCCLUSION_WIDTH - 1)) == 0 &&
+                  (OCCLUSION_HEIGHT & (OCCLUSION_HEIGHT - 1)) == 0,
+              "occlusion buffer size must be a power of two");
+
+OcclusionCuller::OcclusionCuller(size_t threads) : workers(threads) {
+  int width = OCCLUSION_WIDTH;
+  int height = OCCLUSION_HEIGHT;
+  while (true) {
+    levelSizes.emplace_back(width, height);
+    levels.emplace_back(size_t(width) * height, 1.f);
+    if (width == 1 && height == 1)
+      break;
+    width = std::max(1, width / 2);
+    height = std::max(1, height / 2);
+  }
+}
+
+void OcclusionCuller::begin(const glm::mat4 &vp,
+                            const std::vector<OccluderBox> &occluders) {
+  started = std::chrono::steady_clock::now();
+  viewProjection = vp;
+  screenOccluders.clear();
+  stats.occluders = 0;
+  stats.faces = 0;
+
+  // Project and near-clip on the calling thread; it is a handful of
+  // vertices per occluder, the per-pixel work happens in the bands
+  std::vector<glm::vec2> silhouette;
+  for (const auto &occluder : occluders) {
+    if (occluder.box.isEmpty())
+      continue;
+
+    glm::mat4 mvp = vp * occluder.model;
+    glm::vec4 clip[8];
+    for (int i = 0; i < 8; ++i) {
+      clip[i] = mvp * glm::vec4(boxCorner(occluder.box, i), 1.f);
+    }
+    // Mirroring transforms flip the winding of the front faces
+    bool mirrored = glm::determinant(glm::mat3(occluder.model)) < 0.f;
+
+    ScreenOccluder screen;
+    silhouette.clear();
+    for (const auto &face : BOX_FACES) {
+      // Clip against the near plane: a quad becomes at most a pentagon
+      glm::vec3 polygon[5];
+      int count = 0;
+      for (int i = 0; i < 4; ++i) {
+        const glm::vec4 &p = clip[face[i]];
+        const glm::vec4 &q = clip[face[(i + 1) % 4]];
+        float dp = nearDistance(p);
+        float dq = nearDistance(q);
+        if (dp >= 0.f)
+          polygon[count++] = toScreen(p);
+        if ((dp >= 0.f) != (dq >= 0.f))
+          polygon[count++] = toScreen(p + (q - p) * (dp / (dp - dq)));
+      }
+      if (count < 3)
+        continue;
+
+      // Back faces are always hidden by the front of the same box. The
+      // widest fan triangle gives the most stable depth plane.
+      float area = 0.f;
+      int widest = 1;
+      for (int i = 1; i + 1 < count; ++i) {
+        float fan = signedArea(polygon[0], polygon[i], polygon[i + 1]);
+        area += fan;
+        if (std::abs(fan) >
+            std::abs(signedArea(polygon[0], polygon[widest],
+                                polygon[widest + 1])))
+          widest = i;
+      }
+      if ((mirrored ? -area : area) <= 0.f)
+        continue;
+
+      const glm::vec3 &v0 = polygon[0];
+      const glm::vec3 &v1 = polygon[widest];
+      const glm::vec3 &v2 = polygon[widest + 1];
+      float planeArea = signedArea(v0, v1, v2);
+      if (std::abs(planeArea) < 1e-6f || screen.planeCount == 3)
+        continue;
+      // Depth is linear in screen space: z(x, y) = zx * x + zy * y + zc
+      int plane = screen.planeCount++;
+      screen.zx[plane] = ((v1.z - v0.z) * (v2.y - v0.y) -
+                          (v2.z - v0.z) * (v1.y - v0.y)) /
+                         planeArea;
+      screen.zy[plane] = ((v2.z - v0.z) * (v1.x - v0.x) -
+                          (v1.z - v0.z) * (v2.x - v0.x)) /
+                         planeArea;
+      screen.zc[plane] =
+          v0.z - screen.zx[plane] * v0.x - screen.zy[plane] * v0.y;
+
+      for (int i = 0; i < count; ++i) {
+        silhouette.emplace_back(polygon[i].x, polygon[i].y);
+      }
+    }
+    if (screen.planeCount == 0)
+      continue;
+
+    // The front faces of a box cover its convex silhouette exactly, so one
+    // polygon without inner edges avoids cracks between faces
+    std::vector<glm::vec2> hull = convexHull(silhouette);
+    if (hull.size() < 3 || hull.size() > MAX_EDGES)
+      continue;
+
+    // Edge functions, pulled in by half a pixel so only fully covered
+    // pixels pass: a partly covered one must not hide whatever shows
+    // through the rest of it
+    glm::vec2 hullMin(std::numeric_limits<float>::max());
+    glm::vec2 hullMax(std::numeric_limits<float>::lowest());
+    screen.edgeCount = static_cast<int>(hull.size());
+    for (int i = 0; i < screen.edgeCount; ++i) {
+      const glm::vec2 &p = hull[i];
+      const glm::vec2 &q = hull[(i + 1) % screen.edgeCount];
+      screen.a[i] = p.y - q.y;
+      screen.b[i] = q.x - p.x;
+      screen.c[i] = -(screen.a[i] * p.x + screen.b[i] * p.y) -
+                    0.5f * (std::abs(screen.a[i]) + std::abs(screen.b[i]));
+      hullMin = glm::min(hullMin, p);
+      hullMax = glm::max(hullMax, p);
+    }
+
+    // Pixels entirely inside the bounding rectangle
+    screen.minX = std::max(0, int(std::ceil(hullMin.x)));
+    screen.maxX = std::min(OCCLUSION_WIDTH - 1, int(std::floor(hullMax.x)) - 1);
+    screen.minY = std::max(0, int(std::ceil(hullMin.y)));
+    screen.maxY =
+        std::min(OCCLUSION_HEIGHT - 1, int(std::floor(hullMax.y)) - 1);
+    if (screen.minX > screen.maxX || screen.minY > screen.maxY)
+      continue;
+
+    ++stats.occluders;
+    stats.faces += screen.planeCount;
+    screenOccluders.push_back(screen);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    bandsLeft = OCCLUSION_BANDS;
+  }
+  for (int band = 0; band < OCCLUSION_BANDS; ++band) {
+    workers.submit([this, band] {
+      rasterizeBand(band);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        --bandsLeft;
+      }
+      bandsDone.notify_one();
+    });
+  }
+}
+
+void OcclusionCuller::finish() {
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    bandsDone.wait(lock, [this] { return bandsLeft == 0; });
+  }
+  buildHiZ();
+
+  stats.rasterMs = std::chrono::duration<float, std::milli>(
+                       std::chrono::steady_clock::now() - started)
+                       .count();
+}
+
+void OcclusionCuller::rasterizeBand(int band) {
+  int rowsPerBand = (OCCLUSION_HEIGHT + OCCLUSION_BANDS - 1) / OCCLUSION_BANDS;
+  int rowBegin = band * rowsPerBand;
+  int rowEnd = std::min(OCCLUSION_HEIGHT, rowBegin + rowsPerBand);
+  if (rowBegin >= rowEnd)
+    return;
+
+  std::fill(levels[0].begin() + size_t(rowBegin) * OCCLUSION_WIDTH,
+            levels[0].begin() + size_t(rowEnd) * OCCLUSION_WIDTH, 1.f);
+
+  for (const auto &occluder : screenOccluders) {
+    rasterize(occluder, rowBegin, rowEnd);
+  }
+}
+
+void OcclusionCuller::rasterize(const ScreenOccluder &occluder, int rowBegin,
+                                int rowEnd) {
+  int minY = std::max(rowBegin, occluder.minY);
+  int maxY = std::min(rowEnd - 1, occluder.maxY);
+
+  float *depth = levels[0].data();
+  for (int y = minY; y <= maxY; ++y) {
+    float py = y + 0.5f;
+    float *row = depth + size_t(y) * OCCLUSION_WIDTH;
+#if defined(__SSE2__)
+    // Four pixels per step; the width is a multiple of 4 and pixels outside
+    // the bounding rectangle fail the edge tests anyway
+    __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    __m128 edgeRow[MAX_EDGES], edgeStep[MAX_EDGES];
+    for (int i = 0; i < occluder.edgeCount; ++i) {
+      edgeRow[i] = _mm_set1_ps(occluder.b[i] * py + occluder.c[i]);
+      edgeStep[i] = _mm_set1_ps(occluder.a[i]);
+    }
+    __m128 zRow[3], zStep[3];
+    for (int i = 0; i < occluder.planeCount; ++i) {
+      zRow[i] = _mm_set1_ps(occluder.zy[i] * py + occluder.zc[i]);
+      zStep[i] = _mm_set1_ps(occluder.zx[i]);
+    }
+    __m128 zero = _mm_setzero_ps();
+    for (int x = occluder.minX & ~3; x <= occluder.maxX; x += 4) {
+      __m128 px = _mm_add_ps(_mm_set1_ps(float(x)), laneOffsets);
+      __m128 inside = _mm_cmpeq_ps(zero, zero);
+      for (int i = 0; i < occluder.edgeCount; ++i) {
+        inside = _mm_and_ps(
+            inside, _mm_cmpge_ps(
+                        _mm_add_ps(_mm_mul_ps(edgeStep[i], px), edgeRow[i]),
+                        zero));
+      }
+      if (_mm_movemask_ps(inside) == 0)
+        continue;
+      __m128 z = _mm_add_ps(_mm_mul_ps(zStep[0], px), zRow[0]);
+      for (int i = 1; i < occluder.planeCount; ++i) {
+        z = _mm_max_ps(z, _mm_add_ps(_mm_mul_ps(zStep[i], px), zRow[i]));
+      }
+      __m128 old = _mm_loadu_ps(row + x);
+      __m128 nearer = _mm_min_ps(old, z);
+      _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer),
+                                       _mm_andnot_ps(inside, old)));
+    }
+#else
+    for (int x = occluder.minX; x <= occluder.maxX; ++x) {
+      float px = x + 0.5f;
+      bool inside = true;
+      for (int i = 0; i < occluder.edgeCount && inside; ++i) {
+        inside = occluder.a[i] * px + occluder.b[i] * py + occluder.c[i] >= 0.f;
+      }
+      if (!inside)
+        continue;
+      float z = occluder.zx[0] * px + occluder.zy[0] * py + occluder.zc[0];
+      for (int i = 1; i < occluder.planeCount; ++i) {
+        z = std::max(z, occluder.zx[i] * px + occluder.zy[i] * py +
+                            occluder.zc[i]);
+      }
+      row[x] = std::min(row[x], z);
+    }
+#endif
+  }
+}
+
+void OcclusionCuller::buildHiZ() {
+  for (size_t level = 1; level < levels.size(); ++level) {
+    const std::vector<float> &src = levels[level - 1];
+    std::vector<float> &dst = levels[level];
+    glm::ivec2 srcSize = levelSizes[level - 1];
+    glm::ivec2 dstSize = levelSizes[level];
+    for (int y = 0; y < dstSize.y; ++y) {
+      int y0 = std::min(y * 2, srcSize.y - 1);
+      int y1 = std::min(y * 2 + 1, srcSize.y - 1);
+      for (int x = 0; x < dstSize.x; ++x) {
+        int x0 = std::min(x * 2, srcSize.x - 1);
+        int x1 = std::min(x * 2 + 1, srcSize.x - 1);
+        // Farthest depth: anything nearer than this is hidden everywhere
+        dst[size_t(y) * dstSize.x + x] =
+            std::max(std::max(src[size_t(y0) * srcSize.x + x0],
+                              src[size_t(y0) * srcSize.x + x1]),
+                     std::max(src[size_t(y1) * srcSize.x + x0],
+                              src[size_t(y1) * srcSize.x + x1]));
+      }
+    }
+  }
+}
+
+bool OcclusionCuller::isVisible(const AABB &box) {
+  ++stats.tested;
+  if (box.isEmpty())
+    return true;
+
+  glm::vec2 screenMin(std::numeric_limits<float>::max());
+  glm::vec2 screenMax(std::numeric_limits<float>::lowest());
+  float minDepth = 1.f;
+  for (int i = 0; i < 8; ++i) {
+    glm::vec4 clip = viewProjection * glm::vec4(boxCorner(box, i), 1.f);
+    // Crossing the near plane: the box is right in front of the camera
+    if (nearDistance(clip) <= 0.f)
+      return true;
+    glm::vec3 screen = toScreen(clip);
+    screenMin = glm::min(screenMin, glm::vec2(screen.x, screen.y));
+    screenMax = glm::max(screenMax, glm::vec2(screen.x, screen.y));
+    minDepth = std::min(minDepth, screen.z);
+  }
+
+  // Covered pixels; off-screen boxes are the frustum culler's business
+  int x0 = std::max(0, int(std::floor(screenMin.x)));
+  int y0 = std::max(0, int(std::floor(screenMin.y)));
+  int x1 = std::min(OCCLUSION_WIDTH - 1, int(std::floor(screenMax.x)));
+  int y1 = std::min(OCCLUSION_HEIGHT - 1, int(std::floor(screenMax.y)));
+  if (x0 > x1 || y0 > y1)
+    return true;
+
+  // Coarsest level where the rectangle touches at most 2x2 texels
+  int level = 0;
+  while (level + 1 < getLevelCount() &&
+         ((x1 >> level) - (x0 >> level) > 1 ||
+          (y1 >> level) - (y0 >> level) > 1)) {
+    ++level;
+  }
+
+  const std::vector<float> &hiZ = levels[level];
+  glm::ivec2 size = levelSizes[level];
+  for (int y = y0 >> level; y <= std::min(y1 >> level, size.y - 1); ++y) {
+    for (int x = x0 >> level; x <= std::min(x1 >> level, size.x - 1); ++x) {
+      if (hiZ[size_t(y) * size.x + x] >= minDepth)
+        return true;
+    }
+  }
+
+  ++stats.occluded;
+  return false;
+}
+
+OcclusionStats OcclusionCuller::takeStats() {
+  OcclusionStats result = stats;
+  stats.tested = 0;
+  stats.occluded = 0;
+  return result;
+}
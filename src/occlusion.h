@@ -0,0 +1,122 @@
+#pragma once
+
+#include "math/bounds.h"
+#include "threadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <glm/glm.hpp>
+#include <mutex>
+#include <vector>
+
+// Software depth buffer size; tiny on purpose, only big occluders matter
+constexpr int OCCLUSION_WIDTH = 256;
+constexpr int OCCLUSION_HEIGHT = 128;
+// Horizontal bands rasterized in parallel, one job each
+constexpr int OCCLUSION_BANDS = 4;
+// Largest occluders per frame, ranked by bounding radius over distance
+constexpr size_t OCCLUSION_MAX_OCCLUDERS = 128;
+// Smaller occluders than this (radius / distance) hide next to nothing
+constexpr float OCCLUSION_MIN_SIZE = 0.02f;
+
+// Solid box (in model space) known to lie inside a mesh, e.g. the box
+// inscribed in a cylinder. Never use plain bounds: they overestimate.
+struct OccluderBox {
+  glm::mat4 model;
+  AABB box;
+};
+
+// Box inscribed in the unit cylinder of Mesh::buildPrimitive
+inline AABB unitCylinderOccluder(int sides) {
+  // Inner radius of the polygon, then the square inside that circle
+  float half = std::cos(glm::radians(180.f / sides)) / std::sqrt(2.f);
+  AABB box;
+  box.min = glm::vec3(-half, 0.f, -half);
+  box.max = glm::vec3(half, 1.f, half);
+  return box;
+}
+
+// The unit cylinder is an open tube: a camera that can look in one end and
+// out the other must not use it as an occluder. camera is in the cylinder's
+// own space. Any line through both end discs stays within radius 1 + 2d at
+// axial distance d past an end, so farther out than that is safe.
+inline bool canSeeThroughUnitCylinder(const glm::vec3 &camera) {
+  float pastEnd = std::max({0.f, -camera.y, camera.y - 1.f});
+  float radial = std::sqrt(camera.x * camera.x + camera.z * camera.z);
+  return radial <= 1.f + 2.f * pastEnd;
+}
+
+struct OcclusionStats {
+  size_t occluders = 0; // boxes rasterized (in front of the near plane)
+  size_t faces = 0;     // front faces whose depth planes were rasterized
+  size_t tested = 0;
+  size_t occluded = 0;
+  float rasterMs = 0.f; // begin() to the end of finish()
+};
+
+// CPU occlusion culling: occluder boxes are rasterized into a low resolution
+// depth buffer on worker threads, reduced into a max-depth (Hi-Z) pyramid,
+// and occludee boxes are tested against the coarsest level that covers them
+// with a few texels. Touches no GL state, so it can run anywhere.
+class OcclusionCuller {
+public:
+  explicit OcclusionCuller(size_t threads = OCCLUSION_BANDS);
+
+  // Prevent copying/moving (workers hold a pointer to this)
+  OcclusionCuller(const OcclusionCuller &) = delete;
+  OcclusionCuller &operator=(const OcclusionCuller &) = delete;
+  OcclusionCuller(OcclusionCuller &&) = delete;
+  OcclusionCuller &operator=(OcclusionCuller &&) = delete;
+
+  // Start rasterizing occluders as seen through viewProjection. Returns
+  // immediately; the caller can do other work until finish().
+  void begin(const glm::mat4 &viewProjection,
+             const std::vector<OccluderBox> &occluders);
+  // Wait for the rasterizer and build the Hi-Z pyramid
+  void finish();
+
+  // False only if box is certainly hidden behind the occluders. Call
+  // between finish() and the next begin().
+  bool isVisible(const AABB &box);
+
+  // Depth in [0, 1] (1 = nothing drawn), row 0 at the bottom of the screen
+  const std::vector<float> &getDepth() const { return levels[0]; }
+  int getLevelCount() const { return static_cast<int>(levels.size()); }
+  // Resets the tested/occluded counters
+  OcclusionStats takeStats();
+
+private:
+  // One occluder as seen on screen: its convex silhouette as edge functions
+  // a * x + b * y + c >= 0, and the depth planes of its front faces (the
+  // depth at a pixel is the farthest of them, where the ray enters the box)
+  static constexpr int MAX_EDGES = 16;
+  struct ScreenOccluder {
+    int minX, maxX, minY, maxY; // pixels touched, inclusive
+    int edgeCount = 0;
+    float a[MAX_EDGES], b[MAX_EDGES], c[MAX_EDGES];
+    int planeCount = 0;
+    float zx[3], zy[3], zc[3];
+  };
+
+  void rasterizeBand(int band);
+  void rasterize(const ScreenOccluder &occluder, int rowBegin, int rowEnd);
+  void buildHiZ();
+
+  glm::mat4 viewProjection{1.f};
+  std::vector<ScreenOccluder> screenOccluders;
+  // levels[0] is the full resolution depth, each next level halves both
+  // dimensions and keeps the farthest depth of its 2x2 block
+  std::vector<std::vector<float>> levels;
+  std::vector<glm::ivec2> levelSizes;
+
+  std::mutex mutex;
+  std::condition_variable bandsDone;
+  int bandsLeft = 0;
+  std::chrono::steady_clock::time_point started;
+  OcclusionStats stats;
+
+  // Declared last so the workers are joined before the state above goes
+  ThreadPool workers;
+};
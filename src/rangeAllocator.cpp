@@ -0,0 +1,274 @@
+#include "rangeAllocator.h"
+#include <algorithm>
+
+namespace {
+int floorLog2(uint32_t value) { return 31 - __builtin_clz(value); }
+int lowestBit(uint32_t value) { return __builtin_ctz(value); }
+} // namespace
+
+RangeAllocator::RangeAllocator(uint32_t capacity) {
+  for (auto &heads : freeHeads) {
+    std::fill(std::begin(heads), std::end(heads), INVALID_RANGE);
+  }
+  grow(capacity);
+}
+
+void RangeAllocator::mapping(uint32_t size, int &fl, int &sl) {
+  // Sizes below SL_COUNT get exact classes in the first row
+  if (size < SL_COUNT) {
+    fl = 0;
+    sl = int(size);
+    return;
+  }
+  int log = floorLog2(size);
+  fl = log - SL_BITS + 1;
+  sl = int(size >> (log - SL_BITS)) - SL_COUNT;
+}
+
+uint32_t RangeAllocator::newBlock() {
+  if (!unusedBlocks.empty()) {
+    uint32_t block = unusedBlocks.back();
+    unusedBlocks.pop_back();
+    blocks[block] = Block();
+    return block;
+  }
+  blocks.emplace_back();
+  return uint32_t(blocks.size() - 1);
+}
+
+void RangeAllocator::releaseBlock(uint32_t block) {
+  unusedBlocks.push_back(block);
+}
+
+void RangeAllocator::insertFree(uint32_t block) {
+  Block &b = blocks[block];
+  int fl, sl;
+  mapping(b.size, fl, sl);
+  b.free = true;
+  b.prevFree = INVALID_RANGE;
+  b.nextFree = freeHeads[fl][sl];
+  if (b.nextFree != INVALID_RANGE) {
+    blocks[b.nextFree].prevFree = block;
+  }
+  freeHeads[fl][sl] = block;
+  flBitmap |= 1u << fl;
+  slBitmaps[fl] |= 1u << sl;
+}
+
+void RangeAllocator::removeFree(uint32_t block) {
+  Block &b = blocks[block];
+  int fl, sl;
+  mapping(b.size, fl, sl);
+  if (b.prevFree != INVALID_RANGE) {
+    blocks[b.prevFree].nextFree = b.nextFree;
+  } else {
+    freeHeads[fl][sl] = b.nextFree;
+  }
+  if (b.nextFree != INVALID_RANGE) {
+    blocks[b.nextFree].prevFree = b.prevFree;
+  }
+  if (freeHeads[fl][sl] == INVALID_RANGE) {
+    slBitmaps[fl] &= ~(1u << sl);
+    if (!slBitmaps[fl]) {
+      flBitmap &= ~(1u << fl);
+    }
+  }
+  b.free = false;
+}
+
+uint32_t RangeAllocator::findFree(uint32_t size) const {
+  // Round up to the next class so any block found there is big enough
+  uint32_t rounded = size;
+  if (size >= SL_COUNT) {
+    uint32_t step = (1u << (floorLog2(size) - SL_BITS)) - 1;
+    rounded = size > UINT32_MAX - step ? UINT32_MAX : size + step;
+  }
+  int fl, sl;
+  mapping(rounded, fl, sl);
+
+  uint32_t slMap = slBitmaps[fl] & (~0u << sl);
+  if (!slMap) {
+    uint32_t flMap = fl + 1 < FL_COUNT ? flBitmap & (~0u << (fl + 1)) : 0;
+    if (flMap) {
+      fl = lowestBit(flMap);
+      slMap = slBitmaps[fl];
+    }
+  }
+  if (slMap) {
+    return freeHeads[fl][lowestBit(slMap)];
+  }
+
+  // Nothing a class up; a block in the size's own class may still fit
+  mapping(size, fl, sl);
+  for (uint32_t block = freeHeads[fl][sl]; block != INVALID_RANGE;
+       block = blocks[block].nextFree) {
+    if (blocks[block].size >= size) {
+      return block;
+    }
+  }
+  return INVALID_RANGE;
+}
+
+uint32_t RangeAllocator::allocate(uint32_t size) {
+  if (size == 0)
+    return INVALID_RANGE;
+  uint32_t block = findFree(size);
+  if (block == INVALID_RANGE)
+    return INVALID_RANGE;
+  removeFree(block);
+
+  // Give the rest back as a block of its own
+  if (blocks[block].size > size) {
+    uint32_t rest = newBlock();
+    Block &b = blocks[block];
+    Block &r = blocks[rest];
+    r.offset = b.offset + size;
+    r.size = b.size - size;
+    r.prevPhysical = block;
+    r.nextPhysical = b.nextPhysical;
+    if (b.nextPhysical != INVALID_RANGE) {
+      blocks[b.nextPhysical].prevPhysical = rest;
+    } else {
+      lastBlock = rest;
+    }
+    b.nextPhysical = rest;
+    b.size = size;
+    insertFree(rest);
+  }
+
+  used += size;
+  ++allocations;
+  return block;
+}
+
+void RangeAllocator::free(uint32_t handle) {
+  if (handle == INVALID_RANGE)
+    return;
+  used -= blocks[handle].size;
+  --allocations;
+
+  uint32_t next = blocks[handle].nextPhysical;
+  if (next != INVALID_RANGE && blocks[next].free) {
+    removeFree(next);
+    Block &b = blocks[handle];
+    b.size += blocks[next].size;
+    b.nextPhysical = blocks[next].nextPhysical;
+    if (b.nextPhysical != INVALID_RANGE) {
+      blocks[b.nextPhysical].prevPhysical = handle;
+    } else {
+      lastBlock = handle;
+    }
+    releaseBlock(next);
+  }
+
+  uint32_t prev = blocks[handle].prevPhysical;
+  if (prev != INVALID_RANGE && blocks[prev].free) {
+    removeFree(prev);
+    Block &p = blocks[prev];
+    p.size += blocks[handle].size;
+    p.nextPhysical = blocks[handle].nextPhysical;
+    if (p.nextPhysical != INVALID_RANGE) {
+      blocks[p.nextPhysical].prevPhysical = prev;
+    } else {
+      lastBlock = prev;
+    }
+    releaseBlock(handle);
+    handle = prev;
+  }
+
+  insertFree(handle);
+}
+
+void RangeAllocator::grow(uint32_t newCapacity) {
+  if (newCapacity <= capacity)
+    return;
+  uint32_t extra = newCapacity - capacity;
+
+  if (lastBlock != INVALID_RANGE && blocks[lastBlock].free) {
+    removeFree(lastBlock);
+    blocks[lastBlock].size += extra;
+    insertFree(lastBlock);
+  } else {
+    uint32_t block = newBlock();
+    blocks[block].offset = capacity;
+    blocks[block].size = extra;
+    blocks[block].prevPhysical = lastBlock;
+    if (lastBlock != INVALID_RANGE) {
+      blocks[lastBlock].nextPhysical = block;
+    } else {
+      firstBlock = block;
+    }
+    lastBlock = block;
+    insertFree(block);
+  }
+  capacity = newCapacity;
+}
+
+void RangeAllocator::compact(std::vector<Move> &moves) {
+  moves.clear();
+
+  // Walk in address order, dropping free blocks and packing live ones
+  uint32_t cursor = 0;
+  uint32_t prevLive = INVALID_RANGE;
+  uint32_t block = firstBlock;
+  firstBlock = INVALID_RANGE;
+  while (block != INVALID_RANGE) {
+    uint32_t next = blocks[block].nextPhysical;
+    Block &b = blocks[block];
+    if (b.free) {
+      removeFree(block);
+      releaseBlock(block);
+    } else {
+      moves.push_back({block, b.offset, cursor, b.size});
+      b.offset = cursor;
+      cursor += b.size;
+      b.prevPhysical = prevLive;
+      if (prevLive != INVALID_RANGE) {
+        blocks[prevLive].nextPhysical = block;
+      } else {
+        firstBlock = block;
+      }
+      prevLive = block;
+    }
+    block = next;
+  }
+  if (prevLive != INVALID_RANGE) {
+    blocks[prevLive].nextPhysical = INVALID_RANGE;
+  }
+  lastBlock = prevLive;
+
+  // All the free space in one block at the end
+  if (cursor < capacity) {
+    uint32_t tail = newBlock();
+    blocks[tail].offset = cursor;
+    blocks[tail].size = capacity - cursor;
+    blocks[tail].prevPhysical = prevLive;
+    if (prevLive != INVALID_RANGE) {
+      blocks[prevLive].nextPhysical = tail;
+    } else {
+      firstBlock = tail;
+    }
+    lastBlock = tail;
+    insertFree(tail);
+  }
+}
+
+RangeAllocatorStats RangeAllocator::getStats() const {
+  RangeAllocatorStats stats;
+  stats.capacity = capacity;
+  stats.used = used;
+  stats.allocations = allocations;
+  for (uint32_t block = firstBlock; block != INVALID_RANGE;
+       block = blocks[block].nextPhysical) {
+    if (blocks[block].free) {
+      ++stats.freeBlocks;
+      stats.largestFree = std::max<size_t>(stats.largestFree,
+                                           blocks[block].size);
+    }
+  }
+  size_t totalFree = capacity - used;
+  if (totalFree > 0) {
+    stats.fragmentation = 1.f - float(stats.largestFree) / float(totalFree);
+  }
+  return stats;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+constexpr uint32_t INVALID_RANGE = UINT32_MAX;
+
+struct RangeAllocatorStats {
+  size_t capacity = 0; // in units
+  size_t used = 0;
+  size_t allocations = 0;
+  size_t freeBlocks = 0;
+  size_t largestFree = 0;
+  // 1 - largest free block / all free space: 0 is one hole, near 1 means
+  // the free space is shattered into many small ones
+  float fragmentation = 0.f;
+};
+
+// Two-level segregated fit (TLSF) allocator over the units [0, capacity).
+// It only keeps the books, the caller owns the memory. Free blocks sit in
+// one list per size class (power of two, split 16 ways) found through two
+// bitmaps, and a freed block merges with its free neighbours right away, so
+// allocate() and free() are O(1).
+class RangeAllocator {
+public:
+  explicit RangeAllocator(uint32_t capacity = 0);
+
+  // Handle of a new block of size units, INVALID_RANGE if nothing fits
+  uint32_t allocate(uint32_t size);
+  void free(uint32_t handle);
+  // Add free space at the end
+  void grow(uint32_t newCapacity);
+
+  // One live block before and after compact()
+  struct Move {
+    uint32_t handle;
+    uint32_t from;
+    uint32_t to;
+    uint32_t size;
+  };
+  // Slide every block down so the free space becomes one block at the end.
+  // Handles stay valid; moves gets every live block in address order.
+  void compact(std::vector<Move> &moves);
+
+  uint32_t getOffset(uint32_t handle) const { return blocks[handle].offset; }
+  uint32_t getSize(uint32_t handle) const { return blocks[handle].size; }
+  uint32_t getCapacity() const { return capacity; }
+  RangeAllocatorStats getStats() const;
+
+private:
+  static constexpr int SL_BITS = 4;
+  static constexpr int SL_COUNT = 1 << SL_BITS;
+  static constexpr int FL_COUNT = 32;
+
+  struct Block {
+    uint32_t offset = 0;
+    uint32_t size = 0;
+    uint32_t prevPhysical = INVALID_RANGE;
+    uint32_t nextPhysical = INVALID_RANGE;
+    uint32_t prevFree = INVALID_RANGE;
+    uint32_t nextFree = INVALID_RANGE;
+    bool free = false;
+  };
+
+  // Size class holding blocks of this size
+  static void mapping(uint32_t size, int &fl, int &sl);
+  uint32_t newBlock();
+  void releaseBlock(uint32_t block);
+  void insertFree(uint32_t block);
+  void removeFree(uint32_t block);
+  uint32_t findFree(uint32_t size) const;
+
+  std::vector<Block> blocks;
+  std::vector<uint32_t> unusedBlocks; // recycled slots of blocks
+  uint32_t freeHeads[FL_COUNT][SL_COUNT];
+  uint32_t flBitmap = 0;
+  uint32_t slBitmaps[FL_COUNT] = {};
+  uint32_t firstBlock = INVALID_RANGE; // in address order
+  uint32_t lastBlock = INVALID_RANGE;
+  uint32_t capacity = 0;
+  size_t used = 0;
+  size_t allocations = 0;
+};
@@ -0,0 +1,284 @@
+#include "renderQueue.h"
+#include "../include/glad/glad.h"
+#include "materialTable.h"
+#include "mesh.h"
+#include <algorithm>
+
+// What binding everything per draw would cost: image/specular/diffuse
+// textures, the VAO, and model/color/shininess uniforms
+constexpr size_t NAIVE_TEXTURE_BINDS = 3;
+constexpr size_t NAIVE_UNIFORM_UPDATES = 3;
+
+void RenderQueue::clear() {
+  items.clear();
+  keys.clear();
+  textureSets.clear();
+}
+
+uint32_t RenderQueue::textureSetId(const Texture *image,
+                                   const Material &material) {
+  // GL texture names are small integers, 21 bits each is plenty
+  uint64_t packed = (uint64_t(image->getId()) << 42) |
+                    (uint64_t(material.diffuse->getId()) << 21) |
+                    uint64_t(material.specular->getId());
+  // 0 is taken by draws from the material table
+  auto [it, inserted] = textureSets.try_emplace(
+      packed, static_cast<uint32_t>(textureSets.size() + 1));
+  return it->second;
+}
+
+void RenderQueue::push(RenderPass pass, uint32_t shader, const Mesh &mesh,
+                       int submesh, const InstanceData &instance,
+                       float depth) {
+  const Material &material =
+      mesh.getMaterial(mesh.getSubmeshes()[submesh].material);
+  pushItem(pass, shader, mesh, submesh,
+           textureSetId(mesh.getImageTexture().get(), material),
+           OBJECT_NO_MATERIAL, instance, depth);
+}
+
+void RenderQueue::pushMesh(RenderPass pass, uint32_t shader, const Mesh &mesh,
+                           const InstanceData &instance, float depth) {
+  if (materials) {
+    MeshMaterials resolved = materials->resolve(mesh);
+    if (resolved.packed) {
+      pushItem(pass, shader, mesh, WHOLE_MESH, 0, resolved.base, instance,
+               depth);
+      return;
+    }
+  }
+  for (size_t submesh = 0; submesh < mesh.getSubmeshes().size(); ++submesh) {
+    push(pass, shader, mesh, static_cast<int>(submesh), instance, depth);
+  }
+}
+
+void RenderQueue::pushItem(RenderPass pass, uint32_t shader, const Mesh &mesh,
+                           int submesh, uint32_t textures, uint32_t material,
+                           const InstanceData &instance, float depth) {
+  float normalized = std::clamp(depth / maxDepth, 0.f, 1.f);
+  uint64_t depthBits =
+      uint64_t(normalized * float((1u << SORT_KEY_DEPTH_BITS) - 1));
+
+  constexpr int submeshShift = SORT_KEY_DEPTH_BITS;
+  constexpr int meshShift = submeshShift + SORT_KEY_SUBMESH_BITS;
+  constexpr int texturesShift = meshShift + SORT_KEY_MESH_BITS;
+  constexpr int shaderShift = texturesShift + SORT_KEY_TEXTURES_BITS;
+  constexpr int passShift = shaderShift + SORT_KEY_SHADER_BITS;
+
+  // Ids wider than their field wrap around; that only costs grouping, since
+  // submit() compares the real mesh and submesh
+  uint64_t key =
+      (uint64_t(pass) << passShift) |
+      ((uint64_t(shader) & ((1u << SORT_KEY_SHADER_BITS) - 1)) << shaderShift) |
+      ((uint64_t(textures) & ((1u << SORT_KEY_TEXTURES_BITS) - 1))
+       << texturesShift) |
+      ((uint64_t(mesh.getId()) & ((1u << SORT_KEY_MESH_BITS) - 1))
+       << meshShift) |
+      ((uint64_t(submesh) & ((1u << SORT_KEY_SUBMESH_BITS) - 1))
+       << submeshShift) |
+      depthBits;
+
+  keys.push_back({key, static_cast<uint32_t>(items.size())});
+  items.push_back({&mesh, submesh, textures, material, instance});
+}
+
+void RenderQueue::sort() {
+  // LSD radix sort, 8 bits per pass. Bytes that are equal across all keys
+  // (e.g. pass and shader today) are skipped.
+  scratch.resize(keys.size());
+  for (int shift = 0; shift < 64; shift += 8) {
+    size_t counts[256] = {};
+    for (const auto &entry : keys) {
+      ++counts[(entry.first >> shift) & 0xff];
+    }
+    if (std::find(std::begin(counts), std::end(counts), keys.size()) !=
+        std::end(counts))
+      continue;
+
+    size_t offsets[256];
+    size_t total = 0;
+    for (int i = 0; i < 256; ++i) {
+      offsets[i] = total;
+      total += counts[i];
+    }
+    for (const auto &entry : keys) {
+      scratch[offsets[(entry.first >> shift) & 0xff]++] = entry;
+    }
+    keys.swap(scratch);
+  }
+}
+
+void RenderQueue::bindTextures(const Mesh &mesh, const Material &material) {
+  if (mesh.getImageTexture().get() != boundImage) {
+    mesh.bindImageTexture();
+    boundImage = mesh.getImageTexture().get();
+    ++stats.textureBinds;
+  }
+  if (!boundMaterial || !material.hasSameTextures(*boundMaterial)) {
+    material.bind();
+    stats.textureBinds += 2;
+  }
+  boundMaterial = &material;
+}
+
+void RenderQueue::submit(InstanceBuffer &instanceBuffer, int shininessLoc) {
+  stats = RenderStats();
+  stats.items = keys.size();
+
+  // Instances of a run must be contiguous, so upload in sorted order
+  instances.clear();
+  for (const auto &entry : keys) {
+    instances.push_back(items[entry.second].instance);
+  }
+  instanceBuffer.upload(instances);
+
+  boundImage = nullptr;
+  boundMaterial = nullptr;
+  unsigned int boundVertexArray = 0;
+  float boundShininess = -1.f;
+  for (size_t first = 0; first < keys.size();) {
+    const Item &item = items[keys[first].second];
+    size_t count = 1;
+    while (first + count < keys.size()) {
+      const Item &next = items[keys[first + count].second];
+      if (next.mesh != item.mesh || next.submesh != item.submesh)
+        break;
+      ++count;
+    }
+
+    const Mesh &mesh = *item.mesh;
+    const Submesh &submesh = mesh.getSubmeshes()[item.submesh];
+    const Material &material = mesh.getMaterial(submesh.material);
+
+    bindTextures(mesh, material);
+    if (material.shininess != boundShininess) {
+      glUniform1f(shininessLoc, material.shininess);
+      boundShininess = material.shininess;
+      ++stats.uniformUpdates;
+    }
+
+    // The instance attributes point into the buffer per run, so they are
+    // re-set even when the VAO stays bound
+    if (mesh.getVertexArray() != boundVertexArray) {
+      mesh.bindVertexArray();
+      boundVertexArray = mesh.getVertexArray();
+      ++stats.vaoBinds;
+    }
+    instanceBuffer.bindAttributes(first);
+
+    mesh.drawSubmesh(submesh, static_cast<int>(count));
+    ++stats.drawCalls;
+    first += count;
+  }
+
+  stats.textureBindsSkipped =
+      stats.items * NAIVE_TEXTURE_BINDS - stats.textureBinds;
+  stats.uniformUpdatesSkipped =
+      stats.items * NAIVE_UNIFORM_UPDATES - stats.uniformUpdates;
+  stats.vaoBindsSkipped = stats.items - stats.vaoBinds;
+}
+
+void RenderQueue::submitIndirect(IndirectDrawBuffer &indirect) {
+  stats = RenderStats();
+  stats.items = keys.size();
+
+  batches.clear();
+
+  // Objects in sorted order so a run's instances are contiguous and a
+  // command's baseInstance can point at its first one
+  objects.clear();
+  commands.clear();
+  for (size_t first = 0; first < keys.size();) {
+    const Item &item = items[keys[first].second];
+    size_t count = 0;
+    while (first + count < keys.size()) {
+      const Item &next = items[keys[first + count].second];
+      if (next.mesh != item.mesh || next.submesh != item.submesh)
+        break;
+      // Material table draws take shininess from their entries
+      float shininess = 0.f;
+      if (next.submesh != WHOLE_MESH) {
+        shininess = next.mesh
+                        ->getMaterial(
+                            next.mesh->getSubmeshes()[next.submesh].material)
+                        .shininess;
+      }
+      const glm::mat3 &normal = next.instance.normalMatrix;
+      objects.push_back({next.instance.model,
+                         {glm::vec4(normal[0], 0.f), glm::vec4(normal[1], 0.f),
+                          glm::vec4(normal[2], 0.f)},
+                         glm::vec3(next.instance.color),
+                         shininess,
+                         next.material,
+                         next.instance.color.a,
+                         {}});
+      ++count;
+    }
+
+    const Mesh &mesh = *item.mesh;
+    Submesh submesh{0, 0, mesh.getElementCount()};
+    const Material *material = nullptr;
+    if (item.submesh != WHOLE_MESH) {
+      submesh = mesh.getSubmeshes()[item.submesh];
+      material = &mesh.getMaterial(submesh.material);
+    }
+    if (batches.empty() ||
+        batches.back().vertexArray != mesh.getVertexArray() ||
+        batches.back().indexed != mesh.isIndexed() ||
+        batches.back().textures != item.textures) {
+      batches.push_back({&mesh, material, mesh.getVertexArray(),
+                         mesh.isIndexed(), item.textures,
+                         commands.size() * sizeof(uint32_t), 0});
+    }
+    if (mesh.isIndexed()) {
+      DrawElementsIndirectCommand command{
+          submesh.count, uint32_t(count), mesh.getFirstIndex() + submesh.first,
+          int32_t(mesh.getFirstVertex()), uint32_t(first)};
+      const uint32_t *words = reinterpret_cast<const uint32_t *>(&command);
+      commands.insert(commands.end(), words, words + 5);
+    } else {
+      DrawArraysIndirectCommand command{submesh.count, uint32_t(count),
+                                        mesh.getFirstVertex() + submesh.first,
+                                        uint32_t(first)};
+      const uint32_t *words = reinterpret_cast<const uint32_t *>(&command);
+      commands.insert(commands.end(), words, words + 4);
+    }
+    ++batches.back().drawCount;
+    ++stats.commands;
+    first += count;
+  }
+  indirect.upload(objects, commands);
+  if (materials) {
+    materials->upload();
+  }
+
+  boundImage = nullptr;
+  boundMaterial = nullptr;
+  unsigned int boundVertexArray = 0;
+  for (const Batch &batch : batches) {
+    if (batch.material) {
+      bindTextures(*batch.mesh, *batch.material);
+    }
+    if (batch.vertexArray != boundVertexArray) {
+      batch.mesh->bindVertexArray();
+      indirect.bindObjectIndices();
+      boundVertexArray = batch.vertexArray;
+      ++stats.vaoBinds;
+    }
+
+    // A batch's commands are all the same kind and tightly packed
+    if (batch.indexed) {
+      glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                  (void *)batch.offset, batch.drawCount, 0);
+    } else {
+      glMultiDrawArraysIndirect(GL_TRIANGLES, (void *)batch.offset,
+                                batch.drawCount, 0);
+    }
+    ++stats.drawCalls;
+  }
+
+  stats.textureBindsSkipped =
+      stats.items * NAIVE_TEXTURE_BINDS - stats.textureBinds;
+  stats.uniformUpdatesSkipped = stats.items * NAIVE_UNIFORM_UPDATES;
+  stats.vaoBindsSkipped = stats.items - stats.vaoBinds;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "indirectDraw.h"
+#include "instanceBuffer.h"
+#include <cstddef>
+#include <cstdint>
+#include <glm/ext/vector_float3.hpp>
+#include <unordered_map>
+#include <vector>
+
+class MaterialTable;
+class Mesh;
+class Texture;
+struct Material;
+
+// Packed draw sort key, most significant field first:
+//   pass:4 | shader:4 | texture set:20 | mesh:20 | submesh:6 | depth:10
+// Sorting by it groups draws that share state and, within one submesh,
+// orders instances front to back. The submesh sits above depth so the
+// instances of one submesh stay a single run.
+constexpr int SORT_KEY_DEPTH_BITS = 10;
+constexpr int SORT_KEY_SUBMESH_BITS = 6;
+constexpr int SORT_KEY_MESH_BITS = 20;
+constexpr int SORT_KEY_TEXTURES_BITS = 20;
+constexpr int SORT_KEY_SHADER_BITS = 4;
+
+enum class RenderPass : uint32_t { Opaque = 0 };
+
+// Per-frame submission counters. "Skipped" counts calls a naive renderer
+// (bind everything per draw) would have made.
+struct RenderStats {
+  // draws queued: one per entity and submesh, or per entity for meshes in
+  // the material table
+  size_t items = 0;
+  size_t drawCalls = 0; // instanced or multi-draw indirect calls issued
+  size_t commands = 0;  // indirect commands written (indirect path only)
+  size_t textureBinds = 0;
+  size_t textureBindsSkipped = 0;
+  size_t uniformUpdates = 0;
+  size_t uniformUpdatesSkipped = 0;
+  size_t vaoBinds = 0;
+  size_t vaoBindsSkipped = 0;
+};
+
+class RenderQueue {
+public:
+  // Forget last frame's items (keeps allocations)
+  void clear();
+
+  // Queue one submesh of mesh drawn with the given instance data. depth is
+  // the view distance, clamped to maxDepth for the key.
+  void push(RenderPass pass, uint32_t shader, const Mesh &mesh, int submesh,
+            const InstanceData &instance, float depth);
+
+  // Queue a whole mesh: one item when its materials are in the material
+  // table (the vertices pick their material), one per submesh otherwise
+  void pushMesh(RenderPass pass, uint32_t shader, const Mesh &mesh,
+                const InstanceData &instance, float depth);
+
+  // Radix sort the queued items by key
+  void sort();
+
+  // Upload instance data in sorted order and draw every run of items sharing
+  // mesh and submesh with a single instanced call, skipping redundant texture,
+  // VAO and shininess changes
+  void submit(InstanceBuffer &instanceBuffer, int shininessLoc);
+
+  // GPU-driven alternative to submit(): every item becomes an entry of the
+  // object table, every run of a mesh and submesh an indirect command, and
+  // every run of commands sharing VAO, textures and draw kind (arrays or
+  // elements) one glMultiDraw*Indirect call. Shininess travels with the
+  // object, so it never splits a run, and meshes in the material table need
+  // no texture binds, so all of them share one call per draw kind.
+  void submitIndirect(IndirectDrawBuffer &indirect);
+
+  // Resolve meshes through this table in pushMesh() and bind it in
+  // submitIndirect(); null keeps every draw on bound textures
+  void setMaterialTable(MaterialTable *table) { materials = table; }
+  void setMaxDepth(float depth) { maxDepth = depth; }
+  const RenderStats &getStats() const { return stats; }
+
+private:
+  // Item::submesh of a mesh drawn in one go from the material table
+  static constexpr int WHOLE_MESH = -1;
+
+  struct Item {
+    const Mesh *mesh;
+    int submesh;
+    uint32_t textures; // texture set id, 0 = from the material table
+    uint32_t material; // first material table entry or OBJECT_NO_MATERIAL
+    InstanceData instance;
+  };
+
+  // Commands drawn by one glMultiDraw*Indirect call
+  struct Batch {
+    const Mesh *mesh; // the first one, for its textures
+    const Material *material; // null for the material table
+    unsigned int vertexArray;
+    bool indexed;
+    uint32_t textures;
+    size_t offset; // bytes into the command buffer
+    int drawCount;
+  };
+
+  uint32_t textureSetId(const Texture *image, const Material &material);
+  void pushItem(RenderPass pass, uint32_t shader, const Mesh &mesh,
+                int submesh, uint32_t textures, uint32_t material,
+                const InstanceData &instance, float depth);
+  // Bind the image and material textures unless they already are
+  void bindTextures(const Mesh &mesh, const Material &material);
+
+  std::vector<Item> items;
+  // (key, item index) pairs, radix sorted by key
+  std::vector<std::pair<uint64_t, uint32_t>> keys;
+  std::vector<std::pair<uint64_t, uint32_t>> scratch;
+  std::vector<InstanceData> instances;
+  std::vector<ObjectData> objects;
+  std::vector<uint32_t> commands;
+  std::vector<Batch> batches;
+  // Bound by the last bindTextures() of this submit
+  const Texture *boundImage = nullptr;
+  const Material *boundMaterial = nullptr;
+  // Dense ids for the key, handed out in order of first use this frame
+  std::unordered_map<uint64_t, uint32_t> textureSets;
+  MaterialTable *materials = nullptr;
+  float maxDepth = 1000.f;
+  RenderStats stats;
+};
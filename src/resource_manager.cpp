@@ -1,5 +1,10 @@
 #include "resource_manager.h"
 #include "mesh.h"
+#include "meshCooker.h"
+#include "textureCooker.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
 #include <glm/ext/vector_float3.hpp>
 #include <iostream>
 
@@ -7,20 +12,18 @@ std::shared_ptr<Mesh>
 ResourceManager::loadMesh(const std::string &path, const std::string &filename,
                           const std::string &texturePath) {
   std::string key = path + filename;
-
-  // Check if already cached
-  auto it = meshCache.find(key);
-  if (it != meshCache.end()) {
-    if (auto shared = it->second.lock()) {
-      return shared;
-    }
-    // Expired, remove from cache
-    meshCache.erase(it);
+  if (auto cached = findCachedMesh(key)) {
+    return cached;
   }
 
   // Load new mesh
   auto mesh = std::make_shared<Mesh>();
-  int verts = mesh->loadObj(path, filename, texturePath);
+  MeshData data;
+  int verts = 0;
+  if (Mesh::parseObj(path, filename, texturePath, data)) {
+    attachTextures(*mesh, data);
+    verts = mesh->upload(data);
+  }
   if (verts == 0) {
     std::cerr << "Failed to load mesh: " << key << std::endl;
     return nullptr;
@@ -32,12 +35,355 @@ ResourceManager::loadMesh(const std::string &path, const std::string &filename,
 
 std::shared_ptr<Mesh>
 ResourceManager::loadMesh(const std::vector<glm::vec3> &verts, int pathSegments,
-                          int circleSegments, float radius, glm::vec3 color) {
-  auto mesh = std::make_shared<Mesh>(color);
+                          int circleSegments, float radius) {
+  std::string key = sweepKey(verts, pathSegments, circleSegments, radius);
+  if (auto cached = findCachedMesh(key)) {
+    return cached;
+  }
+
+  auto mesh = std::make_shared<Mesh>();
   int size = mesh->loadSweep(verts, pathSegments, circleSegments, radius);
   if (size == 0) {
     std::cerr << "Cannot load mesh with no verts" << std::endl;
     return nullptr;
   }
+  meshCache[key] = mesh;
+  return mesh;
+}
+
+std::shared_ptr<Mesh> ResourceManager::loadPrimitive(Primitive primitive,
+                                                     int sides) {
+  // Can't clash with OBJ paths or the "sweep:" keys
+  std::string key = "primitive:" + std::to_string(int(primitive)) + ":" +
+                    std::to_string(sides);
+  if (auto cached = findCachedMesh(key)) {
+    return cached;
+  }
+
+  auto mesh = std::make_shared<Mesh>();
+  MeshData data = Mesh::buildPrimitive(primitive, sides);
+  if (mesh->upload(data) == 0) {
+    std::cerr << "Cannot build primitive with " << sides << " sides"
+              << std::endl;
+    return nullptr;
+  }
+  meshCache[key] = mesh;
+  return mesh;
+}
+
+std::shared_ptr<Mesh>
+ResourceManager::loadMeshAsync(const std::string &path,
+                               const std::string &filename,
+                               const std::string &texturePath,
+                               std::vector<std::shared_ptr<Mesh>> *lods) {
+  std::string key = path + filename;
+  // Possibly still loading, callers share it either way
+  if (auto cached = findCachedMesh(key)) {
+    if (lods) {
+      lods->clear();
+      for (int level = 1; level < LOD_LEVELS; ++level) {
+        auto it = meshCache.find(lodKey(key, level));
+        auto lod = it == meshCache.end() ? nullptr : it->second.lock();
+        if (!lod)
+          break;
+        lods->push_back(lod);
+      }
+    }
+    return cached;
+  }
+
+  // Every level gets a mesh up front; ones the simplifier didn't produce
+  // stay empty, and the renderer never switches to an unloaded level
+  auto mesh = std::make_shared<Mesh>();
+  std::vector<std::string> keys = {key};
+  std::vector<std::weak_ptr<Mesh>> targets = {mesh};
+  if (lods) {
+    lods->clear();
+    for (int level = 1; level < LOD_LEVELS; ++level) {
+      auto lod = std::make_shared<Mesh>();
+      keys.push_back(lodKey(key, level));
+      meshCache[keys.back()] = lod;
+      lods->push_back(lod);
+      targets.push_back(lod);
+    }
+  }
+  queueLoad([this, keys, targets, path, filename, texturePath] {
+    auto levels = std::make_shared<std::vector<MeshData>>();
+    if (!loadMeshLods(path, filename, texturePath, *levels)) {
+      std::cerr << "Failed to load mesh: " << path + filename << std::endl;
+      return std::function<void()>(
+          [this, keys, targets] { forgetMeshes(keys, targets); });
+    }
+    return std::function<void()>([this, targets, levels] {
+      for (size_t level = 0;
+           level < targets.size() && level < levels->size(); ++level) {
+        if (auto mesh = targets[level].lock()) {
+          attachTextures(*mesh, (*levels)[level]);
+          mesh->upload((*levels)[level]);
+        }
+      }
+    });
+  });
+
+  meshCache[key] = mesh;
   return mesh;
 }
+
+std::shared_ptr<Mesh>
+ResourceManager::loadMeshAsync(const std::vector<glm::vec3> &verts,
+                               int pathSegments, int circleSegments,
+                               float radius, int section, int sections) {
+  std::string key = sweepKey(verts, pathSegments, circleSegments, radius,
+                             section, sections);
+  if (auto cached = findCachedMesh(key)) {
+    return cached;
+  }
+
+  auto mesh = std::make_shared<Mesh>();
+  std::weak_ptr<Mesh> target = mesh;
+  queueLoad([this, key, target, verts, pathSegments, circleSegments, radius,
+             section, sections] {
+    auto data = std::make_shared<MeshData>();
+    data->vertices = Mesh::buildSweep(verts, pathSegments, circleSegments,
+                                      radius, section, sections);
+    if (data->vertices.empty()) {
+      std::cerr << "Cannot load mesh with no verts" << std::endl;
+      return std::function<void()>(
+          [this, key, target] { forgetMeshes({key}, {target}); });
+    }
+    return std::function<void()>([target, data] {
+      if (auto mesh = target.lock()) {
+        mesh->upload(*data);
+      }
+    });
+  });
+
+  meshCache[key] = mesh;
+  return mesh;
+}
+
+std::shared_ptr<Texture>
+ResourceManager::loadTexture(const std::string &path,
+                             const SamplerSettings &sampler) {
+  // Canonicalize so "a/../grass.jpg" and "grass.jpg" share one entry
+  std::error_code ec;
+  std::string canonical = std::filesystem::weakly_canonical(path, ec).string();
+  if (ec) {
+    canonical = path;
+  }
+  std::string key = canonical + "|" + sampler.key();
+
+  auto it = textureCache.find(key);
+  if (it != textureCache.end()) {
+    if (auto shared = it->second.lock()) {
+      ++textureStats.hits;
+      return shared;
+    }
+    textureCache.erase(it);
+  }
+  ++textureStats.misses;
+
+  auto texture = std::make_shared<Texture>();
+  std::weak_ptr<Texture> target = texture;
+  queueLoad([this, target, canonical, sampler, compress = compressTextures] {
+    // Cook on first use, afterwards just map the cooked file
+    std::string cookedPath = cookedTexturePath(canonical, compress);
+    if (!isCookedTextureFresh(canonical, cookedPath)) {
+      CookOptions options;
+      options.compressBC1 = compress;
+      cookTexture(canonical, cookedPath, options);
+    }
+
+    auto cooked = std::make_shared<CookedTexture>();
+    bool opened = cooked->open(cookedPath);
+    if (opened && TextureStreamer::shouldStream(*cooked, sampler)) {
+      // Large textures start at their small tail mips; the streamer pages
+      // in bigger levels once something on screen needs them
+      for (int level = cooked->getLevelCount() - 1; level >= 0; --level) {
+        const CookedLevel &info = cooked->getLevel(level);
+        if (std::max(info.width, info.height) > STREAMING_TAIL_SIZE)
+          break;
+        cooked->prefetchLevel(level);
+      }
+      return std::function<void()>([this, target, canonical, sampler,
+                                    cooked] {
+        if (auto texture = target.lock()) {
+          streamer.add(texture, cooked, sampler);
+          std::cerr << "Streaming texture: " << canonical << " ("
+                    << texture->getWidth() << "x" << texture->getHeight()
+                    << ", " << cooked->getLevelCount() << " mips)\n";
+        }
+      });
+    }
+    if (opened) {
+      cooked->prefetch();
+      return std::function<void()>([target, canonical, sampler, cooked] {
+        if (auto texture = target.lock()) {
+          if (texture->upload(*cooked, sampler)) {
+            std::cerr << "Loaded texture: " << canonical << " ("
+                      << texture->getWidth() << "x" << texture->getHeight()
+                      << ", " << cooked->getLevelCount() << " mips)\n";
+          }
+        }
+      });
+    }
+
+    // Cooking failed (e.g. read-only cache dir), decode directly instead
+    auto image = std::make_shared<ImageData>();
+    if (!Texture::loadImage(canonical, *image)) {
+      return std::function<void()>();
+    }
+    return std::function<void()>([target, canonical, sampler, image] {
+      if (auto texture = target.lock()) {
+        if (texture->upload(*image, sampler)) {
+          std::cerr << "Loaded texture: " << canonical << " (" << image->width
+                    << "x" << image->height << ", " << image->channels
+                    << "chan)\n";
+        }
+      }
+    });
+  });
+
+  textureCache[key] = texture;
+  return texture;
+}
+
+TextureCacheStats ResourceManager::getTextureStats() {
+  TextureCacheStats stats = textureStats;
+  for (auto it = textureCache.begin(); it != textureCache.end();) {
+    if (auto texture = it->second.lock()) {
+      ++stats.texturesResident;
+      stats.bytesResident += texture->getByteSize();
+      ++it;
+    } else {
+      // Last user released it, the GL texture is already gone
+      it = textureCache.erase(it);
+    }
+  }
+  return stats;
+}
+
+MeshCacheStats ResourceManager::getMeshStats() {
+  MeshCacheStats stats = meshStats;
+  for (auto it = meshCache.begin(); it != meshCache.end();) {
+    if (auto mesh = it->second.lock()) {
+      ++stats.meshesResident;
+      stats.verticesResident += mesh->getVertexCount();
+      ++it;
+    } else {
+      it = meshCache.erase(it);
+    }
+  }
+  return stats;
+}
+
+std::shared_ptr<Mesh> ResourceManager::findCachedMesh(const std::string &key) {
+  auto it = meshCache.find(key);
+  if (it != meshCache.end()) {
+    if (auto shared = it->second.lock()) {
+      ++meshStats.hits;
+      return shared;
+    }
+    // Expired, remove from cache
+    meshCache.erase(it);
+  }
+  ++meshStats.misses;
+  return nullptr;
+}
+
+void ResourceManager::forgetMeshes(
+    const std::vector<std::string> &keys,
+    const std::vector<std::weak_ptr<Mesh>> &targets) {
+  for (size_t i = 0; i < keys.size(); ++i) {
+    auto it = meshCache.find(keys[i]);
+    // Unless a newer load has taken the key over since
+    if (it != meshCache.end() && !it->second.owner_before(targets[i]) &&
+        !targets[i].owner_before(it->second)) {
+      meshCache.erase(it);
+    }
+  }
+}
+
+std::string ResourceManager::sweepKey(const std::vector<glm::vec3> &verts,
+                                      int pathSegments, int circleSegments,
+                                      float radius, int section,
+                                      int sections) {
+  // The raw parameter bytes: equal keys always mean identical geometry, and
+  // the "sweep:" prefix can never clash with an OBJ path
+  std::string key = "sweep:";
+  key.append(reinterpret_cast<const char *>(&pathSegments), sizeof(int));
+  key.append(reinterpret_cast<const char *>(&circleSegments), sizeof(int));
+  key.append(reinterpret_cast<const char *>(&radius), sizeof(float));
+  key.append(reinterpret_cast<const char *>(&section), sizeof(int));
+  key.append(reinterpret_cast<const char *>(&sections), sizeof(int));
+  key.append(reinterpret_cast<const char *>(verts.data()),
+             verts.size() * sizeof(glm::vec3));
+  return key;
+}
+
+std::string ResourceManager::lodKey(const std::string &key, int level) {
+  return key + "|lod" + std::to_string(level);
+}
+
+void ResourceManager::attachTextures(Mesh &mesh, const MeshData &data) {
+  for (size_t i = 0; i < data.materials.size(); ++i) {
+    const MaterialData &material = data.materials[i];
+    if (!material.diffusePath.empty()) {
+      mesh.setTexture(loadTexture(material.diffusePath), TextureType::Diffuse,
+                      i);
+    }
+    if (!material.specularPath.empty()) {
+      mesh.setTexture(loadTexture(material.specularPath),
+                      TextureType::Specular, i);
+    }
+  }
+  if (!data.imagePath.empty()) {
+    mesh.setTexture(loadTexture(data.imagePath), TextureType::Image);
+  }
+}
+
+void ResourceManager::queueLoad(
+    std::function<std::function<void()>()> work) {
+  ++pending;
+
+  // Workers only ever see weak_ptrs: the last reference to a Mesh or Texture
+  // must be dropped on the main thread since their destructors delete GL
+  // objects
+  workers.submit([this, work = std::move(work)] {
+    std::function<void()> upload = work();
+    if (!upload) {
+      upload = [] {};
+    }
+
+    std::lock_guard<std::mutex> lock(completedMutex);
+    completed.push_back(std::move(upload));
+  });
+}
+
+int ResourceManager::processUploads(float budgetMs) {
+  auto start = std::chrono::steady_clock::now();
+  int uploaded = 0;
+
+  while (true) {
+    std::function<void()> upload;
+    {
+      std::lock_guard<std::mutex> lock(completedMutex);
+      if (completed.empty())
+        break;
+      upload = std::move(completed.front());
+      completed.pop_front();
+    }
+    --pending;
+
+    upload();
+    ++uploaded;
+
+    float elapsedMs = std::chrono::duration<float, std::milli>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+    if (elapsedMs >= budgetMs)
+      break;
+  }
+
+  return uploaded;
+}
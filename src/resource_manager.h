@@ -1,14 +1,35 @@
 #pragma once
 
+#include "mesh.h"
+#include "texture.h"
+#include "textureStreamer.h"
+#include "threadPool.h"
+#include <cstddef>
+#include <deque>
+#include <functional>
 #include <glm/ext/vector_float3.hpp>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
-class Mesh;
 class Shader;
 
+struct TextureCacheStats {
+  size_t hits = 0;
+  size_t misses = 0;
+  size_t texturesResident = 0;
+  size_t bytesResident = 0;
+};
+
+struct MeshCacheStats {
+  size_t hits = 0;
+  size_t misses = 0;
+  size_t meshesResident = 0;
+  size_t verticesResident = 0;
+};
+
 class ResourceManager {
 public:
   ResourceManager() = default;
@@ -18,12 +39,89 @@ public:
                                  const std::string &filename,
                                  const std::string &texturePath = "");
 
-  // Loads mesh from vector of vec3s, radius and res
+  // Loads mesh from vector of vec3s, radius and res. Sweeps with identical
+  // parameters share one mesh; straight ones are better drawn as a
+  // primitive (see Mesh::matchPrimitive()).
   std::shared_ptr<Mesh> loadMesh(const std::vector<glm::vec3> &verts,
                                  int pathSegments, int circleSegments,
-                                 float radius,
-                                 glm::vec3 color = {1.f, 1.f, 1.f});
+                                 float radius);
+
+  // The shared unit primitive with this many sides. Built and uploaded
+  // right away, it is only a few dozen vertices.
+  std::shared_ptr<Mesh> loadPrimitive(Primitive primitive, int sides);
+
+  // Async variants: return an empty mesh right away and parse/decode on the
+  // worker threads. The mesh draws nothing until processUploads() has
+  // uploaded its data on the main thread.
+  // OBJs go through the mesh cache (see meshCooker.h), which also holds
+  // their simplified LOD levels; those are returned in lods, finest first
+  // and loading alongside the mesh.
+  std::shared_ptr<Mesh>
+  loadMeshAsync(const std::string &path, const std::string &filename,
+                const std::string &texturePath = "",
+                std::vector<std::shared_ptr<Mesh>> *lods = nullptr);
+  // Sweeps, or one section of a sweep (see Mesh::buildSweep)
+  std::shared_ptr<Mesh> loadMeshAsync(const std::vector<glm::vec3> &verts,
+                                      int pathSegments, int circleSegments,
+                                      float radius, int section = 0,
+                                      int sections = 1);
+
+  // Returns the shared texture for path + sampler, loading it on a worker
+  // thread on first use. Until the load is uploaded the texture is white.
+  // The texture lives as long as someone holds the returned pointer.
+  // Images are cooked once into cache/textures (see textureCooker.h) and later
+  // runs map the cooked mip chain instead of decoding again.
+  std::shared_ptr<Texture> loadTexture(const std::string &path,
+                                       const SamplerSettings &sampler = {});
+
+  // Cook and upload textures as BC1. Only enable if Texture::supportsBC1().
+  void setTextureCompression(bool enabled) { compressTextures = enabled; }
+
+  // Upload finished loads to the GPU until budgetMs has been spent. Must be
+  // called from the thread owning the GL context, once per frame.
+  int processUploads(float budgetMs);
+
+  // Loads queued or decoded but not yet uploaded
+  int pendingLoads() const { return pending; }
+
+  // Hits/misses since startup and what is currently alive on the GPU
+  TextureCacheStats getTextureStats();
+  MeshCacheStats getMeshStats();
+
+  // Large cooked textures are handed to the streamer instead of being
+  // uploaded whole; feed it resolution requests and update() it every frame
+  TextureStreamer &getTextureStreamer() { return streamer; }
 
 private:
+  // Request every texture listed in data through the cache
+  void attachTextures(Mesh &mesh, const MeshData &data);
+
+  // Live cached mesh for key, or nullptr (counts the hit/miss)
+  std::shared_ptr<Mesh> findCachedMesh(const std::string &key);
+  // Uncache the meshes of a failed load, so asking again retries it
+  void forgetMeshes(const std::vector<std::string> &keys,
+                    const std::vector<std::weak_ptr<Mesh>> &targets);
+  // Cache key of an LOD level of the mesh cached under key
+  static std::string lodKey(const std::string &key, int level);
+  static std::string sweepKey(const std::vector<glm::vec3> &verts,
+                              int pathSegments, int circleSegments,
+                              float radius, int section = 0,
+                              int sections = 1);
+
+  // Run work on a worker; the returned closure runs on the main thread
+  void queueLoad(std::function<std::function<void()>()> work);
+
   std::unordered_map<std::string, std::weak_ptr<Mesh>> meshCache;
+  MeshCacheStats meshStats;
+  std::unordered_map<std::string, std::weak_ptr<Texture>> textureCache;
+  TextureCacheStats textureStats;
+  bool compressTextures = false;
+  TextureStreamer streamer;
+
+  std::mutex completedMutex;
+  std::deque<std::function<void()>> completed;
+  int pending = 0;
+
+  // Declared last so workers are joined before the queue above is destroyed
+  ThreadPool workers;
 };
@@ -6,22 +6,32 @@
 #include <sstream>
 
 Shader::Shader() {}
-Shader::~Shader() { glDeleteProgram(currentShaderProgram); }
+Shader::~Shader() {
+  GLState::get().forgetProgram(currentShaderProgram);
+  glDeleteProgram(currentShaderProgram);
+}
 
-ShaderResult Shader::loadShaders() {
-  vertexSource = readFile("src/shaders/shader.vert");
+ShaderResult Shader::loadShaders(const std::vector<std::string> &defines,
+                                 const std::string &vertexPath,
+                                 const std::string &fragmentPath) {
+  vertexSource = readFile(vertexPath.c_str());
   if (vertexSource.empty()) {
-    std::cerr << "Failed to read vertex shader file: src/shaders/shader.vert" << std::endl;
+    std::cerr << "Failed to read vertex shader file: " << vertexPath << std::endl;
     return ShaderResult::FileNotFound;
   }
   
-  fragmentSource = readFile("src/shaders/shader.frag");
+  fragmentSource = readFile(fragmentPath.c_str());
   if (fragmentSource.empty()) {
-    std::cerr << "Failed to read fragment shader file: src/shaders/shader.frag" << std::endl;
+    std::cerr << "Failed to read fragment shader file: " << fragmentPath << std::endl;
     return ShaderResult::FileNotFound;
   }
 
+  vertexSource = addDefines(vertexSource, defines);
+  fragmentSource = addDefines(fragmentSource, defines);
+
+  GLState::get().forgetProgram(currentShaderProgram);
   glDeleteProgram(currentShaderProgram);
+  uniformLocations.clear();
 
   currentShaderProgram =
       createShaderProgram(vertexSource.c_str(), fragmentSource.c_str());
@@ -30,7 +40,7 @@ ShaderResult Shader::loadShaders() {
     return ShaderResult::LinkingFailed;
   }
 
-  glUseProgram(currentShaderProgram);
+  GLState::get().useProgram(currentShaderProgram);
   return ShaderResult::Success;
 }
 
@@ -41,6 +51,23 @@ std::string Shader::readFile(const char *path) {
   return buffer.str();
 }
 
+std::string Shader::addDefines(const std::string &source,
+                               const std::vector<std::string> &defines) {
+  if (defines.empty()) {
+    return source;
+  }
+  // Nothing but whitespace may come before #version
+  size_t version = source.find("#version");
+  size_t lineEnd =
+      source.find('\n', version == std::string::npos ? 0 : version);
+  size_t insertAt = lineEnd == std::string::npos ? source.size() : lineEnd + 1;
+  std::string block;
+  for (const std::string &define : defines) {
+    block += "#define " + define + "\n";
+  }
+  return source.substr(0, insertAt) + block + source.substr(insertAt);
+}
+
 unsigned int Shader::createShaderProgram(const char *vertexSource,
                                          const char *fragmentSource) {
   unsigned int vertexShader = compileShader(GL_VERTEX_SHADER, vertexSource);
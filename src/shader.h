@@ -1,8 +1,10 @@
 #pragma once
 
 #include "../include/glad/glad.h"
+#include "glState.h"
 #include <map>
 #include <string>
+#include <vector>
 
 enum class ShaderResult {
   Success,
@@ -15,8 +17,13 @@ class Shader {
 public:
   Shader();
   ~Shader();
-  ShaderResult loadShaders();
-  void use() { glUseProgram(currentShaderProgram); }
+  // Compile and link the shader files, each define inserted as "#define X"
+  // after their #version line
+  ShaderResult
+  loadShaders(const std::vector<std::string> &defines = {},
+              const std::string &vertexPath = "src/shaders/shader.vert",
+              const std::string &fragmentPath = "src/shaders/shader.frag");
+  void use() { GLState::get().useProgram(currentShaderProgram); }
   unsigned int getShaderProgram() { return currentShaderProgram; }
   int addUniform(const std::string &name);
   unsigned int getUniformLocation(const std::string &name);
@@ -24,12 +31,14 @@ public:
 
 private:
   std::string readFile(const char *path);
+  static std::string addDefines(const std::string &source,
+                                const std::vector<std::string> &defines);
   unsigned int createShaderProgram(const char *vertexSource,
                                    const char *fragmentSource);
   unsigned int compileShader(unsigned int type, const char *source);
 
   std::string vertexSource;
   std::string fragmentSource;
-  unsigned int currentShaderProgram;
+  unsigned int currentShaderProgram = 0;
   std::map<std::string, unsigned int> uniformLocations;
 };
@@ -0,0 +1,34 @@
+#version 330 core
+
+out vec4 FragColor;
+
+in vec2 TexCoord;
+flat in float Fade;
+
+uniform sampler2D atlas;
+uniform int lightCount;
+
+// Same dither as shader.frag: a fading tree's geometry keeps the pixels
+// below its coverage (1 - Fade), the impostor takes the rest
+float ditherThreshold()
+{
+  const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0,
+                                    3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+  ivec2 p = ivec2(gl_FragCoord.xy) & 3;
+  return (bayer[p.x + p.y * 4] + 0.5) / 16.0;
+}
+
+void main()
+{
+  vec4 texel = texture(atlas, TexCoord);
+  if (texel.a < 0.5 || ditherThreshold() < 1.0 - Fade)
+    discard;
+
+  // Mips average in the transparent black around the tree, undo that
+  vec3 baseColor = texel.rgb / texel.a;
+  // shader.frag's ambient term for untextured meshes, or its unlit color
+  // without lights; point lights rarely reach trees this far out and are
+  // left out
+  vec3 finalColor = lightCount == 0 ? baseColor : baseColor * baseColor * 0.25;
+  FragColor = vec4(min(finalColor, vec3(1.0)), 1.0);
+}
@@ -0,0 +1,49 @@
+#version 330 core
+// Per quad (see treeImpostors.h)
+layout(location = 0) in vec4 aCenterRadius;
+layout(location = 1) in vec2 aTileFade; // first tile, fade
+
+layout(std140) uniform CameraBlock {
+  mat4 view;
+  mat4 projection;
+} cameraBlock;
+
+// Keep in sync with treeImpostors.h
+#define IMPOSTOR_VIEWS 8
+#define PI 3.14159265
+
+uniform vec3 cameraPos;
+// Size of one tile in atlas coordinates
+uniform vec2 tileScale;
+uniform int tilesPerRow;
+
+out vec2 TexCoord;
+flat out float Fade;
+
+void main()
+{
+  // Triangle strip corners (-1,-1) (1,-1) (-1,1) (1,1)
+  vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+  vec3 center = aCenterRadius.xyz;
+
+  // Turn about the vertical axis only, trees stay upright
+  vec3 toCamera = vec3(cameraPos.x - center.x, 0.0, cameraPos.z - center.z);
+  toCamera = dot(toCamera, toCamera) > 1e-6 ? normalize(toCamera)
+                                            : vec3(0.0, 0.0, 1.0);
+  vec3 right = cross(vec3(0.0, 1.0, 0.0), toCamera);
+
+  // Nearest baked view; view k was rendered from angle k * 2pi / VIEWS,
+  // measured from +z towards +x
+  float angle = atan(toCamera.x, toCamera.z);
+  int view = int(floor(angle / (2.0 * PI / IMPOSTOR_VIEWS) + 0.5));
+  // angle is in [-pi, pi]; % of a negative int is undefined in GLSL
+  view = (view + IMPOSTOR_VIEWS) % IMPOSTOR_VIEWS;
+  int tile = int(aTileFade.x) + view;
+  vec2 tileOrigin = vec2(tile % tilesPerRow, tile / tilesPerRow) * tileScale;
+  TexCoord = tileOrigin + (corner * 0.5 + 0.5) * tileScale;
+  Fade = aTileFade.y;
+
+  vec3 position = center + (right * corner.x + vec3(0.0, corner.y, 0.0)) *
+                               aCenterRadius.w;
+  gl_Position = cameraBlock.projection * cameraBlock.view * vec4(position, 1.0);
+}
@@ -0,0 +1,11 @@
+#version 330 core
+
+out vec4 FragColor;
+
+in vec3 BaseColor;
+
+void main()
+{
+  // Unlit: impostor.frag shades it like shader.frag shades the geometry
+  FragColor = vec4(BaseColor, 1.0);
+}
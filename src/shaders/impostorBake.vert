@@ -0,0 +1,18 @@
+#version 330 core
+layout(location = 0) in vec3 aPos;
+// White unless static batching baked an entity color in
+layout(location = 13) in vec4 aVertexColor;
+// Per instance (see instanceBuffer.h)
+layout(location = 3) in mat4 aModel;
+layout(location = 7) in vec4 aColor;
+
+// One tile's orthographic view of the tree
+uniform mat4 viewProjection;
+
+out vec3 BaseColor;
+
+void main()
+{
+  BaseColor = aColor.rgb * aVertexColor.rgb;
+  gl_Position = viewProjection * aModel * vec4(aPos, 1.0);
+}
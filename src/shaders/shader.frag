@@ -6,73 +6,147 @@ out vec4 FragColor;
 in vec2 TexCoord;
 in vec3 FragPos;
 in vec3 FaceNormal;
+// Per-instance color; solid color meshes sample a white texture
+in vec3 BaseColor;
 
 uniform sampler2D imageTexture;
 uniform sampler2D specularTexture;
 uniform sampler2D diffuseTexture;
 
+#ifdef INDIRECT_DRAW
+// Comes with the object (see shader.vert)
+flat in float Shininess;
+#define shininess Shininess
+#ifdef MATERIAL_TABLE
+// Packed texture arrays, keep in sync with materialTable.h
+#define MATERIAL_TEXTURE_ARRAYS 8
+uniform sampler2DArray materialArrays[MATERIAL_TEXTURE_ARRAYS];
+flat in ivec2 ImageSlot;
+flat in ivec2 DiffuseSlot;
+flat in ivec2 SpecularSlot;
+
+// Sampler array indices must be constant in GLSL 3.30, hence the switch.
+// The gradients are taken outside so the branches can diverge.
+vec4 sampleSlot(ivec2 slot, sampler2D fallback, vec2 dx, vec2 dy)
+{
+  vec3 coord = vec3(TexCoord, float(slot.y));
+  switch (slot.x) {
+  case 0: return textureGrad(materialArrays[0], coord, dx, dy);
+  case 1: return textureGrad(materialArrays[1], coord, dx, dy);
+  case 2: return textureGrad(materialArrays[2], coord, dx, dy);
+  case 3: return textureGrad(materialArrays[3], coord, dx, dy);
+  case 4: return textureGrad(materialArrays[4], coord, dx, dy);
+  case 5: return textureGrad(materialArrays[5], coord, dx, dy);
+  case 6: return textureGrad(materialArrays[6], coord, dx, dy);
+  case 7: return textureGrad(materialArrays[7], coord, dx, dy);
+  }
+  return textureGrad(fallback, TexCoord, dx, dy);
+}
+#endif
+#else
 uniform float shininess = 32.0;
+#endif
 uniform vec3 cameraPos;
 
-// Maximum number of lights supported in the uniform buffer
-#define MAX_LIGHTS 128
+in float ViewDepth;
+flat in float Coverage;
+
+// Ordered 4x4 dither, thresholds in (0, 1). impostor.frag keeps exactly the
+// pixels a fading mesh drops here, so the two cross-fade without blending.
+float ditherThreshold()
+{
+  const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0,
+                                    3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+  ivec2 p = ivec2(gl_FragCoord.xy) & 3;
+  return (bayer[p.x + p.y * 4] + 0.5) / 16.0;
+}
 
-// Light structure containing position, color, and intensity
-struct Light {
-  vec3 position;
-  vec3 color;
-  float intensity;
-};
+// Light cluster grid, keep in sync with lightClusters.h
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
 
-// Uniform buffer block containing array of lights and light count
-layout(std140) uniform LightBlock {
-  Light lights[MAX_LIGHTS];
-  int count;
-} lightBlock;
+// Two texels per light: position + radius, color + intensity
+uniform samplerBuffer lightData;
+// (offset, count) into lightIndices for every cluster
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer lightIndices;
+// Pixels per tile in xy; slice = log(ViewDepth) * z + w
+uniform vec4 clusterParams;
+uniform int lightCount;
 
 void main()
 {
-  vec3 texColor = texture(imageTexture, TexCoord).rgb;
+  if (Coverage < 1.0 && ditherThreshold() >= Coverage)
+    discard;
+
+#ifdef MATERIAL_TABLE
+  vec2 dx = dFdx(TexCoord);
+  vec2 dy = dFdy(TexCoord);
+  vec4 imageSample = sampleSlot(ImageSlot, imageTexture, dx, dy);
+  vec4 diffuseSample = sampleSlot(DiffuseSlot, diffuseTexture, dx, dy);
+  vec4 specularSample = sampleSlot(SpecularSlot, specularTexture, dx, dy);
+#else
+  vec4 imageSample = texture(imageTexture, TexCoord);
+  vec4 diffuseSample = texture(diffuseTexture, TexCoord);
+  vec4 specularSample = texture(specularTexture, TexCoord);
+#endif
+  vec3 texColor = imageSample.rgb * BaseColor;
 
   // Sample diffuse and specular textures using texture coordinates
-  vec4 diffuseColor = texture(diffuseTexture, TexCoord);
-  vec4 specColor = texture(specularTexture, TexCoord);
+  vec4 diffuseColor = diffuseSample * vec4(BaseColor, 1.0);
+  vec4 specColor = specularSample * vec4(BaseColor, 1.0);
 
-  // Normalize surface normal and calculate view direction from fragment to camera
-  vec3 norm = normalize(FaceNormal);
+  // Normalize surface normal and calculate view direction from fragment to camera.
+  // Back faces are only visible on open surfaces (leaves, terrain), so light
+  // them as seen from that side.
+  vec3 norm = normalize(gl_FrontFacing ? FaceNormal : -FaceNormal);
   vec3 viewDir = normalize(cameraPos - FragPos);
 
   // Ambient lighting contribution (5% of diffuse color)
   vec3 ambient = diffuseColor.rgb * 0.25;
   vec3 totalLight = vec3(0.0);
 
-  // Iterate through all lights in the light block
-  for (int i = 0; i < lightBlock.count; i++) {
+  // Only the lights whose radius reaches this fragment's cluster
+  ivec2 tile = min(ivec2(gl_FragCoord.xy / clusterParams.xy),
+                   ivec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+  int slice = clamp(int(log(max(ViewDepth, 1e-4)) * clusterParams.z + clusterParams.w),
+                    0, CLUSTER_Z - 1);
+  int cluster = tile.x + tile.y * CLUSTER_X + slice * CLUSTER_X * CLUSTER_Y;
+  uvec2 range = texelFetch(clusterGrid, cluster).xy;
+
+  for (uint i = 0u; i < range.y; i++) {
+    int light = int(texelFetch(lightIndices, int(range.x + i)).r);
+    vec3 lightPos = texelFetch(lightData, light * 2).xyz;
+    vec4 colorIntensity = texelFetch(lightData, light * 2 + 1);
+    vec3 lightColor = colorIntensity.rgb;
+
     // Calculate light direction and distance from fragment to light
-    vec3 lightDir = normalize(lightBlock.lights[i].position - FragPos);
-    float dist = length(lightBlock.lights[i].position - FragPos);
+    vec3 lightDir = normalize(lightPos - FragPos);
+    float dist = length(lightPos - FragPos);
 
-    // Calculate quadratic attenuation based on distance
+    // Calculate quadratic attenuation based on distance (lightRadius()
+    // solves this for the cutoff, keep them in sync)
     float atten = 1.0 / (1.0 + 0.1 * dist + 0.01 * dist * dist);
 
     // Diffuse component: lambertian shading (dot product of normal and light direction)
     float diff = max(dot(norm, lightDir), 0.0);
-    vec3 diffuse = diff * lightBlock.lights[i].color * diffuseColor.rgb;
+    vec3 diffuse = diff * lightColor * diffuseColor.rgb;
 
     // Blinn-Phong specular: calculate halfway vector between light and view directions
     vec3 halfDir = normalize(lightDir + viewDir);
     float spec = pow(max(dot(norm, halfDir), 0.0), shininess);
-    vec3 specular = spec * specColor.rgb * lightBlock.lights[i].color;
+    vec3 specular = spec * specColor.rgb * lightColor;
 
     // Accumulate lighting contribution with attenuation and intensity
-    totalLight += (diffuse + specular) * atten * lightBlock.lights[i].intensity;
+    totalLight += (diffuse + specular) * atten * colorIntensity.a;
   }
 
   // Combine ambient and accumulated light contributions
   vec3 finalColor = (ambient + totalLight) * texColor;
 
   // if no lights present, use just diffuse color (unlit)
-  if (lightBlock.count == 0) {
+  if (lightCount == 0) {
     finalColor = diffuseColor.rgb;
   }
 
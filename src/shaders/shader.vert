@@ -1,9 +1,55 @@
 #version 330 core
+#ifdef INDIRECT_DRAW
+#extension GL_ARB_shader_storage_buffer_object : require
+#extension GL_ARB_shading_language_420pack : require
+#endif
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec2 aTexCoord;
 layout(location = 2) in vec3 aNormal;
+// White unless static batching baked an entity color in
+layout(location = 13) in vec4 aVertexColor;
+
+#ifdef INDIRECT_DRAW
+// Object table (see indirectDraw.h); the instanced index attribute starts
+// at each command's baseInstance
+struct ObjectData {
+  mat4 model;
+  vec4 normalMatrix[3];
+  vec3 color;
+  float shininess;
+  uint material;
+  float coverage;
+};
+layout(std430, binding = 0) readonly buffer ObjectBlock {
+  ObjectData objects[];
+};
+layout(location = 11) in uint aObjectIndex;
+flat out float Shininess;
+#ifdef MATERIAL_TABLE
+// Material table (see materialTable.h); a mesh's vertices index its
+// entries from the object's first one
+struct MaterialEntry {
+  ivec2 image;
+  ivec2 diffuse;
+  ivec2 specular;
+  float shininess;
+};
+layout(std430, binding = 1) readonly buffer MaterialBlock {
+  MaterialEntry materials[];
+};
+layout(location = 12) in uint aMaterialId;
+// (array, layer) of each texture; array -1 samples the bound texture
+flat out ivec2 ImageSlot;
+flat out ivec2 DiffuseSlot;
+flat out ivec2 SpecularSlot;
+#endif
+#else
+// Per instance (see instanceBuffer.h)
+layout(location = 3) in mat4 aModel;
+layout(location = 7) in vec4 aColor;
+layout(location = 8) in mat3 aNormalMatrix;
+#endif
 
-uniform mat4 model;
 layout(std140) uniform CameraBlock {
   mat4 view;
   mat4 projection;
@@ -12,15 +58,57 @@ layout(std140) uniform CameraBlock {
 out vec3 FaceNormal;
 out vec3 FragPos;
 out vec2 TexCoord;
+out vec3 BaseColor;
+// Distance in front of the camera, picks the light cluster slice
+out float ViewDepth;
+// Fraction of pixels drawn, below 1 while fading out to an impostor
+flat out float Coverage;
 
 void main()
 {
+#ifdef INDIRECT_DRAW
+  ObjectData object = objects[aObjectIndex];
+  mat4 model = object.model;
+  mat3 normalMatrix = mat3(object.normalMatrix[0].xyz,
+                           object.normalMatrix[1].xyz,
+                           object.normalMatrix[2].xyz);
+  vec3 color = object.color;
+  Coverage = object.coverage;
+  Shininess = object.shininess;
+#ifdef MATERIAL_TABLE
+  if (object.material != 0xFFFFFFFFu) {
+    MaterialEntry material = materials[object.material + aMaterialId];
+    ImageSlot = material.image;
+    DiffuseSlot = material.diffuse;
+    SpecularSlot = material.specular;
+    Shininess = material.shininess;
+  } else {
+    ImageSlot = ivec2(-1);
+    DiffuseSlot = ivec2(-1);
+    SpecularSlot = ivec2(-1);
+  }
+#endif
+#else
+  mat4 model = aModel;
+  mat3 normalMatrix = aNormalMatrix;
+  vec3 color = aColor.rgb;
+  Coverage = aColor.a;
+#endif
+
   // world space of the object
   FragPos = vec3(model * vec4(aPos, 1.0));
 
-  // Transform normal to world space
+  // Transform normal to world space. The CPU precomputes the normal matrix;
+  // NORMAL_MATRIX_IN_SHADER restores the per-vertex inverse for comparison.
+#ifdef NORMAL_MATRIX_IN_SHADER
   FaceNormal = mat3(transpose(inverse(model))) * aNormal;
+#else
+  FaceNormal = normalMatrix * aNormal;
+#endif
   TexCoord = aTexCoord;
+  BaseColor = color * aVertexColor.rgb;
 
-  gl_Position = cameraBlock.projection * cameraBlock.view * vec4(FragPos, 1.0);
+  vec4 viewPos = cameraBlock.view * vec4(FragPos, 1.0);
+  ViewDepth = -viewPos.z;
+  gl_Position = cameraBlock.projection * viewPos;
 }
@@ -0,0 +1,213 @@
+#include "staticBatcher.h"
+#include "ecs/registry.h"
+#include "mesh.h"
+#include <algorithm>
+#include <unordered_set>
+
+bool StaticBatcher::canBatch(Registry &reg, int entity,
+                             const glm::vec2 &cellSize) const {
+  const auto &meshComp = reg.getMesh(entity);
+  if (!meshComp || meshComp->staticChunk >= 0 || meshComp->primitive ||
+      !meshComp->mesh->isLoaded())
+    return false;
+  // A chunk has a single level. Meshes too simple to simplify come with
+  // LOD slots that never load and are fine to merge.
+  for (const auto &lod : meshComp->lods) {
+    if (lod->isLoaded())
+      return false;
+  }
+
+  // Anything animated, or attached to something animated, moves
+  for (int id = entity; id >= 0; id = reg.getTransform(id).parentId) {
+    if (reg.getSineAnimator(id) || reg.getRotationAnimator(id) ||
+        reg.getParametricAnimator(id) || reg.getCamera(id))
+      return false;
+  }
+
+  // A chunk's bounds are its cell; something bigger would only make them
+  // looser
+  glm::mat4 model = reg.getTransform(entity).matrix * meshComp->localMatrix;
+  AABB box = transformAABB(meshComp->mesh->getBounds(), model);
+  return box.max.x - box.min.x <= cellSize.x &&
+         box.max.z - box.min.z <= cellSize.y;
+}
+
+void StaticBatcher::build(Registry &reg, const glm::vec2 &min,
+                          const glm::vec2 &max, int cells) {
+  glm::vec2 cellSize = (max - min) / float(cells);
+  std::unordered_set<int> chunkEntities;
+  for (const Chunk &chunk : chunks) {
+    chunkEntities.insert(chunk.entity);
+  }
+
+  // Entity order decides vertex order, keep it stable between runs
+  std::vector<int> ids(reg.getMeshEntityIds().begin(),
+                       reg.getMeshEntityIds().end());
+  std::sort(ids.begin(), ids.end());
+
+  std::vector<size_t> touched;
+  for (int id : ids) {
+    if (chunkEntities.count(id) || !canBatch(reg, id, cellSize))
+      continue;
+    glm::vec3 position = reg.getTransform(id).matrix[3];
+    glm::vec2 local = (glm::vec2(position.x, position.z) - min) / cellSize;
+    if (local.x < 0.f || local.y < 0.f || local.x >= float(cells) ||
+        local.y >= float(cells))
+      continue;
+    int cell = int(local.x) + int(local.y) * cells;
+
+    const Texture *image = reg.getMesh(id)->mesh->getImageTexture().get();
+    size_t index = 0;
+    while (index < chunks.size() && (chunks[index].cell != cell ||
+                                     chunks[index].imageTexture != image)) {
+      ++index;
+    }
+    if (index == chunks.size()) {
+      int entity = reg.createEntity();
+      reg.setTransform(entity, {{0, 0, 0}, {0, 0, 0}, {1, 1, 1}, -1});
+      chunks.push_back({entity, cell, image, {}});
+    }
+    chunks[index].members.push_back(id);
+    if (std::find(touched.begin(), touched.end(), index) == touched.end()) {
+      touched.push_back(index);
+    }
+
+    MeshComp meshComp = *reg.getMesh(id);
+    meshComp.staticChunk = int(index);
+    reg.setMesh(id, meshComp);
+  }
+
+  for (size_t index : touched) {
+    rebuild(reg, chunks[index]);
+  }
+  updateStats(reg);
+}
+
+void StaticBatcher::unbatch(Registry &reg, int entity) {
+  const auto &current = reg.getMesh(entity);
+  if (!current || current->staticChunk < 0)
+    return;
+
+  MeshComp meshComp = *current;
+  Chunk &chunk = chunks[meshComp.staticChunk];
+  chunk.members.erase(
+      std::remove(chunk.members.begin(), chunk.members.end(), entity),
+      chunk.members.end());
+  meshComp.staticChunk = -1;
+  reg.setMesh(entity, meshComp);
+
+  rebuild(reg, chunk);
+  ++stats.rebuilds;
+  updateStats(reg);
+}
+
+void StaticBatcher::rebuild(Registry &reg, Chunk &chunk) {
+  // An empty mesh never counts as loaded, so the BVH drops the chunk
+  auto merged = std::make_shared<Mesh>();
+  if (chunk.members.empty()) {
+    reg.setMesh(chunk.entity, std::optional<MeshComp>({merged}));
+    return;
+  }
+
+  MeshData data;
+  // Distinct materials of the chunk, and the indices drawn with each
+  std::vector<const Material *> materials;
+  std::vector<std::vector<unsigned int>> materialIndices;
+  std::vector<unsigned int> remap;
+  for (int member : chunk.members) {
+    const MeshComp &meshComp = *reg.getMesh(member);
+    const Mesh &mesh = *meshComp.mesh;
+    const Transform &transform = reg.getTransform(member);
+    glm::mat4 model = transform.matrix * meshComp.localMatrix;
+    glm::mat3 normalMatrix =
+        transform.normalMatrix * meshComp.localNormalMatrix;
+
+    remap.clear();
+    for (const Material &material : mesh.getMaterials()) {
+      size_t index = 0;
+      while (index < materials.size() &&
+             (!materials[index]->hasSameTextures(material) ||
+              materials[index]->shininess != material.shininess)) {
+        ++index;
+      }
+      if (index == materials.size()) {
+        materials.push_back(&material);
+        materialIndices.emplace_back();
+      }
+      remap.push_back(static_cast<unsigned int>(index));
+    }
+
+    unsigned char color[3];
+    for (int c = 0; c < 3; ++c) {
+      color[c] = static_cast<unsigned char>(
+          std::clamp(meshComp.color[c], 0.f, 1.f) * 255.f + 0.5f);
+    }
+
+    unsigned int base = static_cast<unsigned int>(data.vertices.size());
+    for (const Vertex &vertex : mesh.getVertices()) {
+      Vertex out = vertex;
+      out.position = glm::vec3(model * glm::vec4(vertex.position, 1.f));
+      glm::vec3 normal = normalMatrix * vertex.normal;
+      float length = glm::length(normal);
+      out.normal = length > 0.f ? normal / length : normal;
+      out.materialId = remap[std::min<size_t>(vertex.materialId,
+                                              remap.size() - 1)];
+      for (int c = 0; c < 3; ++c) {
+        out.color[c] = static_cast<unsigned char>(vertex.color[c] *
+                                                  color[c] / 255);
+      }
+      data.vertices.push_back(out);
+    }
+
+    const std::vector<unsigned int> &indices = mesh.getIndices();
+    for (const Submesh &submesh : mesh.getSubmeshes()) {
+      std::vector<unsigned int> &out = materialIndices[remap[submesh.material]];
+      for (unsigned int i = submesh.first; i < submesh.first + submesh.count;
+           ++i) {
+        out.push_back(base + (mesh.isIndexed() ? indices[i] : i));
+      }
+    }
+  }
+
+  for (size_t m = 0; m < materials.size(); ++m) {
+    Submesh submesh;
+    submesh.material = static_cast<int>(m);
+    submesh.first = static_cast<unsigned int>(data.indices.size());
+    submesh.count = static_cast<unsigned int>(materialIndices[m].size());
+    data.indices.insert(data.indices.end(), materialIndices[m].begin(),
+                        materialIndices[m].end());
+    if (submesh.count > 0) {
+      data.submeshes.push_back(submesh);
+    }
+
+    MaterialData material;
+    material.shininess = materials[m]->shininess;
+    data.materials.push_back(material);
+  }
+
+  // Textures are shared with the members, nothing is copied
+  for (size_t m = 0; m < materials.size(); ++m) {
+    merged->setTexture(materials[m]->diffuse, TextureType::Diffuse, int(m));
+    merged->setTexture(materials[m]->specular, TextureType::Specular, int(m));
+  }
+  merged->setTexture(
+      reg.getMesh(chunk.members.front())->mesh->getImageTexture(),
+      TextureType::Image);
+  merged->upload(data);
+  reg.setMesh(chunk.entity, std::optional<MeshComp>({merged}));
+}
+
+void StaticBatcher::updateStats(Registry &reg) {
+  size_t rebuilds = stats.rebuilds;
+  stats = StaticBatchStats();
+  stats.rebuilds = rebuilds;
+  for (const Chunk &chunk : chunks) {
+    if (chunk.members.empty())
+      continue;
+    const Mesh &mesh = *reg.getMesh(chunk.entity)->mesh;
+    stats.entities += chunk.members.size();
+    ++stats.chunks;
+    stats.vertices += mesh.getVertices().size();
+    stats.indices += mesh.getIndices().size();
+  }
+}
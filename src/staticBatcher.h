@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <glm/ext/vector_float2.hpp>
+#include <vector>
+
+class Registry;
+class Texture;
+
+struct StaticBatchStats {
+  size_t entities = 0; // entities baked into chunks
+  size_t chunks = 0;   // chunk meshes with anything in them
+  size_t vertices = 0;
+  size_t indices = 0;
+  size_t rebuilds = 0; // chunks re-merged after an unbatch
+};
+
+// Load-time merging of meshes that never move. Every such entity's vertices
+// are moved to world space (with its color baked in) and appended to the
+// chunk of its grid cell and image texture; chunks are entities of their
+// own with one submesh per distinct material, so the BVH culls them like
+// any other mesh. Batched entities keep their MeshComp with a handle to the
+// chunk and can be unbatched if they ever need to move.
+class StaticBatcher {
+public:
+  // Batch every loaded, non-animated mesh entity within the square
+  // [min, max] of the XZ plane, split into cells x cells chunks. Entities
+  // larger than a cell or with LOD levels (a chunk has only one) stay as
+  // they are.
+  void build(Registry &reg, const glm::vec2 &min, const glm::vec2 &max,
+             int cells);
+  // Draw the entity on its own again and re-merge the chunk without it
+  void unbatch(Registry &reg, int entity);
+
+  const StaticBatchStats &getStats() const { return stats; }
+
+private:
+  struct Chunk {
+    int entity; // draws the merged mesh
+    int cell;
+    const Texture *imageTexture;
+    std::vector<int> members;
+  };
+
+  bool canBatch(Registry &reg, int entity, const glm::vec2 &cellSize) const;
+  void rebuild(Registry &reg, Chunk &chunk);
+  void updateStats(Registry &reg);
+
+  std::vector<Chunk> chunks; // MeshComp::staticChunk indexes this
+  StaticBatchStats stats;
+};
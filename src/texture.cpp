@@ -0,0 +1,313 @@
+#include "texture.h"
+#include "glState.h"
+#include "textureCooker.h"
+#include <algorithm>
+#include <cstring>
+#include <glm/common.hpp>
+#include <iostream>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../include/stb/stb_image.h"
+
+std::string SamplerSettings::key() const {
+  return std::to_string(wrap) + ":" + std::to_string(minFilter) + ":" +
+         std::to_string(magFilter);
+}
+
+Texture::Texture() : id(0), width(0), height(0), byteSize(0) {
+  glGenTextures(1, &id);
+  uploadSolid(glm::vec3(1.0f));
+}
+
+Texture::~Texture() {
+  if (id) {
+    GLState::get().forgetTexture(id);
+    glDeleteTextures(1, &id);
+  }
+}
+
+void Texture::uploadSolid(const glm::vec3 &color) {
+  unsigned char pixel[] = {
+      static_cast<unsigned char>(glm::clamp(color.r, 0.0f, 1.0f) * 255.0f),
+      static_cast<unsigned char>(glm::clamp(color.g, 0.0f, 1.0f) * 255.0f),
+      static_cast<unsigned char>(glm::clamp(color.b, 0.0f, 1.0f) * 255.0f),
+      255};
+
+  // NOTE: needed to manualy init texter with all params
+  GLState::get().bindTextureForUpload(id);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+               pixel);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+  width = 1;
+  height = 1;
+  byteSize = 4;
+  internalFormat = GL_RGBA8;
+  levelCount = 1;
+  sampler = {GL_REPEAT, GL_NEAREST, GL_NEAREST};
+  streamed = false;
+  ++version;
+}
+
+bool Texture::upload(const ImageData &image, const SamplerSettings &sampler) {
+  if (image.pixels.empty()) {
+    uploadSolid(glm::vec3(1.0f));
+    return false;
+  }
+
+  // Check max texture size
+  GLint maxSize = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+  if (image.width > maxSize || image.height > maxSize) {
+    std::cerr << "Texture is " << image.width << "x" << image.height
+              << " which exceeds GL_MAX_TEXTURE_SIZE (" << maxSize
+              << "). Falling back to white texture.\n";
+    uploadSolid(glm::vec3(1.0f));
+    return false;
+  }
+
+  GLState::get().bindTextureForUpload(id);
+
+  // Texture parameters
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler.wrap);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler.wrap);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sampler.minFilter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampler.magFilter);
+
+  // Pixel alignment for arbitrary widths
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+  GLenum format = GL_RGB;
+  GLenum internalFormat = GL_RGB8;
+  if (image.channels == 1) {
+    format = GL_RED;
+    internalFormat = GL_R8;
+  } else if (image.channels == 3) {
+    format = GL_RGB;
+    internalFormat = GL_RGB8;
+  } else if (image.channels == 4) {
+    format = GL_RGBA;
+    internalFormat = GL_RGBA8;
+  } else {
+    // Unexpected channel count — treat as RGBA
+    format = GL_RGBA;
+    internalFormat = GL_RGBA8;
+  }
+
+  // Upload and generate mipmaps
+  glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0,
+               format, GL_UNSIGNED_BYTE, image.pixels.data());
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000);
+  if (sampler.usesMipmaps()) {
+    glGenerateMipmap(GL_TEXTURE_2D);
+  }
+
+  width = image.width;
+  height = image.height;
+  // A full mip chain adds 1/3
+  byteSize = levelBytes(internalFormat, width, height);
+  levelCount = 1;
+  if (sampler.usesMipmaps()) {
+    byteSize += byteSize / 3;
+    for (int size = std::max(width, height); size > 1; size /= 2) {
+      ++levelCount;
+    }
+  }
+  this->internalFormat = internalFormat;
+  this->sampler = sampler;
+  streamed = false;
+  ++version;
+  return true;
+}
+
+static GLenum cookedInternalFormat(CookedFormat format) {
+  switch (format) {
+  case CookedFormat::BC1:
+    return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+  case CookedFormat::R8:
+    return GL_R8;
+  case CookedFormat::RGB8:
+    return GL_RGB8;
+  default:
+    return GL_RGBA8;
+  }
+}
+
+size_t Texture::levelBytes(GLenum internalFormat, int width, int height) {
+  if (internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) {
+    return size_t((width + 3) / 4) * ((height + 3) / 4) * 8;
+  }
+  return size_t(width) * height * (internalFormat == GL_R8 ? 1 : 4);
+}
+
+size_t Texture::levelBytes(const CookedTexture &cooked, int level) {
+  const CookedLevel &info = cooked.getLevel(level);
+  return levelBytes(cookedInternalFormat(cooked.getFormat()), info.width,
+                    info.height);
+}
+
+// glTexImage2D / glCompressedTexImage2D for one cooked level
+static void specifyCookedLevel(CookedFormat format, int glLevel,
+                               const CookedLevel &info,
+                               const unsigned char *data) {
+  GLenum internalFormat = cookedInternalFormat(format);
+  if (format == CookedFormat::BC1) {
+    glCompressedTexImage2D(GL_TEXTURE_2D, glLevel, internalFormat, info.width,
+                           info.height, 0, info.size, data);
+    return;
+  }
+
+  GLenum pixelFormat = GL_RGBA;
+  if (format == CookedFormat::R8) {
+    pixelFormat = GL_RED;
+  } else if (format == CookedFormat::RGB8) {
+    pixelFormat = GL_RGB;
+  }
+  glTexImage2D(GL_TEXTURE_2D, glLevel, internalFormat, info.width, info.height,
+               0, pixelFormat, GL_UNSIGNED_BYTE, data);
+}
+
+static void applySampler(const SamplerSettings &sampler) {
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler.wrap);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler.wrap);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sampler.minFilter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampler.magFilter);
+}
+
+bool Texture::upload(const CookedTexture &cooked,
+                     const SamplerSettings &sampler) {
+  CookedFormat format = cooked.getFormat();
+  if (format == CookedFormat::BC1 && !supportsBC1()) {
+    std::cerr << "BC1 textures are not supported by this driver\n";
+    uploadSolid(glm::vec3(1.0f));
+    return false;
+  }
+
+  GLint maxSize = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+  // Skip levels the driver can't hold instead of falling back to white
+  int first = 0;
+  while (first < cooked.getLevelCount() - 1 &&
+         int(std::max(cooked.getLevel(first).width,
+                      cooked.getLevel(first).height)) > maxSize) {
+    ++first;
+  }
+  int last = sampler.usesMipmaps() ? cooked.getLevelCount() - 1 : first;
+
+  GLState::get().bindTextureForUpload(id);
+  applySampler(sampler);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, last - first);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+  byteSize = 0;
+  for (int level = first; level <= last; ++level) {
+    specifyCookedLevel(format, level - first, cooked.getLevel(level),
+                       cooked.getLevelData(level));
+    byteSize += levelBytes(cooked, level);
+  }
+
+  width = cooked.getLevel(first).width;
+  height = cooked.getLevel(first).height;
+  internalFormat = cookedInternalFormat(format);
+  levelCount = last - first + 1;
+  this->sampler = sampler;
+  streamed = false;
+  ++version;
+  return true;
+}
+
+void Texture::beginStreaming(const CookedTexture &cooked,
+                             const SamplerSettings &sampler) {
+  GLState::get().bindTextureForUpload(id);
+  // Free the placeholder so only streamed levels take memory
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+               nullptr);
+  applySampler(sampler);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL,
+                  cooked.getLevelCount() - 1);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL,
+                  cooked.getLevelCount() - 1);
+
+  width = cooked.getWidth();
+  height = cooked.getHeight();
+  byteSize = 0;
+  internalFormat = cookedInternalFormat(cooked.getFormat());
+  levelCount = cooked.getLevelCount();
+  this->sampler = sampler;
+  streamed = true;
+  ++version;
+}
+
+void Texture::uploadLevel(const CookedTexture &cooked, int level,
+                          const unsigned char *data) {
+  GLState::get().bindTextureForUpload(id);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  specifyCookedLevel(cooked.getFormat(), level, cooked.getLevel(level), data);
+  byteSize += levelBytes(cooked, level);
+}
+
+void Texture::dropLevel(const CookedTexture &cooked, int level) {
+  // A 0x0 image releases the level's storage
+  GLState::get().bindTextureForUpload(id);
+  glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, nullptr);
+  byteSize -= levelBytes(cooked, level);
+}
+
+void Texture::setBaseLevel(int level) {
+  GLState::get().bindTextureForUpload(id);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+}
+
+bool Texture::supportsBC1() {
+  static int supported = -1;
+  if (supported < 0) {
+    supported = 0;
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i) {
+      const char *name =
+          reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i));
+      if (name && std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0) {
+        supported = 1;
+        break;
+      }
+    }
+  }
+  return supported == 1;
+}
+
+static std::shared_ptr<Texture> whiteTexture;
+
+const std::shared_ptr<Texture> &Texture::white() {
+  if (!whiteTexture) {
+    whiteTexture = std::make_shared<Texture>();
+  }
+  return whiteTexture;
+}
+
+void Texture::releaseWhite() { whiteTexture.reset(); }
+
+bool Texture::loadImage(const std::string &path, ImageData &out) {
+  int width = 0, height = 0, nrChannels = 0;
+  unsigned char *data =
+      stbi_load(path.c_str(), &width, &height, &nrChannels, 0);
+  if (!data) {
+    std::cerr << "Failed to load texture: " << path << std::endl;
+    return false;
+  }
+
+  out.width = width;
+  out.height = height;
+  out.channels = nrChannels;
+  out.pixels.assign(data, data + size_t(width) * height * nrChannels);
+  stbi_image_free(data);
+  return true;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "../include/glad/glad.h"
+#include <cstddef>
+#include <cstdint>
+#include <glm/ext/vector_float3.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Not part of the GL 3.3 core header
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+class CookedTexture;
+
+// Decoded image pixels, ready for glTexImage2D
+struct ImageData {
+  int width = 0;
+  int height = 0;
+  int channels = 0;
+  std::vector<unsigned char> pixels;
+};
+
+// Sampler state baked into a texture object. Part of the texture cache key, so
+// the same image sampled two different ways gets two textures.
+struct SamplerSettings {
+  GLint wrap = GL_REPEAT;
+  GLint minFilter = GL_LINEAR_MIPMAP_LINEAR;
+  GLint magFilter = GL_LINEAR;
+
+  bool usesMipmaps() const {
+    return minFilter != GL_NEAREST && minFilter != GL_LINEAR;
+  }
+  std::string key() const;
+};
+
+// Owns one GL_TEXTURE_2D. Starts out as a 1x1 white placeholder so it can be
+// bound while the real image is still decoding.
+class Texture {
+public:
+  Texture();
+  ~Texture();
+
+  // Prevent copying/moving (OpenGL resources must stay in one place)
+  Texture(const Texture &) = delete;
+  Texture &operator=(const Texture &) = delete;
+  Texture(Texture &&) = delete;
+  Texture &operator=(Texture &&) = delete;
+
+  // Replace the contents with a decoded image. Falls back to white and
+  // returns false if the image is empty or too large for the driver.
+  bool upload(const ImageData &image, const SamplerSettings &sampler = {});
+
+  // Upload every mip level of a cooked texture as stored, no mip generation
+  bool upload(const CookedTexture &cooked, const SamplerSettings &sampler = {});
+
+  // Streaming: mip levels of a cooked texture are specified one at a time,
+  // using the cooked level numbers, and GL_TEXTURE_BASE_LEVEL points at the
+  // largest resident one. beginStreaming() resets the texture to no levels.
+  void beginStreaming(const CookedTexture &cooked,
+                      const SamplerSettings &sampler = {});
+  void uploadLevel(const CookedTexture &cooked, int level,
+                   const unsigned char *data);
+  void dropLevel(const CookedTexture &cooked, int level);
+  void setBaseLevel(int level);
+
+  // Replace the contents with a single pixel of the given color
+  void uploadSolid(const glm::vec3 &color);
+
+  // Shared 1x1 white texture bound for every unset material slot. Solid
+  // colors come from the per-instance color attribute instead of a texture.
+  static const std::shared_ptr<Texture> &white();
+  // Drop the shared reference while the GL context is still alive, so the
+  // texture goes away with the last mesh using it instead of at exit
+  static void releaseWhite();
+
+  // GL_EXT_texture_compression_s3tc is available for BC1 cooked textures
+  static bool supportsBC1();
+
+  // Bytes one level takes in VRAM, counting RGB8 as padded to 4 bytes per
+  // texel. Everything that budgets texture memory counts with these.
+  static size_t levelBytes(GLenum internalFormat, int width, int height);
+  static size_t levelBytes(const CookedTexture &cooked, int level);
+
+  // Decode an image file with stb_image. CPU only, safe on any thread.
+  static bool loadImage(const std::string &path, ImageData &out);
+
+  unsigned int getId() const { return id; }
+  int getWidth() const { return width; }
+  int getHeight() const { return height; }
+  // Approximate VRAM footprint including the mip chain
+  size_t getByteSize() const { return byteSize; }
+  // What copies of the texture (MaterialTable's arrays) need to match
+  GLenum getInternalFormat() const { return internalFormat; }
+  int getLevelCount() const { return levelCount; }
+  const SamplerSettings &getSampler() const { return sampler; }
+  // Bumped whenever the contents change, so copies know to refresh
+  uint32_t getVersion() const { return version; }
+  // Streamed textures change levels every few frames and are never copied
+  bool isStreamed() const { return streamed; }
+
+private:
+  unsigned int id;
+  int width, height;
+  size_t byteSize;
+  GLenum internalFormat = GL_RGBA8;
+  int levelCount = 0; // levels 0..levelCount-1 hold the full image
+  SamplerSettings sampler;
+  uint32_t version = 0;
+  bool streamed = false;
+};
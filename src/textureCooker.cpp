@@ -0,0 +1,476 @@
+#include "textureCooker.h"
+#include "../include/stb/stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Rows below this many output pixels are filtered on the calling thread
+constexpr int PARALLEL_MIN_PIXELS = 256 * 256;
+constexpr size_t LEVEL_ALIGNMENT = 16;
+// Largest width or height a cooked texture may claim
+constexpr uint32_t MAX_COOKED_DIMENSION = 1 << 16;
+
+// Splits [0, count) into one contiguous range per thread
+static void parallelFor(int count, int threads,
+                        const std::function<void(int, int)> &fn) {
+  if (threads <= 1 || count < threads) {
+    fn(0, count);
+    return;
+  }
+
+  std::vector<std::thread> pool;
+  int chunk = (count + threads - 1) / threads;
+  for (int begin = 0; begin < count; begin += chunk) {
+    int end = std::min(count, begin + chunk);
+    pool.emplace_back(fn, begin, end);
+  }
+  for (auto &t : pool) {
+    t.join();
+  }
+}
+
+static void downsampleRows(const unsigned char *src, int srcWidth,
+                           int srcHeight, int channels, unsigned char *dst,
+                           int dstWidth, int rowBegin, int rowEnd) {
+  for (int y = rowBegin; y < rowEnd; ++y) {
+    // Odd sizes clamp to the last row/column instead of reading past it
+    const unsigned char *r0 =
+        src + size_t(std::min(2 * y, srcHeight - 1)) * srcWidth * channels;
+    const unsigned char *r1 =
+        src + size_t(std::min(2 * y + 1, srcHeight - 1)) * srcWidth * channels;
+    unsigned char *out = dst + size_t(y) * dstWidth * channels;
+
+    int x = 0;
+#ifdef __SSE2__
+    // 4 RGBA output pixels (8 source pixels per row) per iteration
+    if (channels == 4 && srcWidth >= 2) {
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i round = _mm_set1_epi16(2);
+      int simdEnd = std::min(dstWidth, srcWidth / 2) & ~3;
+      for (; x < simdEnd; x += 4) {
+        const unsigned char *a = r0 + x * 8;
+        const unsigned char *b = r1 + x * 8;
+        __m128i a0 = _mm_loadu_si128((const __m128i *)a);
+        __m128i a1 = _mm_loadu_si128((const __m128i *)(a + 16));
+        __m128i b0 = _mm_loadu_si128((const __m128i *)b);
+        __m128i b1 = _mm_loadu_si128((const __m128i *)(b + 16));
+
+        // vertical sums, widened to 16 bits: 2 source pixels per register
+        __m128i v0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero),
+                                   _mm_unpacklo_epi8(b0, zero));
+        __m128i v1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero),
+                                   _mm_unpackhi_epi8(b0, zero));
+        __m128i v2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero),
+                                   _mm_unpacklo_epi8(b1, zero));
+        __m128i v3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero),
+                                   _mm_unpackhi_epi8(b1, zero));
+
+        // horizontal sums: add the upper pixel onto the lower one
+        v0 = _mm_add_epi16(v0, _mm_srli_si128(v0, 8));
+        v1 = _mm_add_epi16(v1, _mm_srli_si128(v1, 8));
+        v2 = _mm_add_epi16(v2, _mm_srli_si128(v2, 8));
+        v3 = _mm_add_epi16(v3, _mm_srli_si128(v3, 8));
+
+        __m128i lo = _mm_srli_epi16(
+            _mm_add_epi16(_mm_unpacklo_epi64(v0, v1), round), 2);
+        __m128i hi = _mm_srli_epi16(
+            _mm_add_epi16(_mm_unpacklo_epi64(v2, v3), round), 2);
+        _mm_storeu_si128((__m128i *)(out + x * 4), _mm_packus_epi16(lo, hi));
+      }
+    }
+#endif
+
+    for (; x < dstWidth; ++x) {
+      int x0 = std::min(2 * x, srcWidth - 1) * channels;
+      int x1 = std::min(2 * x + 1, srcWidth - 1) * channels;
+      for (int c = 0; c < channels; ++c) {
+        out[x * channels + c] = static_cast<unsigned char>(
+            (r0[x0 + c] + r0[x1 + c] + r1[x0 + c] + r1[x1 + c] + 2) >> 2);
+      }
+    }
+  }
+}
+
+void downsampleBox(const unsigned char *src, int srcWidth, int srcHeight,
+                   int channels, unsigned char *dst, int threads) {
+  int dstWidth = std::max(1, srcWidth / 2);
+  int dstHeight = std::max(1, srcHeight / 2);
+  if (dstWidth * dstHeight < PARALLEL_MIN_PIXELS) {
+    threads = 1;
+  }
+
+  parallelFor(dstHeight, threads, [&](int begin, int end) {
+    downsampleRows(src, srcWidth, srcHeight, channels, dst, dstWidth, begin,
+                   end);
+  });
+}
+
+// 5:6:5 packing and unpacking for BC1 endpoints
+static uint16_t packRGB565(const int rgb[3]) {
+  return uint16_t(((rgb[0] * 31 + 127) / 255) << 11 |
+                  ((rgb[1] * 63 + 127) / 255) << 5 |
+                  ((rgb[2] * 31 + 127) / 255));
+}
+
+static void unpackRGB565(uint16_t c, int rgb[3]) {
+  int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+  rgb[0] = (r << 3) | (r >> 2);
+  rgb[1] = (g << 2) | (g >> 4);
+  rgb[2] = (b << 3) | (b >> 2);
+}
+
+// Bounding box endpoint fit, inset by 1/16 of the range to reduce error
+static void encodeBC1Block(const unsigned char block[16][3],
+                           unsigned char *out) {
+  int lo[3] = {255, 255, 255}, hi[3] = {0, 0, 0};
+  for (int i = 0; i < 16; ++i) {
+    for (int c = 0; c < 3; ++c) {
+      lo[c] = std::min(lo[c], int(block[i][c]));
+      hi[c] = std::max(hi[c], int(block[i][c]));
+    }
+  }
+  for (int c = 0; c < 3; ++c) {
+    int inset = (hi[c] - lo[c]) / 16;
+    lo[c] += inset;
+    hi[c] -= inset;
+  }
+
+  uint16_t c0 = packRGB565(hi), c1 = packRGB565(lo);
+  uint32_t indices = 0;
+  if (c0 < c1) {
+    std::swap(c0, c1);
+  }
+
+  if (c0 != c1) {
+    // c0 > c1 selects the 4 color mode
+    int palette[4][3];
+    unpackRGB565(c0, palette[0]);
+    unpackRGB565(c1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    for (int i = 0; i < 16; ++i) {
+      int best = 0, bestDist = 1 << 30;
+      for (int p = 0; p < 4; ++p) {
+        int dist = 0;
+        for (int c = 0; c < 3; ++c) {
+          int d = int(block[i][c]) - palette[p][c];
+          dist += d * d;
+        }
+        if (dist < bestDist) {
+          bestDist = dist;
+          best = p;
+        }
+      }
+      indices |= uint32_t(best) << (2 * i);
+    }
+  }
+
+  out[0] = c0 & 0xFF;
+  out[1] = c0 >> 8;
+  out[2] = c1 & 0xFF;
+  out[3] = c1 >> 8;
+  std::memcpy(out + 4, &indices, 4);
+}
+
+std::vector<unsigned char> compressBC1(const unsigned char *pixels, int width,
+                                       int height, int channels) {
+  int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+  std::vector<unsigned char> out(size_t(blocksX) * blocksY * 8);
+
+  for (int by = 0; by < blocksY; ++by) {
+    for (int bx = 0; bx < blocksX; ++bx) {
+      unsigned char block[16][3];
+      for (int i = 0; i < 16; ++i) {
+        // Partial blocks at the edge repeat the last row/column
+        int x = std::min(bx * 4 + i % 4, width - 1);
+        int y = std::min(by * 4 + i / 4, height - 1);
+        const unsigned char *p = pixels + (size_t(y) * width + x) * channels;
+        block[i][0] = p[0];
+        block[i][1] = p[1];
+        block[i][2] = p[2];
+      }
+      encodeBC1Block(block, &out[(size_t(by) * blocksX + bx) * 8]);
+    }
+  }
+  return out;
+}
+
+bool cookTexture(const std::string &srcPath, const std::string &dstPath,
+                 const CookOptions &options) {
+  int width = 0, height = 0, channels = 0;
+  unsigned char *decoded =
+      stbi_load(srcPath.c_str(), &width, &height, &channels, 0);
+  if (!decoded) {
+    std::cerr << "Failed to cook texture: " << srcPath << std::endl;
+    return false;
+  }
+  if (channels == 2) {
+    // No 2 channel format in the container, expand to RGBA
+    stbi_image_free(decoded);
+    decoded = stbi_load(srcPath.c_str(), &width, &height, &channels, 4);
+    if (!decoded) {
+      std::cerr << "Failed to cook texture: " << srcPath << std::endl;
+      return false;
+    }
+    channels = 4;
+  }
+
+  int threads = options.threads > 0
+                    ? options.threads
+                    : std::max(1u, std::thread::hardware_concurrency());
+
+  // Full mip chain down to 1x1, largest first
+  std::vector<std::vector<unsigned char>> mips;
+  std::vector<std::pair<int, int>> sizes;
+  mips.emplace_back(decoded, decoded + size_t(width) * height * channels);
+  sizes.push_back({width, height});
+  stbi_image_free(decoded);
+
+  while (sizes.back().first > 1 || sizes.back().second > 1) {
+    auto [w, h] = sizes.back();
+    int nw = std::max(1, w / 2), nh = std::max(1, h / 2);
+    std::vector<unsigned char> next(size_t(nw) * nh * channels);
+    downsampleBox(mips.back().data(), w, h, channels, next.data(), threads);
+    mips.push_back(std::move(next));
+    sizes.push_back({nw, nh});
+  }
+
+  CookedFormat format = CookedFormat(channels);
+  if (options.compressBC1 && channels >= 3) {
+    format = CookedFormat::BC1;
+    parallelFor((int)mips.size(), threads, [&](int begin, int end) {
+      for (int i = begin; i < end; ++i) {
+        mips[i] = compressBC1(mips[i].data(), sizes[i].first, sizes[i].second,
+                              channels);
+      }
+    });
+  }
+
+  CookedHeader header{};
+  std::memcpy(header.magic, COOKED_TEXTURE_MAGIC, 4);
+  header.version = COOKED_TEXTURE_VERSION;
+  header.format = uint32_t(format);
+  header.width = width;
+  header.height = height;
+  header.levelCount = mips.size();
+
+  std::vector<CookedLevel> levels(mips.size());
+  uint64_t offset = sizeof(CookedHeader) + sizeof(CookedLevel) * levels.size();
+  for (size_t i = 0; i < mips.size(); ++i) {
+    offset = (offset + LEVEL_ALIGNMENT - 1) / LEVEL_ALIGNMENT * LEVEL_ALIGNMENT;
+    levels[i] = {offset, mips[i].size(), uint32_t(sizes[i].first),
+                 uint32_t(sizes[i].second)};
+    offset += mips[i].size();
+  }
+
+  // Write next to the target and rename, so readers never see half a file
+  std::error_code ec;
+  fs::create_directories(fs::path(dstPath).parent_path(), ec);
+  std::ostringstream tmpName;
+  tmpName << dstPath << ".tmp" << std::this_thread::get_id();
+  std::string tmpPath = tmpName.str();
+
+  std::ofstream file(tmpPath, std::ios::binary);
+  if (!file) {
+    std::cerr << "Failed to write cooked texture: " << tmpPath << std::endl;
+    return false;
+  }
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char *>(levels.data()),
+             sizeof(CookedLevel) * levels.size());
+  for (size_t i = 0; i < mips.size(); ++i) {
+    std::vector<char> pad(levels[i].offset - file.tellp(), 0);
+    file.write(pad.data(), pad.size());
+    file.write(reinterpret_cast<const char *>(mips[i].data()), mips[i].size());
+  }
+  file.close();
+
+  fs::rename(tmpPath, dstPath, ec);
+  if (ec) {
+    std::cerr << "Failed to write cooked texture: " << dstPath << std::endl;
+    fs::remove(tmpPath, ec);
+    return false;
+  }
+  return true;
+}
+
+std::string cookedTexturePath(const std::string &srcPath, bool compressBC1) {
+  std::error_code ec;
+  std::string canonical = fs::weakly_canonical(srcPath, ec).string();
+  if (ec) {
+    canonical = srcPath;
+  }
+
+  std::ostringstream name;
+  name << "cache/textures/" << std::hex << std::hash<std::string>{}(canonical)
+       << (compressBC1 ? ".bc1" : "") << ".tex";
+  return name.str();
+}
+
+bool isCookedTextureFresh(const std::string &srcPath,
+                          const std::string &dstPath) {
+  std::error_code ec;
+  auto dstTime = fs::last_write_time(dstPath, ec);
+  if (ec)
+    return false;
+  auto srcTime = fs::last_write_time(srcPath, ec);
+  if (ec)
+    return false;
+  return dstTime >= srcTime;
+}
+
+// Bytes a level of the given format and size holds, 0 for unknown formats
+static uint64_t cookedLevelSize(uint32_t format, uint64_t width,
+                                uint64_t height) {
+  switch (CookedFormat(format)) {
+  case CookedFormat::R8:
+  case CookedFormat::RGB8:
+  case CookedFormat::RGBA8:
+    return width * height * format;
+  case CookedFormat::BC1:
+    return (width + 3) / 4 * ((height + 3) / 4) * 8;
+  }
+  return 0;
+}
+
+CookedTexture::~CookedTexture() {
+  if (data)
+    munmap(const_cast<unsigned char *>(data), size);
+}
+
+bool CookedTexture::open(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(CookedHeader)) {
+    ::close(fd);
+    return false;
+  }
+
+  void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapped == MAP_FAILED)
+    return false;
+
+  data = static_cast<const unsigned char *>(mapped);
+  size = st.st_size;
+  header = reinterpret_cast<const CookedHeader *>(data);
+  levels = reinterpret_cast<const CookedLevel *>(data + sizeof(CookedHeader));
+
+  // Reject anything that would make us read outside the mapping
+  bool valid = std::memcmp(header->magic, COOKED_TEXTURE_MAGIC, 4) == 0 &&
+               header->version == COOKED_TEXTURE_VERSION &&
+               header->levelCount > 0 && header->levelCount <= 32 &&
+               header->width <= MAX_COOKED_DIMENSION &&
+               header->height <= MAX_COOKED_DIMENSION &&
+               sizeof(CookedHeader) + sizeof(CookedLevel) * header->levelCount <=
+                   size;
+  // Every level must hold exactly the bytes the upload will read for it
+  for (uint32_t i = 0; valid && i < header->levelCount; ++i) {
+    const CookedLevel &level = levels[i];
+    uint64_t expected =
+        cookedLevelSize(header->format, level.width, level.height);
+    valid = level.width > 0 && level.height > 0 &&
+            level.width <= header->width && level.height <= header->height &&
+            expected > 0 && level.size == expected && level.offset <= size &&
+            level.size <= size - level.offset;
+  }
+  if (!valid) {
+    std::cerr << "Invalid cooked texture: " << path << std::endl;
+    munmap(mapped, size);
+    data = nullptr;
+    header = nullptr;
+    levels = nullptr;
+    return false;
+  }
+  return true;
+}
+
+// Page in [begin, begin + length) of a mapping
+static void touchPages(const unsigned char *begin, size_t length) {
+  long pageSize = sysconf(_SC_PAGESIZE);
+  // madvise wants a page aligned start
+  uintptr_t address = reinterpret_cast<uintptr_t>(begin);
+  uintptr_t aligned = address & ~uintptr_t(pageSize - 1);
+  length += address - aligned;
+  madvise(reinterpret_cast<void *>(aligned), length, MADV_WILLNEED);
+
+  // Touch every page so the upload on the main thread never blocks on I/O
+  const unsigned char *start = reinterpret_cast<const unsigned char *>(aligned);
+  volatile unsigned char sink = 0;
+  for (size_t i = 0; i < length; i += pageSize) {
+    sink = sink + start[i];
+  }
+}
+
+void CookedTexture::prefetch() const { touchPages(data, size); }
+
+void CookedTexture::prefetchLevel(int level) const {
+  touchPages(getLevelData(level), levels[level].size);
+}
+
+int runCookTool(const std::vector<std::string> &args) {
+  CookOptions options;
+  std::vector<std::string> inputs;
+  for (const auto &arg : args) {
+    if (arg == "--bc1") {
+      options.compressBC1 = true;
+    } else {
+      inputs.push_back(arg);
+    }
+  }
+
+  if (inputs.empty()) {
+    std::cerr << "usage: --cook [--bc1] <image>..." << std::endl;
+    return 1;
+  }
+
+  int failed = 0;
+  for (const auto &src : inputs) {
+    std::string dst = cookedTexturePath(src, options.compressBC1);
+
+    auto start = std::chrono::steady_clock::now();
+    bool ok = cookTexture(src, dst, options);
+    float ms = std::chrono::duration<float, std::milli>(
+                   std::chrono::steady_clock::now() - start)
+                   .count();
+
+    CookedTexture cooked;
+    if (!ok || !cooked.open(dst)) {
+      ++failed;
+      continue;
+    }
+
+    uint64_t bytes = 0;
+    for (int i = 0; i < cooked.getLevelCount(); ++i) {
+      bytes += cooked.getLevel(i).size;
+    }
+    std::cerr << src << " -> " << dst << ": " << cooked.getWidth() << "x"
+              << cooked.getHeight() << ", " << cooked.getLevelCount()
+              << " levels, " << bytes / 1024 << " KiB, " << ms << " ms"
+              << std::endl;
+  }
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// On-disk layout of a cooked texture (".tex"): a header, one CookedLevel per
+// mip (largest first), then the level data. Levels are stored exactly as
+// glTexImage2D / glCompressedTexImage2D expect them.
+constexpr char COOKED_TEXTURE_MAGIC[4] = {'T', 'E', 'X', 'C'};
+constexpr uint32_t COOKED_TEXTURE_VERSION = 1;
+
+enum class CookedFormat : uint32_t { R8 = 1, RGB8 = 3, RGBA8 = 4, BC1 = 100 };
+
+struct CookedHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t format;
+  uint32_t width;
+  uint32_t height;
+  uint32_t levelCount;
+};
+
+struct CookedLevel {
+  uint64_t offset; // from start of file
+  uint64_t size;
+  uint32_t width;
+  uint32_t height;
+};
+
+struct CookOptions {
+  bool compressBC1 = false; // RGB(A) sources only, alpha is dropped
+  int threads = 0;          // 0 = hardware concurrency
+};
+
+// Read-only mmap of a cooked texture file
+class CookedTexture {
+public:
+  CookedTexture() = default;
+  ~CookedTexture();
+
+  // Prevent copying/moving (owns the mapping)
+  CookedTexture(const CookedTexture &) = delete;
+  CookedTexture &operator=(const CookedTexture &) = delete;
+  CookedTexture(CookedTexture &&) = delete;
+  CookedTexture &operator=(CookedTexture &&) = delete;
+
+  // Map the file and validate its header and level table
+  bool open(const std::string &path);
+
+  // Ask the kernel to read the whole file in now (call off the main thread)
+  void prefetch() const;
+  // Same for a single mip level
+  void prefetchLevel(int level) const;
+
+  CookedFormat getFormat() const { return CookedFormat(header->format); }
+  int getWidth() const { return header->width; }
+  int getHeight() const { return header->height; }
+  int getLevelCount() const { return header->levelCount; }
+  const CookedLevel &getLevel(int level) const { return levels[level]; }
+  const unsigned char *getLevelData(int level) const {
+    return data + levels[level].offset;
+  }
+
+private:
+  const unsigned char *data = nullptr;
+  size_t size = 0;
+  const CookedHeader *header = nullptr;
+  const CookedLevel *levels = nullptr;
+};
+
+// Decode srcPath, build its full mip chain and write it to dstPath
+bool cookTexture(const std::string &srcPath, const std::string &dstPath,
+                 const CookOptions &options = {});
+
+// Where the cooked copy of srcPath lives ("cache/textures/<hash>.tex")
+std::string cookedTexturePath(const std::string &srcPath, bool compressBC1);
+
+// True if dstPath exists and is newer than srcPath
+bool isCookedTextureFresh(const std::string &srcPath,
+                          const std::string &dstPath);
+
+// One 2x2 box filter step (SSE2 for RGBA), split across threads by rows
+void downsampleBox(const unsigned char *src, int srcWidth, int srcHeight,
+                   int channels, unsigned char *dst, int threads);
+
+// Encode tightly packed RGB/RGBA pixels into BC1 (DXT1) blocks
+std::vector<unsigned char> compressBC1(const unsigned char *pixels, int width,
+                                       int height, int channels);
+
+// "--cook [--bc1] <image>..." tool mode: cooks each image into the cache and
+// reports sizes and timings. Returns the process exit code.
+int runCookTool(const std::vector<std::string> &args);
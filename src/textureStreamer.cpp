@@ -0,0 +1,238 @@
+#include "textureStreamer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+TextureStreamer::TextureStreamer(size_t budgetBytes)
+    : budgetBytes(budgetBytes) {}
+
+bool TextureStreamer::shouldStream(const CookedTexture &cooked,
+                                   const SamplerSettings &sampler) {
+  // Without mipmapped sampling the base level is always the one sampled
+  return sampler.usesMipmaps() && cooked.getLevelCount() > 1 &&
+         std::max(cooked.getWidth(), cooked.getHeight()) >= STREAMING_MIN_SIZE;
+}
+
+void TextureStreamer::add(const std::shared_ptr<Texture> &texture,
+                          const std::shared_ptr<CookedTexture> &cooked,
+                          const SamplerSettings &sampler) {
+  Entry entry;
+  entry.texture = texture;
+  entry.key = texture.get();
+  entry.id = nextId++;
+  entry.cooked = cooked;
+
+  // First level small enough to always keep
+  entry.tailLevel = cooked->getLevelCount() - 1;
+  for (int level = 0; level < cooked->getLevelCount(); ++level) {
+    const CookedLevel &info = cooked->getLevel(level);
+    if (std::max(info.width, info.height) <= STREAMING_TAIL_SIZE) {
+      entry.tailLevel = level;
+      break;
+    }
+  }
+
+  texture->beginStreaming(*cooked, sampler);
+  for (int level = cooked->getLevelCount() - 1; level >= entry.tailLevel;
+       --level) {
+    texture->uploadLevel(*cooked, level, cooked->getLevelData(level));
+    residentBytes += levelBytes(entry, level);
+  }
+  texture->setBaseLevel(entry.tailLevel);
+  entry.residentLevel = entry.tailLevel;
+  entry.wantedLevel = entry.tailLevel;
+  entry.lastUsedFrame = frame;
+
+  // Re-adding the same texture replaces its entry
+  auto it = index.find(entry.key);
+  if (it != index.end()) {
+    Entry &old = entries[it->second];
+    for (int level = old.residentLevel; level < old.cooked->getLevelCount();
+         ++level) {
+      residentBytes -= levelBytes(old, level);
+    }
+    old = std::move(entry);
+  } else {
+    index[entry.key] = entries.size();
+    entries.push_back(std::move(entry));
+  }
+}
+
+void TextureStreamer::requestResolution(const Texture *texture, float pixels) {
+  auto it = index.find(texture);
+  if (it == index.end())
+    return;
+  Entry &entry = entries[it->second];
+  entry.wantedPixels = std::max(entry.wantedPixels, pixels);
+}
+
+int TextureStreamer::getResidentLevel(const Texture *texture) const {
+  auto it = index.find(texture);
+  return it == index.end() ? 0 : entries[it->second].residentLevel;
+}
+
+void TextureStreamer::evictLevel(Entry &entry) {
+  int level = entry.residentLevel;
+  if (auto texture = entry.texture.lock()) {
+    // Move the base past the level before releasing it
+    texture->setBaseLevel(level + 1);
+    texture->dropLevel(*entry.cooked, level);
+  }
+  residentBytes -= levelBytes(entry, level);
+  ++entry.residentLevel;
+  ++levelsEvicted;
+}
+
+void TextureStreamer::rebuildIndex() {
+  index.clear();
+  for (size_t i = 0; i < entries.size(); ++i) {
+    index[entries[i].key] = i;
+  }
+}
+
+void TextureStreamer::update(float budgetMs) {
+  auto start = std::chrono::steady_clock::now();
+  ++frame;
+
+  // Forget textures nobody uses anymore, their GL storage is already gone
+  size_t before = entries.size();
+  for (auto &entry : entries) {
+    if (entry.texture.expired()) {
+      for (int level = entry.residentLevel;
+           level < entry.cooked->getLevelCount(); ++level) {
+        residentBytes -= levelBytes(entry, level);
+      }
+    }
+  }
+  entries.erase(std::remove_if(entries.begin(), entries.end(),
+                               [](const Entry &entry) {
+                                 return entry.texture.expired();
+                               }),
+                entries.end());
+  if (entries.size() != before) {
+    rebuildIndex();
+  }
+
+  // Level whose texels roughly match the requested on-screen size
+  for (auto &entry : entries) {
+    if (entry.wantedPixels > 0.f) {
+      float texels = float(std::max(entry.cooked->getWidth(),
+                                    entry.cooked->getHeight()));
+      int level = int(std::floor(std::log2(texels / entry.wantedPixels)));
+      entry.wantedLevel = std::clamp(level, 0, entry.tailLevel);
+      entry.lastUsedFrame = frame;
+    } else {
+      entry.wantedLevel = entry.tailLevel;
+    }
+    entry.wantedPixels = 0.f;
+  }
+
+  // Upload levels the streaming thread has paged in
+  while (true) {
+    LoadedLevel done;
+    {
+      std::lock_guard<std::mutex> lock(loadedMutex);
+      if (loaded.empty())
+        break;
+      done = loaded.front();
+      loaded.pop_front();
+    }
+    --inFlight;
+    inFlightBytes -= done.bytes;
+
+    auto it = index.find(done.key);
+    if (it == index.end() || entries[it->second].id != done.id)
+      continue; // texture was released while loading
+    Entry &entry = entries[it->second];
+    entry.loading = false;
+
+    auto texture = entry.texture.lock();
+    if (!texture || done.level != entry.residentLevel - 1)
+      continue;
+    texture->uploadLevel(*entry.cooked, done.level,
+                         entry.cooked->getLevelData(done.level));
+    texture->setBaseLevel(done.level);
+    entry.residentLevel = done.level;
+    residentBytes += levelBytes(entry, done.level);
+    ++levelsLoaded;
+
+    float elapsedMs = std::chrono::duration<float, std::milli>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+    if (elapsedMs >= budgetMs)
+      break;
+  }
+
+  // Over budget: drop levels nobody wants first, then the least recently
+  // seen textures, one level at a time
+  while (residentBytes > budgetBytes) {
+    Entry *victim = nullptr;
+    for (auto &entry : entries) {
+      if (entry.residentLevel >= entry.tailLevel)
+        continue;
+      bool surplus = entry.residentLevel < entry.wantedLevel;
+      bool unused = entry.lastUsedFrame < frame;
+      if (!surplus && !unused)
+        continue;
+      if (!victim || entry.lastUsedFrame < victim->lastUsedFrame ||
+          (entry.lastUsedFrame == victim->lastUsedFrame &&
+           levelBytes(entry, entry.residentLevel) >
+               levelBytes(*victim, victim->residentLevel))) {
+        victim = &entry;
+      }
+    }
+    if (!victim)
+      break;
+    evictLevel(*victim);
+  }
+
+  // Queue loads, biggest resolution deficit first
+  std::vector<Entry *> wanting;
+  for (auto &entry : entries) {
+    if (!entry.loading && entry.residentLevel > entry.wantedLevel) {
+      wanting.push_back(&entry);
+    }
+  }
+  std::sort(wanting.begin(), wanting.end(), [](const Entry *a, const Entry *b) {
+    return a->residentLevel - a->wantedLevel >
+           b->residentLevel - b->wantedLevel;
+  });
+
+  for (Entry *entry : wanting) {
+    if (inFlight >= STREAMING_MAX_IN_FLIGHT)
+      break;
+    int level = entry->residentLevel - 1;
+    size_t bytes = levelBytes(*entry, level);
+    if (residentBytes + inFlightBytes + bytes > budgetBytes)
+      continue;
+
+    entry->loading = true;
+    ++inFlight;
+    inFlightBytes += bytes;
+
+    // Only page the level in here: the cooked file is mapped, so the GL
+    // thread uploads straight from the mapping without blocking on I/O
+    streamThread.submit([this, cooked = entry->cooked, key = entry->key,
+                         id = entry->id, level, bytes] {
+      cooked->prefetchLevel(level);
+      std::lock_guard<std::mutex> lock(loadedMutex);
+      loaded.push_back({key, id, level, bytes});
+    });
+  }
+}
+
+StreamingStats TextureStreamer::getStats() const {
+  StreamingStats stats;
+  stats.texturesStreamed = entries.size();
+  stats.bytesResident = residentBytes;
+  stats.bytesBudget = budgetBytes;
+  stats.levelsLoaded = levelsLoaded;
+  stats.levelsEvicted = levelsEvicted;
+  stats.loadsInFlight = inFlight;
+  for (const auto &entry : entries) {
+    if (entry.residentLevel == 0) {
+      ++stats.texturesAtFullRes;
+    }
+  }
+  return stats;
+}
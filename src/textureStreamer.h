@@ -0,0 +1,112 @@
+#pragma once
+
+#include "texture.h"
+#include "textureCooker.h"
+#include "threadPool.h"
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Cooked textures at least this wide or tall are streamed
+constexpr int STREAMING_MIN_SIZE = 1024;
+// Levels this size and smaller are uploaded up front and never evicted
+constexpr int STREAMING_TAIL_SIZE = 128;
+// Loads allowed in flight on the streaming thread at once
+constexpr int STREAMING_MAX_IN_FLIGHT = 4;
+
+struct StreamingStats {
+  size_t texturesStreamed = 0;
+  size_t bytesResident = 0;
+  size_t bytesBudget = 0;
+  size_t levelsLoaded = 0;  // since startup
+  size_t levelsEvicted = 0; // since startup
+  int loadsInFlight = 0;
+  int texturesAtFullRes = 0;
+};
+
+// Keeps large cooked textures partially resident: the small tail mips are
+// uploaded immediately, larger levels are read on a background thread when
+// something on screen wants them, and unused high levels are dropped again
+// once the memory budget is exceeded.
+class TextureStreamer {
+public:
+  explicit TextureStreamer(size_t budgetBytes = 256u << 20);
+
+  // Prevent copying/moving (the streaming thread holds a pointer to this)
+  TextureStreamer(const TextureStreamer &) = delete;
+  TextureStreamer &operator=(const TextureStreamer &) = delete;
+  TextureStreamer(TextureStreamer &&) = delete;
+  TextureStreamer &operator=(TextureStreamer &&) = delete;
+
+  static bool shouldStream(const CookedTexture &cooked,
+                           const SamplerSettings &sampler);
+
+  // Start streaming texture from cooked. Uploads the tail levels right away.
+  void add(const std::shared_ptr<Texture> &texture,
+           const std::shared_ptr<CookedTexture> &cooked,
+           const SamplerSettings &sampler);
+
+  // Something using texture covers about `pixels` pixels on screen this
+  // frame. Unknown (non streamed) textures are ignored.
+  void requestResolution(const Texture *texture, float pixels);
+
+  // Once per frame on the GL thread: pick target levels from this frame's
+  // requests, evict over budget, queue loads and upload finished levels for
+  // at most budgetMs.
+  void update(float budgetMs);
+
+  void setBudget(size_t bytes) { budgetBytes = bytes; }
+  bool isStreamed(const Texture *texture) const {
+    return index.count(texture) != 0;
+  }
+  // Largest resident level of a streamed texture (0 = full resolution)
+  int getResidentLevel(const Texture *texture) const;
+  StreamingStats getStats() const;
+
+private:
+  struct Entry {
+    std::weak_ptr<Texture> texture;
+    const Texture *key;
+    size_t id; // tells a reused Texture address apart from the old one
+    std::shared_ptr<CookedTexture> cooked;
+    int residentLevel; // largest (lowest numbered) level on the GPU
+    int tailLevel;     // this level and smaller are always resident
+    int wantedLevel;
+    float wantedPixels = 0.f; // max requested since the last update
+    size_t lastUsedFrame = 0;
+    bool loading = false;
+  };
+
+  struct LoadedLevel {
+    const Texture *key;
+    size_t id;
+    int level;
+    size_t bytes;
+  };
+
+  size_t levelBytes(const Entry &entry, int level) const {
+    return Texture::levelBytes(*entry.cooked, level);
+  }
+  void evictLevel(Entry &entry);
+  void rebuildIndex();
+
+  std::vector<Entry> entries;
+  std::unordered_map<const Texture *, size_t> index;
+  size_t budgetBytes;
+  size_t residentBytes = 0;
+  size_t inFlightBytes = 0;
+  size_t frame = 0;
+  size_t nextId = 0;
+  size_t levelsLoaded = 0;
+  size_t levelsEvicted = 0;
+  int inFlight = 0;
+
+  std::mutex loadedMutex;
+  std::deque<LoadedLevel> loaded;
+
+  // Declared last so the thread is joined before the queue above goes away
+  ThreadPool streamThread{1};
+};
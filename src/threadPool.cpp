@@ -0,0 +1,52 @@
+#include "threadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t workerCount) {
+  if (workerCount == 0) {
+    unsigned int hw = std::thread::hardware_concurrency();
+    workerCount = std::max(1u, hw > 1 ? hw - 1 : 1u);
+  }
+
+  workers.reserve(workerCount);
+  for (size_t i = 0; i < workerCount; ++i) {
+    workers.emplace_back([this] { workerLoop(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+    // Unstarted jobs are dropped, running ones finish
+    jobs.clear();
+  }
+  cv.notify_all();
+
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> job) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    jobs.push_back(std::move(job));
+  }
+  cv.notify_one();
+}
+
+void ThreadPool::workerLoop() {
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+      if (stopping)
+        return;
+
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+    job();
+  }
+}
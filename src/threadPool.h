@@ -0,0 +1,38 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads pulling jobs off a shared FIFO queue.
+// Jobs must not touch OpenGL: only the main thread owns the context.
+class ThreadPool {
+public:
+  // 0 = one worker per hardware thread (minus the main thread)
+  explicit ThreadPool(size_t workerCount = 0);
+  ~ThreadPool();
+
+  // Prevent copying/moving (workers hold a pointer to this pool)
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+  ThreadPool(ThreadPool &&) = delete;
+  ThreadPool &operator=(ThreadPool &&) = delete;
+
+  // Queue a job to run on the next free worker
+  void submit(std::function<void()> job);
+
+  size_t workerCount() const { return workers.size(); }
+
+private:
+  void workerLoop();
+
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()>> jobs;
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool stopping = false;
+};
@@ -0,0 +1,258 @@
+#include "treeImpostors.h"
+#include "../include/glad/glad.h"
+#include "ecs/registry.h"
+#include "geometryArena.h"
+#include "glState.h"
+#include "mesh.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/scalar_constants.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <iostream>
+
+TreeImpostors::TreeImpostors() {
+  glGenVertexArrays(1, &VAO);
+  glGenBuffers(1, &VBO);
+
+  // Corners come from gl_VertexID, only the per-quad data is an attribute
+  GLState::get().bindVertexArray(VAO);
+  GLState::get().bindBuffer(GL_ARRAY_BUFFER, VBO);
+  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(ImpostorInstance),
+                        (void *)offsetof(ImpostorInstance, centerRadius));
+  glEnableVertexAttribArray(0);
+  glVertexAttribDivisor(0, 1);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(ImpostorInstance),
+                        (void *)offsetof(ImpostorInstance, firstTile));
+  glEnableVertexAttribArray(1);
+  glVertexAttribDivisor(1, 1);
+}
+
+TreeImpostors::~TreeImpostors() {
+  GLState::get().forgetTexture(atlas);
+  GLState::get().forgetBuffer(VBO);
+  GLState::get().forgetVertexArray(VAO);
+  glDeleteTextures(1, &atlas);
+  glDeleteBuffers(1, &VBO);
+  glDeleteVertexArrays(1, &VAO);
+}
+
+bool TreeImpostors::loadShaders() {
+  if (bakeShader.loadShaders({}, "src/shaders/impostorBake.vert",
+                             "src/shaders/impostorBake.frag") !=
+          ShaderResult::Success ||
+      shader.loadShaders({}, "src/shaders/impostor.vert",
+                         "src/shaders/impostor.frag") !=
+          ShaderResult::Success) {
+    std::cerr << "Failed to load impostor shaders" << std::endl;
+    return false;
+  }
+  bakeShader.addUniform("viewProjection");
+  shader.addUniform("cameraPos");
+  shader.addUniform("tileScale");
+  shader.addUniform("tilesPerRow");
+  shader.addUniform("atlas");
+  shader.addUniform("lightCount");
+  shader.bindUniformBlock("CameraBlock", 1);
+  return true;
+}
+
+void TreeImpostors::addTree(const std::vector<int> &entities) {
+  trees.push_back({entities, {}, -1});
+}
+
+bool TreeImpostors::bake(Registry &reg) {
+  // Bounds and instances of every tree, in world space
+  std::vector<InstanceData> bakeData;
+  std::vector<size_t> firstInstance;
+  for (Tree &tree : trees) {
+    firstInstance.push_back(bakeData.size());
+    AABB box;
+    for (int id : tree.entities) {
+      const auto &meshComp = reg.getMesh(id);
+      if (!meshComp || !meshComp->mesh->isLoaded())
+        continue;
+      const Transform &transform = reg.getTransform(id);
+      glm::mat4 model = transform.matrix * meshComp->localMatrix;
+      box.expand(transformAABB(meshComp->mesh->getBounds(), model));
+      bakeData.push_back({model, glm::vec4(meshComp->color, 1.f),
+                          transform.normalMatrix *
+                              meshComp->localNormalMatrix});
+    }
+    // Nothing loaded: radius 0 keeps the tree out of the atlas
+    tree.bounds = {box.center(),
+                   box.isEmpty() ? 0.f : glm::length(box.extent())};
+  }
+  if (bakeData.empty())
+    return false;
+
+  int tiles = int(trees.size()) * IMPOSTOR_VIEWS;
+  rows = (tiles + tilesPerRow - 1) / tilesPerRow;
+  int width = tilesPerRow * IMPOSTOR_TILE_SIZE;
+  int height = rows * IMPOSTOR_TILE_SIZE;
+  int maxSize = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+  if (height > maxSize) {
+    std::cerr << "Too many trees for the impostor atlas (" << height
+              << " rows of pixels, at most " << maxSize << ")" << std::endl;
+    return false;
+  }
+
+  // Color goes into the atlas, depth into a throwaway renderbuffer
+  GLState::get().forgetTexture(atlas);
+  glDeleteTextures(1, &atlas);
+  glGenTextures(1, &atlas);
+  GLState::get().bindTextureForUpload(atlas);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, nullptr);
+  unsigned int depth, framebuffer;
+  glGenRenderbuffers(1, &depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+  glGenFramebuffers(1, &framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         atlas, 0);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                            GL_RENDERBUFFER, depth);
+  bool complete =
+      glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+  GLint viewport[4];
+  GLfloat clearColor[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+
+  if (complete) {
+    // Transparent black around the trees: impostor.frag divides by alpha,
+    // so mips don't darken the edges
+    glViewport(0, 0, width, height);
+    glClearColor(0.f, 0.f, 0.f, 0.f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    bakeShader.use();
+    bakeInstances.upload(bakeData);
+    GeometryArena::get().bindVertexArray();
+    for (size_t t = 0; t < trees.size(); ++t) {
+      Tree &tree = trees[t];
+      int tile = int(t) * IMPOSTOR_VIEWS;
+      tree.firstTile = tree.bounds.radius > 0.f ? tile : -1;
+      if (tree.firstTile < 0)
+        continue;
+      glm::vec3 center = tree.bounds.center;
+      float radius = tree.bounds.radius;
+      glm::mat4 projection =
+          glm::ortho(-radius, radius, -radius, radius, radius, 3.f * radius);
+
+      for (int view = 0; view < IMPOSTOR_VIEWS; ++view, ++tile) {
+        // View k looks from angle k around +y, measured from +z towards +x
+        float angle = 2.f * glm::pi<float>() * view / IMPOSTOR_VIEWS;
+        glm::vec3 direction(std::sin(angle), 0.f, std::cos(angle));
+        glm::mat4 viewProjection =
+            projection * glm::lookAt(center + direction * 2.f * radius,
+                                     center, glm::vec3(0, 1, 0));
+        glUniformMatrix4fv(bakeShader.getUniformLocation("viewProjection"), 1,
+                           GL_FALSE, glm::value_ptr(viewProjection));
+        glViewport((tile % tilesPerRow) * IMPOSTOR_TILE_SIZE,
+                   (tile / tilesPerRow) * IMPOSTOR_TILE_SIZE,
+                   IMPOSTOR_TILE_SIZE, IMPOSTOR_TILE_SIZE);
+
+        size_t instance = firstInstance[t];
+        for (int id : tree.entities) {
+          const auto &meshComp = reg.getMesh(id);
+          if (!meshComp || !meshComp->mesh->isLoaded())
+            continue;
+          const Mesh &mesh = *meshComp->mesh;
+          bakeInstances.bindAttributes(instance++);
+          mesh.drawSubmesh({0, 0, mesh.getElementCount()}, 1);
+        }
+      }
+    }
+  } else {
+    std::cerr << "Impostor framebuffer incomplete" << std::endl;
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glDeleteFramebuffers(1, &framebuffer);
+  glDeleteRenderbuffers(1, &depth);
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+  if (!complete) {
+    for (Tree &tree : trees) {
+      tree.firstTile = -1;
+    }
+    return false;
+  }
+
+  // Mips stop at one texel per tile so neighbouring views never blend
+  int levels = int(std::log2(float(IMPOSTOR_TILE_SIZE)));
+  GLState::get().bindTextureForUpload(atlas);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glGenerateMipmap(GL_TEXTURE_2D);
+
+  stats.trees = trees.size();
+  stats.atlasBytes = size_t(width) * height * 4 * 4 / 3;
+  return true;
+}
+
+void TreeImpostors::update(const glm::vec3 &cameraPos,
+                           const Frustum &frustum, float distance,
+                           float fadeDistance) {
+  instances.clear();
+  stats.impostors = 0;
+  stats.fading = 0;
+  for (const Tree &tree : trees) {
+    if (tree.firstTile < 0)
+      continue;
+
+    // 0 at the impostor distance, 1 once past the fade band
+    float beyond = glm::length(tree.bounds.center - cameraPos) - distance;
+    float fade = std::clamp(beyond / std::max(fadeDistance, 1e-3f), 0.f, 1.f);
+    for (int id : tree.entities) {
+      if (size_t(id) >= coverage.size()) {
+        coverage.resize(id + 1, 1.f);
+      }
+      coverage[id] = 1.f - fade;
+    }
+
+    if (fade > 0.f && frustum.intersects(tree.bounds)) {
+      instances.push_back({glm::vec4(tree.bounds.center, tree.bounds.radius),
+                           float(tree.firstTile), fade});
+      stats.fading += fade < 1.f;
+    }
+  }
+  stats.impostors = instances.size();
+}
+
+void TreeImpostors::draw(const glm::vec3 &cameraPos, int lightCount) {
+  if (instances.empty())
+    return;
+
+  GLState::get().bindBuffer(GL_ARRAY_BUFFER, VBO);
+  if (instances.size() > capacity) {
+    capacity = instances.size() + instances.size() / 2;
+  }
+  glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(ImpostorInstance), nullptr,
+               GL_STREAM_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER, 0,
+                  instances.size() * sizeof(ImpostorInstance),
+                  instances.data());
+
+  shader.use();
+  glUniform3fv(shader.getUniformLocation("cameraPos"), 1,
+               glm::value_ptr(cameraPos));
+  glUniform2f(shader.getUniformLocation("tileScale"), 1.f / tilesPerRow,
+              1.f / rows);
+  glUniform1i(shader.getUniformLocation("tilesPerRow"), tilesPerRow);
+  glUniform1i(shader.getUniformLocation("atlas"), 0);
+  glUniform1i(shader.getUniformLocation("lightCount"), lightCount);
+  GLState::get().bindTexture(0, atlas);
+  GLState::get().bindVertexArray(VAO);
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GLsizei(instances.size()));
+}
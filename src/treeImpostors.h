@@ -0,0 +1,97 @@
+#pragma once
+
+#include "instanceBuffer.h"
+#include "math/bounds.h"
+#include "math/frustum.h"
+#include "shader.h"
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+class Registry;
+
+// Views baked per tree, evenly spaced around the vertical axis. Keep in sync
+// with impostor.vert.
+constexpr int IMPOSTOR_VIEWS = 8;
+// Pixels per view, and the atlas width they are packed into
+constexpr int IMPOSTOR_TILE_SIZE = 128;
+constexpr int IMPOSTOR_ATLAS_WIDTH = 2048;
+
+// Per impostor quad, instanced
+struct ImpostorInstance {
+  glm::vec4 centerRadius;
+  float firstTile; // the tree's view 0 in the atlas
+  float fade;      // fraction of pixels the quad covers
+};
+
+struct ImpostorStats {
+  size_t trees = 0;
+  size_t impostors = 0; // quads drawn last frame
+  size_t fading = 0;    // of those, also drawn as geometry
+  size_t atlasBytes = 0;
+};
+
+// Distant trees as camera-facing quads. Every tree (the entities of its
+// trunk, branches and leaves) is rendered once from IMPOSTOR_VIEWS sides
+// into an atlas; past the impostor distance its quad samples the view
+// nearest the camera. Over the fade distance the geometry is dithered out
+// while the quad is dithered in on the complementary pixels, then the
+// geometry is skipped entirely.
+class TreeImpostors {
+public:
+  TreeImpostors();
+  ~TreeImpostors();
+
+  // Prevent copying/moving (OpenGL resources must stay in one place)
+  TreeImpostors(const TreeImpostors &) = delete;
+  TreeImpostors &operator=(const TreeImpostors &) = delete;
+  TreeImpostors(TreeImpostors &&) = delete;
+  TreeImpostors &operator=(TreeImpostors &&) = delete;
+
+  // Bake and billboard programs; false if either fails to build
+  bool loadShaders();
+
+  void addTree(const std::vector<int> &entities);
+
+  // Render every tree into the atlas. Call once their meshes are loaded and
+  // transforms are up to date; restores the framebuffer and viewport.
+  bool bake(Registry &reg);
+
+  // Pick the impostors to draw and the coverage of every tree entity
+  void update(const glm::vec3 &cameraPos, const Frustum &frustum,
+              float distance, float fadeDistance);
+
+  // Fraction of the entity's pixels its geometry should still cover
+  float getCoverage(uint32_t entity) const {
+    return entity < coverage.size() ? coverage[entity] : 1.f;
+  }
+
+  // Draw the quads picked by update() (CameraBlock must be bound), shaded
+  // like shader.frag with lightCount lights
+  void draw(const glm::vec3 &cameraPos, int lightCount);
+
+  const ImpostorStats &getStats() const { return stats; }
+
+private:
+  struct Tree {
+    std::vector<int> entities;
+    BoundingSphere bounds;
+    int firstTile = -1; // -1 until baked
+  };
+
+  Shader bakeShader;
+  Shader shader;
+  InstanceBuffer bakeInstances;
+  unsigned int atlas = 0;
+  unsigned int VAO = 0;
+  unsigned int VBO = 0;
+  size_t capacity = 0; // in instances
+  int tilesPerRow = IMPOSTOR_ATLAS_WIDTH / IMPOSTOR_TILE_SIZE;
+  int rows = 0;
+
+  std::vector<Tree> trees;
+  std::vector<ImpostorInstance> instances;
+  std::vector<float> coverage; // by entity id
+  ImpostorStats stats;
+};
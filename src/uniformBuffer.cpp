@@ -1,5 +1,11 @@
 #include "uniformBuffer.h"
 #include "../include/glad/glad.h"
+#include "glState.h"
+#include <GLFW/glfw3.h>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
 
 UniformBuffer::UniformBuffer() : UBO(0) {
   // Generate OpenGL buffer handle
@@ -7,20 +13,210 @@ UniformBuffer::UniformBuffer() : UBO(0) {
 }
 
 UniformBuffer::~UniformBuffer() {
-  // Only delete if we still own the resource
-  if (UBO)
+  for (void *fence : fences) {
+    if (fence) {
+      glDeleteSync(static_cast<GLsync>(fence));
+    }
+  }
+  // Only delete if we still own the resource (deleting also unmaps)
+  if (UBO) {
+    GLState::get().forgetBuffer(UBO);
     glDeleteBuffers(1, &UBO);
+  }
 }
 
 void UniformBuffer::uploadData(const void *data, size_t size) {
+  if (mapped) {
+    if (size > regionSize) {
+      std::cerr << "Uniform ring region is " << regionSize << " bytes, got "
+                << size << std::endl;
+      return;
+    }
+
+    // The GPU may still read this region from UNIFORM_RING_FRAMES frames ago
+    if (GLsync fence = static_cast<GLsync>(fences[frameIndex])) {
+      auto start = std::chrono::steady_clock::now();
+      GLenum result = glClientWaitSync(fence, 0, 0);
+      if (result == GL_TIMEOUT_EXPIRED) {
+        ++ringStats.fenceWaits;
+        do {
+          result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                    1000000); // 1 ms
+        } while (result == GL_TIMEOUT_EXPIRED);
+      }
+      ringStats.fenceWaitMs += std::chrono::duration<float, std::milli>(
+                                   std::chrono::steady_clock::now() - start)
+                                   .count();
+      glDeleteSync(fence);
+      fences[frameIndex] = nullptr;
+    }
+
+    // Coherent mapping: the write is visible to the GPU without a flush
+    std::memcpy(mapped + regionOffset(), data, size);
+    if (ringBindingPoint >= 0) {
+      bindToPoint(ringBindingPoint);
+    }
+    return;
+  }
+
   // Upload data to GPU buffer using GL_DYNAMIC_DRAW since lights may change
-  // Note: Buffer must already be bound to GL_UNIFORM_BUFFER target via
-  // bindToPoint()
+  GLState::get().bindBuffer(GL_UNIFORM_BUFFER, UBO);
   glBufferData(GL_UNIFORM_BUFFER, size, data, GL_DYNAMIC_DRAW);
 }
 
 void UniformBuffer::bindToPoint(unsigned int bindingPoint) {
+  if (mapped) {
+    ringBindingPoint = static_cast<int>(bindingPoint);
+    GLState::get().bindBufferRange(GL_UNIFORM_BUFFER, bindingPoint, UBO,
+                                   regionOffset(), regionSize);
+    return;
+  }
+
   // Bind this buffer to the specified uniform binding point
   // This makes the buffer data available to shaders at binding = bindingPoint
-  glBindBufferBase(GL_UNIFORM_BUFFER, bindingPoint, UBO);
+  GLState::get().bindBufferBase(GL_UNIFORM_BUFFER, bindingPoint, UBO);
+}
+
+bool UniformBuffer::createRing(size_t maxSize) {
+  if (!GLAD_GL_ARB_buffer_storage || !glBufferStorage)
+    return false;
+
+  // Every region must start on a valid glBindBufferRange offset
+  GLint alignment = 256;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  regionSize = maxSize;
+  regionStride = (maxSize + alignment - 1) / alignment * alignment;
+
+  // Storage is immutable, so the ring needs a fresh buffer object
+  GLState::get().forgetBuffer(UBO);
+  glDeleteBuffers(1, &UBO);
+  glGenBuffers(1, &UBO);
+  GLState::get().bindBuffer(GL_UNIFORM_BUFFER, UBO);
+
+  GLbitfield flags =
+      GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  size_t total = regionStride * UNIFORM_RING_FRAMES;
+  glBufferStorage(GL_UNIFORM_BUFFER, total, nullptr, flags);
+  mapped = static_cast<unsigned char *>(
+      glMapBufferRange(GL_UNIFORM_BUFFER, 0, total, flags));
+  if (!mapped) {
+    std::cerr << "Failed to map uniform ring, using glBufferData"
+              << std::endl;
+    GLState::get().forgetBuffer(UBO);
+    glDeleteBuffers(1, &UBO);
+    glGenBuffers(1, &UBO);
+    return false;
+  }
+  frameIndex = 0;
+  return true;
+}
+
+void UniformBuffer::endFrame() {
+  if (!mapped)
+    return;
+  fences[frameIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  frameIndex = (frameIndex + 1) % UNIFORM_RING_FRAMES;
+  ++ringStats.frames;
+}
+
+UniformRingStats UniformBuffer::takeRingStats() {
+  UniformRingStats stats = ringStats;
+  ringStats = UniformRingStats();
+  return stats;
+}
+
+// Diagonal matrices that differ per frame, so a stale region shows up
+static CameraBlock ringTestBlock(int frame) {
+  return {glm::mat4(float(frame + 1)), glm::mat4(-float(frame + 1))};
+}
+
+// Everything that needs the context, so it is gone before the window
+static int runUniformRingFrames() {
+  UniformBuffer ring;
+  if (!ring.createRing(sizeof(CameraBlock))) {
+    std::cerr << "uniform ring: no ARB_buffer_storage" << std::endl;
+    return 1;
+  }
+
+  // The GPU copies each frame's region here, after the CPU wrote it
+  unsigned int readback;
+  glGenBuffers(1, &readback);
+  GLState::get().bindBuffer(GL_COPY_WRITE_BUFFER, readback);
+  glBufferData(GL_COPY_WRITE_BUFFER,
+               sizeof(CameraBlock) * UNIFORM_RING_TEST_FRAMES, nullptr,
+               GL_STREAM_READ);
+
+  for (int frame = 0; frame < UNIFORM_RING_TEST_FRAMES; ++frame) {
+    CameraBlock block = ringTestBlock(frame);
+    ring.uploadData(&block, sizeof(block));
+    ring.bindToPoint(1);
+    GLState::get().bindBuffer(GL_COPY_READ_BUFFER, ring.getBuffer());
+    GLState::get().bindBuffer(GL_COPY_WRITE_BUFFER, readback);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                        ring.regionOffset(), sizeof(CameraBlock) * frame,
+                        sizeof(CameraBlock));
+    ring.endFrame();
+  }
+
+  std::vector<CameraBlock> copies(UNIFORM_RING_TEST_FRAMES);
+  GLState::get().bindBuffer(GL_COPY_WRITE_BUFFER, readback);
+  glGetBufferSubData(GL_COPY_WRITE_BUFFER, 0,
+                     sizeof(CameraBlock) * copies.size(), copies.data());
+  GLState::get().forgetBuffer(readback);
+  glDeleteBuffers(1, &readback);
+
+  int failures = 0;
+  for (int frame = 0; frame < UNIFORM_RING_TEST_FRAMES; ++frame) {
+    CameraBlock expected = ringTestBlock(frame);
+    if (std::memcmp(&copies[frame], &expected, sizeof(CameraBlock)) != 0) {
+      std::cerr << "uniform ring: frame " << frame << " read back wrong data"
+                << std::endl;
+      ++failures;
+    }
+  }
+  UniformRingStats stats = ring.takeRingStats();
+  if (stats.frames != size_t(UNIFORM_RING_TEST_FRAMES) ||
+      stats.fenceWaits > stats.frames || stats.fenceWaitMs < 0.f) {
+    std::cerr << "uniform ring: bad stats, " << stats.frames << " frames, "
+              << stats.fenceWaits << " fence waits" << std::endl;
+    ++failures;
+  }
+  if (GLenum error = glGetError(); error != GL_NO_ERROR) {
+    std::cerr << "uniform ring: GL error 0x" << std::hex << error << std::dec
+              << std::endl;
+    ++failures;
+  }
+
+  std::cerr << "uniform ring: " << stats.frames << " frames, "
+            << stats.fenceWaits << " fence waits (" << stats.fenceWaitMs
+            << " ms), " << (failures ? "FAILED" : "ok") << std::endl;
+  return failures ? 1 : 0;
+}
+
+int runUniformRingTest() {
+  if (!glfwInit()) {
+    std::cerr << "uniform ring: failed to initialize GLFW" << std::endl;
+    return 1;
+  }
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  GLFWwindow *window = glfwCreateWindow(64, 64, "uniform ring", NULL, NULL);
+  if (!window) {
+    std::cerr << "uniform ring: failed to create a context" << std::endl;
+    glfwTerminate();
+    return 1;
+  }
+  glfwMakeContextCurrent(window);
+
+  int result = 1;
+  if (gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+    result = runUniformRingFrames();
+  } else {
+    std::cerr << "uniform ring: failed to initialize GLAD" << std::endl;
+  }
+  glfwDestroyWindow(window);
+  glfwTerminate();
+  return result;
 }
@@ -5,21 +5,31 @@
 #include <glm/ext/vector_float3.hpp>
 
 // NOTE: any object that stays static per frame throw in UBO
-constexpr int MAX_LIGHTS = 128;
+// Lights live in a buffer texture (see lightClusters.h), not a UBO, so the
+// cap is far above what a uniform block could hold
+constexpr int MAX_LIGHTS = 4096;
 
+// Two RGBA32F texels per light
 struct alignas(32) LightData {
   glm::vec3 position;
-  float _padding1;
+  float radius; // beyond this the light is skipped, see lightRadius()
   glm::vec3 color;
   float intensity;
 };
 
-struct LightBlock {
-  LightData lights[MAX_LIGHTS];
-  int count;
-  int _padding[3]; // Pad to vec4 alignment
+// Frames a persistently mapped ring spans: the CPU fills one region while
+// the GPU may still be reading the other two
+constexpr int UNIFORM_RING_FRAMES = 3;
+
+struct UniformRingStats {
+  size_t frames = 0;
+  size_t fenceWaits = 0; // frames where the region's fence wasn't done yet
+  float fenceWaitMs = 0.f;
 };
 
+// Frames "--test-uniform-ring" drives through the ring
+constexpr int UNIFORM_RING_TEST_FRAMES = 4 * UNIFORM_RING_FRAMES;
+
 struct CameraBlock {
   glm::mat4 view;
   glm::mat4 projection;
@@ -37,14 +47,45 @@ public:
   UniformBuffer &operator=(UniformBuffer &&) = delete;
 
   // Upload data to GPU buffer. Can be called multiple times to update data.
+  // In ring mode this writes the current frame's region (once per frame,
+  // at most maxSize bytes) and rebinds it.
   void uploadData(const void *data, size_t size);
 
   // Bind buffer to a specific binding point for shaders to access
   void bindToPoint(unsigned int bindingPoint);
 
+  // Switch to a persistently mapped, fence-synced ring of
+  // UNIFORM_RING_FRAMES regions of maxSize bytes each. Needs
+  // ARB_buffer_storage; returns false and keeps using glBufferData without.
+  bool createRing(size_t maxSize);
+  bool isRing() const { return mapped != nullptr; }
+  // Ring mode: fence the region this frame's draws read and move on to the
+  // next. Call once per frame after the draws.
+  void endFrame();
+  // Counts since the last call
+  UniformRingStats takeRingStats();
+  // Ring mode: where the current frame's region starts in getBuffer()
+  size_t regionOffset() const { return regionStride * frameIndex; }
+
   // Get the OpenGL buffer handle
   unsigned int getBuffer() { return UBO; }
 
 private:
   unsigned int UBO; // Uniform Buffer Object handle
+
+  // Ring mode
+  unsigned char *mapped = nullptr;
+  size_t regionSize = 0;
+  size_t regionStride = 0; // regionSize rounded up to the offset alignment
+  int frameIndex = 0;
+  void *fences[UNIFORM_RING_FRAMES] = {}; // GLsync per region
+  int ringBindingPoint = -1; // last bindToPoint(), rebound after writes
+  UniformRingStats ringStats;
 };
+
+// "--test-uniform-ring" tool mode: creates a hidden context, writes a
+// different CameraBlock through a ring each frame for
+// UNIFORM_RING_TEST_FRAMES frames and has the GPU copy every region out.
+// Checks the copies and the ring stats; runs under Mesa's llvmpipe
+// (LIBGL_ALWAYS_SOFTWARE=1). Returns the process exit code.
+int runUniformRingTest();
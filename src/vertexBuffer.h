@@ -5,34 +5,18 @@
 #include <glm/ext/vector_float3.hpp>
 #include <vector>
 
+// Locations of Vertex::materialId and Vertex::color, after the
+// per-instance attributes
+constexpr unsigned int VERTEX_ATTRIB_MATERIAL = 12;
+constexpr unsigned int VERTEX_ATTRIB_COLOR = 13;
+
+// Interleaved vertex of every mesh; GeometryArena sets up the attributes
 struct Vertex {
   glm::vec3 position = glm::vec3(0.0f);
   glm::vec2 texCoord = glm::vec2(0.0f);
   glm::vec3 normal = glm::vec3(0.0f);
-  unsigned int materialId;
-};
-
-class vertexBuffer {
-public:
-  vertexBuffer();
-  ~vertexBuffer();
-
-  // Prevent copying/moving (OpenGL resources must stay in one place)
-  vertexBuffer(const vertexBuffer &) = delete;
-  vertexBuffer &operator=(const vertexBuffer &) = delete;
-  vertexBuffer(vertexBuffer &&) = delete;
-  vertexBuffer &operator=(vertexBuffer &&) = delete;
-
-  // Upload vertex data to GPU and configure vertex attributes.
-  // Must be called before rendering. Can be called multiple times to update
-  // data.
-  void uploadVertices(const std::vector<Vertex> &vertices);
-
-  // Returns the OpenGL VAO handle for binding before drawing
-  unsigned int getVAO() { return VAO; }
-
-private:
-  unsigned int
-      VAO; // Vertex Array Object - stores vertex attribute configuration
-  unsigned int VBO; // Vertex Buffer Object - stores actual vertex data on GPU
+  unsigned int materialId = 0; // index into the mesh's materials
+  // Normalized RGBA multiplied into the instance color. White except where
+  // static batching baked an entity's color in.
+  unsigned char color[4] = {255, 255, 255, 255};
 };
@@ -27,3 +27,5 @@ Window::Window(int width, int height, const std::string& title)
     }
   }
 }
+
+Window::~Window() { glfwTerminate(); }
@@ -5,6 +5,8 @@
 class Window {
 public:
   Window(int width, int height, const std::string& title);
+  // Terminates GLFW, destroying the window and its context
+  ~Window();
 
   int getWidth() { return width; }
   int getHeight() { return height; }
@@ -0,0 +1,64 @@
+// CPU-only checks for OcclusionCuller: no window or GL context needed.
+// Built and run by "make test".
+#include "occlusion.h"
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <iostream>
+
+static int failures = 0;
+
+static void check(bool condition, const char *what) {
+  if (!condition) {
+    std::cerr << "FAILED: " << what << std::endl;
+    ++failures;
+  }
+}
+
+static AABB boxAt(const glm::vec3 &center, float half) {
+  AABB box;
+  box.min = center - glm::vec3(half);
+  box.max = center + glm::vec3(half);
+  return box;
+}
+
+int main() {
+  // Camera 10 units in front of a cylinder of radius 3 and height 4 (the
+  // way systems.h places primitive occluders), looking at its middle
+  glm::mat4 projection =
+      glm::perspective(glm::radians(45.f),
+                       float(OCCLUSION_WIDTH) / OCCLUSION_HEIGHT, 0.1f, 100.f);
+  glm::mat4 view = glm::lookAt(glm::vec3(0.f, 2.f, -10.f),
+                               glm::vec3(0.f, 2.f, 0.f), glm::vec3(0, 1, 0));
+  glm::mat4 cylinder = glm::scale(glm::mat4(1.f), glm::vec3(3.f, 4.f, 3.f));
+  std::vector<OccluderBox> occluders = {{cylinder, unitCylinderOccluder(16)}};
+
+  OcclusionCuller culler;
+  culler.begin(projection * view, occluders);
+  culler.finish();
+
+  check(!culler.isVisible(boxAt(glm::vec3(0.f, 2.f, 6.f), 0.5f)),
+        "box behind the cylinder is hidden");
+  check(culler.isVisible(boxAt(glm::vec3(8.f, 2.f, 6.f), 0.5f)),
+        "box beside the cylinder is visible");
+  check(culler.isVisible(boxAt(glm::vec3(0.f, 2.f, -5.f), 0.5f)),
+        "box in front of the cylinder is visible");
+  check(culler.isVisible(boxAt(glm::vec3(0.f, 2.f, 6.f), 4.f)),
+        "box wider than the cylinder is visible");
+
+  OcclusionStats stats = culler.takeStats();
+  check(stats.occluders == 1, "one occluder rasterized");
+  check(stats.tested == 4 && stats.occluded == 1, "test counters");
+
+  // Nothing rasterized: everything is visible
+  culler.begin(projection * view, {});
+  culler.finish();
+  check(culler.isVisible(boxAt(glm::vec3(0.f, 2.f, 6.f), 0.5f)),
+        "box is visible without occluders");
+
+  if (failures > 0) {
+    std::cerr << failures << " occlusion check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cerr << "occlusion: all checks passed" << std::endl;
+  return 0;
+}